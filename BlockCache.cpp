@@ -0,0 +1,67 @@
+//
+// Created by 唐仁初 on 2022/12/22.
+//
+
+#include "BlockCache.h"
+#include <algorithm>
+
+namespace mvcc {
+
+    BlockCache::BlockCache(size_t capacity, size_t block_size) : block_size_(block_size),
+                                                                 slots_(std::max<size_t>(1, capacity / block_size)) {}
+
+    std::shared_ptr<const std::string> BlockCache::get(uint64_t block, const Loader &load) {
+        {
+            std::lock_guard<std::mutex> lg(mtx_);
+            auto it = index_.find(block);
+            if (it != index_.end()) {
+                auto &slot = slots_[it->second];
+                slot.referenced_ = true;
+                hits_.fetch_add(1);
+                return slot.data_;
+            }
+        }
+
+        misses_.fetch_add(1);
+
+        // 加载时不持有锁，多个线程同时加载同一个块时只保留一份
+        auto data = std::make_shared<std::string>();
+        if (!load(block, *data))
+            return nullptr;
+
+        if (data->size() != block_size_)
+            return data;    // 文件末尾不完整的块之后还会被追加，不能缓存
+
+        std::lock_guard<std::mutex> lg(mtx_);
+        auto it = index_.find(block);
+        if (it != index_.end())
+            return slots_[it->second].data_;
+
+        // 清除引用位直到找到一个最近没有被访问的槽位
+        while (slots_[hand_].data_ != nullptr && slots_[hand_].referenced_) {
+            slots_[hand_].referenced_ = false;
+            hand_ = (hand_ + 1) % slots_.size();
+        }
+
+        auto &slot = slots_[hand_];
+        if (slot.data_ != nullptr)
+            index_.erase(slot.block_);
+
+        slot = {block, data, false};
+        index_[block] = hand_;
+        hand_ = (hand_ + 1) % slots_.size();
+        return data;
+    }
+
+    size_t BlockCache::blockSize() const {
+        return block_size_;
+    }
+
+    size_t BlockCache::hitNum() const {
+        return hits_.load();
+    }
+
+    size_t BlockCache::missNum() const {
+        return misses_.load();
+    }
+}
@@ -0,0 +1,77 @@
+//
+// Created by 唐仁初 on 2022/12/22.
+//
+
+#ifndef ALGYOLO_BLOCKCACHE_H
+#define ALGYOLO_BLOCKCACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace mvcc {
+
+    /// @brief A fixed capacity cache of file blocks with CLOCK replacement.
+    /// @details Class BlockCache keeps whole blocks of a file. Each slot has a reference bit which is set on hit, and
+    /// the clock hand clears reference bits until it finds a slot to replace, so blocks read again soon stay in cache
+    /// without moving any list node on hit. Blocks are returned as shared ptrs, so a block replaced while being read
+    /// stays valid for the reader.
+    /// @note All operations are thread safe.
+    class BlockCache {
+    public:
+
+        /// Callback loading a block. It fills data and returns false on error. Only blocks of full size are cached.
+        using Loader = std::function<bool(uint64_t block, std::string &data)>;
+
+        /// Constructs an empty cache.
+        /// \param capacity Max bytes of cached blocks
+        /// \param block_size Size of each block
+        explicit BlockCache(size_t capacity, size_t block_size = 4096);
+
+        BlockCache(const BlockCache &other) = delete;
+
+        BlockCache &operator=(const BlockCache &other) = delete;
+
+        /// Get a block from cache, or load it with given loader on miss.
+        /// \param block Index of block
+        /// \param load Loader of block
+        /// \return Data of block, nullptr if loading failed
+        std::shared_ptr<const std::string> get(uint64_t block, const Loader &load);
+
+        /// Size of each block.
+        /// \return Block size
+        [[nodiscard]] size_t blockSize() const;
+
+        /// Num of gets served from cache.
+        /// \return Hit num
+        [[nodiscard]] size_t hitNum() const;
+
+        /// Num of gets which loaded the block.
+        /// \return Miss num
+        [[nodiscard]] size_t missNum() const;
+
+    private:
+
+        struct Slot {
+            uint64_t block_ = 0;
+            std::shared_ptr<const std::string> data_;
+            bool referenced_ = false;
+        };
+
+        size_t block_size_;
+        std::mutex mtx_;
+        std::vector<Slot> slots_;
+        std::unordered_map<uint64_t, size_t> index_;    // 块号到槽位的映射
+        size_t hand_ = 0;                               // 时钟指针
+
+        std::atomic<size_t> hits_ = 0;
+        std::atomic<size_t> misses_ = 0;
+    };
+}
+
+#endif //ALGYOLO_BLOCKCACHE_H
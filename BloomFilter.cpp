@@ -0,0 +1,96 @@
+//
+// Created by 唐仁初 on 2022/12/12.
+//
+
+#include "BloomFilter.h"
+#include <algorithm>
+#include <functional>
+
+namespace mvcc {
+
+    BloomFilter::Layer::Layer(size_t capacity, int bits_per_key, Layer *nxt)
+            : capacity_(capacity), bits_per_key_(bits_per_key), bits_((capacity * bits_per_key + 63) / 64 * 64),
+              k_(std::max(1, static_cast<int>(bits_per_key * 0.69))), words_(new std::atomic<uint64_t>[bits_ / 64]),
+              nxt_(nxt) {
+        for (size_t i = 0; i < bits_ / 64; i++) {
+            words_[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void BloomFilter::Layer::add(uint64_t h1, uint64_t h2) {
+        for (int i = 0; i < k_; i++) {
+            auto bit = (h1 + i * h2) % bits_;
+            auto mask = uint64_t(1) << (bit % 64);
+            // 已经置位时不再写入，避免无谓的缓存行失效
+            if ((words_[bit / 64].load(std::memory_order_relaxed) & mask) == 0)
+                words_[bit / 64].fetch_or(mask);
+        }
+    }
+
+    bool BloomFilter::Layer::mayContain(uint64_t h1, uint64_t h2) const {
+        for (int i = 0; i < k_; i++) {
+            auto bit = (h1 + i * h2) % bits_;
+            if ((words_[bit / 64].load(std::memory_order_acquire) & (uint64_t(1) << (bit % 64))) == 0)
+                return false;
+        }
+        return true;
+    }
+
+    BloomFilter::BloomFilter(size_t expected, int bits_per_key)
+            : head_(new Layer(std::max<size_t>(expected, 64), bits_per_key, nullptr)) {}
+
+    BloomFilter::~BloomFilter() {
+        auto layer = head_.load();
+        while (layer != nullptr) {
+            auto nxt = layer->nxt_;
+            delete layer;
+            layer = nxt;
+        }
+    }
+
+    void BloomFilter::add(const std::string &key) {
+        auto [h1, h2] = hash(key);
+
+        auto head = head_.load();
+
+        // 当前位数组已满，追加一个更大的位数组，并且增加每个键的位数，使总误判率收敛
+        while (head->count_.load() >= head->capacity_) {
+            auto layer = new Layer(head->capacity_ * 4, head->bits_per_key_ + 2, head);
+            if (head_.compare_exchange_strong(head, layer)) {
+                head = layer;
+                break;
+            }
+            delete layer;
+        }
+
+        head->add(h1, h2);
+        head->count_.fetch_add(1);
+    }
+
+    bool BloomFilter::mayContain(const std::string &key) const {
+        auto [h1, h2] = hash(key);
+
+        for (auto layer = head_.load(); layer != nullptr; layer = layer->nxt_) {
+            if (layer->mayContain(h1, h2))
+                return true;
+        }
+        return false;
+    }
+
+    size_t BloomFilter::memoryUse() const {
+        size_t mem = sizeof(BloomFilter);
+        for (auto layer = head_.load(); layer != nullptr; layer = layer->nxt_) {
+            mem += sizeof(Layer) + layer->bits_ / 8;
+        }
+        return mem;
+    }
+
+    std::pair<uint64_t, uint64_t> BloomFilter::hash(const std::string &key) {
+        uint64_t h1 = std::hash<std::string>()(key);
+        // 使用 murmur 的混合函数得到第二个哈希值，第二个哈希值必须为奇数
+        uint64_t h2 = h1 ^ (h1 >> 33);
+        h2 *= 0xff51afd7ed558ccdULL;
+        h2 ^= h2 >> 33;
+        return {h1, h2 | 1};
+    }
+}
@@ -0,0 +1,78 @@
+//
+// Created by 唐仁初 on 2022/12/12.
+//
+
+#ifndef ALGYOLO_BLOOMFILTER_H
+#define ALGYOLO_BLOOMFILTER_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace mvcc {
+
+    /// @brief A concurrent approximate-membership filter of keys.
+    /// @details Class BloomFilter is a scalable bloom filter. It's made up of a chain of bit arrays. Keys are always
+    /// added to the newest bit array, and a larger and sparser one will be appended when it is full, so false positive
+    /// rate will not grow with key num. Query checks all bit arrays. Keys can not be removed, so the filter should be rebuilt
+    /// after compaction.
+    /// @note All operations are thread safe and lock free. There is no false negative.
+    class BloomFilter {
+    public:
+
+        /// Constructs an empty filter.
+        /// \param expected Expected key num of the first bit array
+        /// \param bits_per_key Bits used for each key, which decides the false positive rate
+        explicit BloomFilter(size_t expected = 1024, int bits_per_key = 10);
+
+        /// Release all bit arrays.
+        ~BloomFilter();
+
+        BloomFilter(const BloomFilter &other) = delete;
+
+        BloomFilter &operator=(const BloomFilter &other) = delete;
+
+        /// Add a key to filter.
+        /// \param key Key to add
+        void add(const std::string &key);
+
+        /// Check if a key may be added to filter. If returns false, key is surely not added.
+        /// \param key Key to check
+        /// \return May key be added
+        [[nodiscard]] bool mayContain(const std::string &key) const;
+
+        /// Get approximately memory use of this filter.
+        /// \return Memory use
+        [[nodiscard]] size_t memoryUse() const;
+
+    private:
+
+        /// A fixed size bit array.
+        struct Layer {
+
+            Layer(size_t capacity, int bits_per_key, Layer *nxt);
+
+            void add(uint64_t h1, uint64_t h2);
+
+            [[nodiscard]] bool mayContain(uint64_t h1, uint64_t h2) const;
+
+            size_t capacity_;   // 可容纳的键数量
+            int bits_per_key_;
+            size_t bits_;
+            int k_;     // 哈希函数个数
+            std::atomic<size_t> count_ = 0;
+            std::unique_ptr<std::atomic<uint64_t>[]> words_;
+            Layer *nxt_;    // 更旧的位数组
+        };
+
+        // Get two independent hashes of key.
+        static std::pair<uint64_t, uint64_t> hash(const std::string &key);
+
+    private:
+
+        std::atomic<Layer *> head_;     // 最新的位数组
+    };
+}
+
+#endif //ALGYOLO_BLOOMFILTER_H
@@ -0,0 +1,185 @@
+//
+// Created by 唐仁初 on 2022/12/24.
+//
+
+#include "ChangeStream.h"
+#include "OpCoordinator.h"
+#include <algorithm>
+#include <unordered_map>
+
+namespace mvcc {
+
+    namespace {
+        std::atomic<uint64_t> next_stream_id{1};
+    }
+
+    ChangeStream::Ring::Ring(size_t capacity) : slots_(capacity) {}
+
+    ChangeStream::ChangeStream(size_t history, size_t ring_size)
+            : id_(next_stream_id.fetch_add(1)), history_size_(std::max<size_t>(1, history)),
+              ring_size_(std::max<size_t>(1, ring_size)) {
+
+        merger_ = std::thread([this] {
+            work();
+        });
+    }
+
+    ChangeStream::~ChangeStream() {
+        {
+            std::lock_guard<std::mutex> lg(mtx_);
+            stop_ = true;
+        }
+        work_cv_.notify_all();
+        poll_cv_.notify_all();
+        merger_.join();
+    }
+
+    void ChangeStream::publish(long version, ChangeType type, const std::string &key, const std::string &value) {
+        auto ring = localRing();
+
+        size_t tail = ring->tail_.load(std::memory_order_relaxed);
+        while (tail - ring->head_.load(std::memory_order_acquire) >= ring->slots_.size()) {
+            // 合并线程总是会及时取走所有变更，不会等待订阅者，所以缓冲已满时只需要短暂等待
+            wake();
+            full_num_.fetch_add(1);
+            std::this_thread::yield();
+        }
+        ring->slots_[tail % ring->slots_.size()] = {version, type, key, value};
+        ring->tail_.store(tail + 1, std::memory_order_release);
+
+        wake();
+    }
+
+    void ChangeStream::wake() {
+        // 只有合并之后的第一个变更需要唤醒合并线程，加锁防止唤醒发生在合并线程检查条件之后、等待之前
+        if (!dirty_.exchange(true)) {
+            { std::lock_guard<std::mutex> lg(mtx_); }
+            work_cv_.notify_one();
+        }
+    }
+
+    ChangeStream::Ring *ChangeStream::localRing() {
+        thread_local std::unordered_map<uint64_t, std::shared_ptr<Ring>> rings;
+
+        auto &ring = rings[id_];
+        if (ring != nullptr)
+            return ring.get();
+
+        // 实例析构之后只有当前线程还持有它的环形缓冲，顺便释放
+        for (auto it = rings.begin(); it != rings.end();) {
+            it = it->second != nullptr && it->second.use_count() == 1 ? rings.erase(it) : std::next(it);
+        }
+
+        auto created = std::make_shared<Ring>(ring_size_);
+        {
+            std::lock_guard<std::mutex> lg(rings_mtx_);
+            rings_.emplace_back(created);
+        }
+        rings[id_] = created;
+        return created.get();
+    }
+
+    bool ChangeStream::poll(long &cursor, std::vector<Change> &changes, size_t max, int wait_ms) {
+        std::unique_lock<std::mutex> lk(mtx_);
+
+        if (wait_ms > 0) {
+            poll_cv_.wait_for(lk, std::chrono::milliseconds(wait_ms), [this, cursor] {
+                return last_version_ > cursor || stop_;
+            });
+        }
+
+        if (cursor < dropped_version_)
+            return false;
+
+        auto it = std::upper_bound(history_.begin(), history_.end(), cursor, [](long version, const Change &change) {
+            return version < change.version_;
+        });
+
+        // 同一个版本的变更一起返回
+        size_t num = 0;
+        for (; it != history_.end() && (num < max || it->version_ == cursor); ++it, ++num) {
+            changes.emplace_back(*it);
+            cursor = it->version_;
+        }
+        return true;
+    }
+
+    long ChangeStream::lastVersion() const {
+        std::lock_guard<std::mutex> lg(mtx_);
+        return last_version_;
+    }
+
+    size_t ChangeStream::fullNum() const {
+        return full_num_.load();
+    }
+
+    void ChangeStream::work() {
+
+        std::unique_lock<std::mutex> lk(mtx_);
+
+        while (!stop_) {
+            // 还有等待确认顺序的变更时定期检查，否则等待新的变更
+            if (pending_.empty())
+                work_cv_.wait(lk, [this] { return stop_ || dirty_.load(); });
+            else
+                work_cv_.wait_for(lk, std::chrono::milliseconds(1));
+
+            if (stop_)
+                break;
+
+            lk.unlock();
+
+            // 先获取已结束的版本再取出变更，不大于该版本的操作都已经发布了它们的变更
+            long released = Coordinator.getReleasedVersion();
+            dirty_.store(false);
+
+            std::vector<std::shared_ptr<Ring>> rings;
+            {
+                std::lock_guard<std::mutex> lg(rings_mtx_);
+                rings = rings_;
+            }
+
+            size_t sorted = pending_.size();
+            for (auto &ring: rings) {
+                size_t head = ring->head_.load(std::memory_order_relaxed);
+                size_t tail = ring->tail_.load(std::memory_order_acquire);
+                for (; head < tail; head++) {
+                    pending_.emplace_back(std::move(ring->slots_[head % ring->slots_.size()]));
+                }
+                ring->head_.store(tail, std::memory_order_release);
+            }
+
+            // 只对新取出的变更排序，再与已排序的部分归并。同一个操作的变更在同一个缓冲中，稳定排序保持它们的顺序，
+            // 归并时之前取出的变更排在同一版本新取出的变更之前
+            auto by_version = [](const Change &a, const Change &b) {
+                return a.version_ < b.version_;
+            };
+            auto drained = pending_.begin() + static_cast<long>(sorted);
+            std::stable_sort(drained, pending_.end(), by_version);
+            if (drained != pending_.begin() && drained != pending_.end() && by_version(*drained, *(drained - 1)))
+                std::inplace_merge(pending_.begin(), drained, pending_.end(), by_version);
+
+            auto ready = std::upper_bound(pending_.begin(), pending_.end(), released,
+                                          [](long version, const Change &change) {
+                                              return version < change.version_;
+                                          });
+
+            lk.lock();
+
+            if (ready == pending_.begin())
+                continue;
+
+            for (auto it = pending_.begin(); it != ready; ++it) {
+                history_.emplace_back(std::move(*it));
+            }
+            pending_.erase(pending_.begin(), ready);
+            last_version_ = history_.back().version_;
+
+            while (history_.size() > history_size_) {
+                dropped_version_ = history_.front().version_;
+                history_.pop_front();
+            }
+            poll_cv_.notify_all();
+        }
+    }
+}
@@ -0,0 +1,134 @@
+//
+// Created by 唐仁初 on 2022/12/24.
+//
+
+#ifndef ALGYOLO_CHANGESTREAM_H
+#define ALGYOLO_CHANGESTREAM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace mvcc {
+
+    /// @brief Change data capture stream of a table, ordered by commit version.
+    /// @details Class ChangeStream collects committed changes of a table and lets subscribers follow them. Writers
+    /// publish changes into a ring buffer owned by the writing thread, so publishing never contends with other writers
+    /// or with subscribers. A merger thread drains all rings and moves changes into a bounded history in version order.
+    /// The merger never waits for subscribers, so a writer finding its ring full only waits for the next drain.
+    /// A change is only moved once all operations with smaller versions have finished, which is decided by the released
+    /// version of OpCoordinator, so a subscriber never sees a change before one with a smaller version.
+    /// Subscribers poll the history with their own cursor, which is the version of the last change they consumed, so
+    /// they can resume from any version still in history. When history is full the oldest changes are dropped, and a
+    /// subscriber behind them is told to resync, so slow subscribers never block writers.
+    /// @note Only writes delay the stream. A snapshot held for a long time, such as an iterator or a checkpoint, does
+    /// not, but an interactive transaction left open delays it until the transaction ends.
+    class ChangeStream {
+    public:
+
+        /// Describes the type of a change
+        enum ChangeType {
+            /// A value is written
+            put,
+            /// A key is erased
+            erase
+        };
+
+        /// @brief One committed change.
+        struct Change {
+            long version_;
+            ChangeType type_;
+            std::string key_;
+            std::string value_;     // 删除时为空
+        };
+
+        /// Start the merger thread.
+        /// \param history Max num of changes kept for subscribers
+        /// \param ring_size Capacity of the ring buffer of each writer thread
+        explicit ChangeStream(size_t history = 1 << 16, size_t ring_size = 1024);
+
+        /// Stop the merger thread. Changes not merged yet are dropped.
+        ~ChangeStream();
+
+        ChangeStream(const ChangeStream &other) = delete;
+
+        ChangeStream &operator=(const ChangeStream &other) = delete;
+
+        /// Publish a committed change. Must be called before the version of the change is released. Never blocks on
+        /// subscribers. Thread safe.
+        /// \param version Commit version
+        /// \param type Type of change
+        /// \param key Key of change
+        /// \param value Value written, empty for erase
+        void publish(long version, ChangeType type, const std::string &key, const std::string &value);
+
+        /// Get changes after given cursor in version order. Changes of one version are never split between two polls.
+        /// \param cursor Version of the last consumed change, 0 to read from the oldest one. Advanced to the version of
+        /// the last returned change
+        /// \param changes Returned changes are appended
+        /// \param max Max num of changes returned, exceeded only to keep a version whole
+        /// \param wait_ms Max time to wait if there is no change after cursor
+        /// \return False if changes after cursor have been dropped from history, subscriber needs to resync
+        bool poll(long &cursor, std::vector<Change> &changes, size_t max = 1024, int wait_ms = 0);
+
+        /// Version of the newest change in history. A new subscriber starting from it only sees later changes.
+        /// \return Version, 0 if there is no change
+        [[nodiscard]] long lastVersion() const;
+
+        /// Num of times a writer found its ring buffer full and waited for the merger.
+        /// \return Wait num
+        [[nodiscard]] size_t fullNum() const;
+
+    private:
+
+        /// A single producer single consumer ring buffer of one writer thread.
+        struct Ring {
+
+            explicit Ring(size_t capacity);
+
+            std::vector<Change> slots_;
+            std::atomic<size_t> head_ = 0;  // 合并线程读取的位置
+            std::atomic<size_t> tail_ = 0;  // 写线程写入的位置
+        };
+
+        // Ring of calling thread, created on first publish.
+        Ring *localRing();
+
+        // Wake the merger if it is waiting for changes.
+        void wake();
+
+        // Merger loop.
+        void work();
+
+    private:
+
+        uint64_t id_;               // 区分不同的实例，线程局部的环形缓冲以它为键
+        size_t history_size_;
+        size_t ring_size_;
+
+        std::mutex rings_mtx_;
+        std::vector<std::shared_ptr<Ring>> rings_;
+        std::atomic<size_t> full_num_ = 0;
+
+        std::atomic<bool> dirty_ = false;   // 上次合并之后是否有新的变更
+        std::deque<Change> pending_;        // 已取出但版本号还不能确认顺序的变更，按版本号排序，只由合并线程访问
+
+        mutable std::mutex mtx_;
+        std::condition_variable work_cv_;
+        std::condition_variable poll_cv_;   // 有新的变更进入历史时唤醒订阅者
+        std::deque<Change> history_;
+        long dropped_version_ = 0;          // 已经从历史中丢弃的最大版本
+        long last_version_ = 0;
+        bool stop_ = false;
+
+        std::thread merger_;
+    };
+}
+
+#endif //ALGYOLO_CHANGESTREAM_H
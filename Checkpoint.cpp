@@ -0,0 +1,184 @@
+//
+// Created by 唐仁初 on 2022/12/20.
+//
+
+#include "Checkpoint.h"
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace mvcc {
+
+    namespace {
+        constexpr char kMagic[8] = {'M', 'V', 'C', 'C', 'C', 'K', 'P', 'T'};
+        constexpr size_t kHeaderSize = 24;
+        constexpr size_t kFooterSize = 24;
+    }
+
+    CheckpointWriter::CheckpointWriter(std::string path, const CheckpointHeader &header)
+            : path_(std::move(path)), tmp_path_(path_ + ".tmp") {
+
+        file_ = std::fopen(tmp_path_.c_str(), "wb");
+        if (file_ == nullptr)
+            throw std::runtime_error("Create checkpoint file failed : " + tmp_path_);
+
+        std::setvbuf(file_, nullptr, _IOFBF, 1 << 20);
+
+        int64_t version = header.version_;
+        write(kMagic, sizeof(kMagic));
+        write(&version, sizeof(version));
+        write(&header.log_batches_, sizeof(header.log_batches_));
+    }
+
+    CheckpointWriter::~CheckpointWriter() {
+        if (file_ != nullptr) {
+            std::fclose(file_);
+            std::remove(tmp_path_.c_str());
+        }
+    }
+
+    bool CheckpointWriter::add(const std::string &key, const std::string &value) {
+        offsets_.push_back(offset_);
+
+        auto key_size = static_cast<uint32_t>(key.size());
+        auto value_size = static_cast<uint32_t>(value.size());
+        write(&key_size, sizeof(key_size));
+        write(&value_size, sizeof(value_size));
+        write(key.data(), key.size());
+        return write(value.data(), value.size());
+    }
+
+    bool CheckpointWriter::finish() {
+        uint64_t index_offset = offset_;
+        uint64_t count = offsets_.size();
+
+        write(offsets_.data(), offsets_.size() * sizeof(uint64_t));
+        write(&count, sizeof(count));
+        write(&index_offset, sizeof(index_offset));
+        write(kMagic, sizeof(kMagic));
+
+        // 数据落盘之后再替换旧的检查点
+        ok_ = ok_ && std::fflush(file_) == 0 && ::fsync(fileno(file_)) == 0;
+        ok_ = std::fclose(file_) == 0 && ok_;
+        file_ = nullptr;
+
+        if (!ok_ || std::rename(tmp_path_.c_str(), path_.c_str()) != 0) {
+            std::remove(tmp_path_.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    size_t CheckpointWriter::size() const {
+        return offsets_.size();
+    }
+
+    bool CheckpointWriter::write(const void *data, size_t n) {
+        if (ok_ && n > 0)
+            ok_ = std::fwrite(data, 1, n, file_) == n;
+        offset_ += n;
+        return ok_;
+    }
+
+    CheckpointReader::CheckpointReader(const std::string &path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return;
+
+        struct stat st{};
+        if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < kHeaderSize + kFooterSize) {
+            ::close(fd);
+            return;
+        }
+
+        // 映射之后文件描述符就不再需要了，页面在访问时才会加载
+        length_ = static_cast<size_t>(st.st_size);
+        void *data = ::mmap(nullptr, length_, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED) {
+            length_ = 0;
+            return;
+        }
+        data_ = static_cast<const char *>(data);
+
+        uint64_t count, index_offset;
+        int64_t version;
+        std::memcpy(&count, data_ + length_ - kFooterSize, sizeof(count));
+        std::memcpy(&index_offset, data_ + length_ - kFooterSize + 8, sizeof(index_offset));
+        std::memcpy(&version, data_ + 8, sizeof(version));
+        std::memcpy(&header_.log_batches_, data_ + 16, sizeof(header_.log_batches_));
+        header_.version_ = static_cast<long>(version);
+
+        // 先检查首尾的魔数，再检查索引正好位于数据之后、尾部之前
+        valid_ = std::memcmp(data_, kMagic, sizeof(kMagic)) == 0 &&
+                 std::memcmp(data_ + length_ - sizeof(kMagic), kMagic, sizeof(kMagic)) == 0 &&
+                 index_offset >= kHeaderSize && count <= (length_ - kHeaderSize - kFooterSize) / sizeof(uint64_t) &&
+                 index_offset + count * sizeof(uint64_t) + kFooterSize == length_;
+
+        if (valid_) {
+            index_ = data_ + index_offset;
+            count_ = count;
+        }
+    }
+
+    CheckpointReader::~CheckpointReader() {
+        if (data_ != nullptr)
+            ::munmap(const_cast<char *>(data_), length_);
+    }
+
+    bool CheckpointReader::valid() const {
+        return valid_;
+    }
+
+    const CheckpointHeader &CheckpointReader::header() const {
+        return header_;
+    }
+
+    size_t CheckpointReader::size() const {
+        return count_;
+    }
+
+    bool CheckpointReader::entry(size_t i, std::string_view &key, std::string_view &value) const {
+        if (i >= count_)
+            return false;
+
+        uint64_t offset;
+        std::memcpy(&offset, index_ + i * sizeof(uint64_t), sizeof(offset));
+
+        // 记录必须位于文件头和索引之间
+        auto limit = static_cast<uint64_t>(index_ - data_);
+        if (offset < kHeaderSize || offset > limit || limit - offset < 8)
+            return false;
+
+        uint32_t key_size, value_size;
+        std::memcpy(&key_size, data_ + offset, sizeof(key_size));
+        std::memcpy(&value_size, data_ + offset + 4, sizeof(value_size));
+        if (limit - offset - 8 < static_cast<uint64_t>(key_size) + value_size)
+            return false;
+
+        key = std::string_view(data_ + offset + 8, key_size);
+        value = std::string_view(data_ + offset + 8 + key_size, value_size);
+        return true;
+    }
+
+    bool CheckpointReader::read(const std::string &path, CheckpointHeader &header,
+                                const std::function<void(const std::string &, const std::string &)> &apply) {
+
+        CheckpointReader reader(path);
+        if (!reader.valid())
+            return false;
+
+        header = reader.header();
+
+        std::string_view key, value;
+        for (size_t i = 0; i < reader.size(); i++) {
+            if (!reader.entry(i, key, value))
+                return false;
+            apply(std::string(key), std::string(value));
+        }
+        return true;
+    }
+}
@@ -0,0 +1,129 @@
+//
+// Created by 唐仁初 on 2022/12/20.
+//
+
+#ifndef ALGYOLO_CHECKPOINT_H
+#define ALGYOLO_CHECKPOINT_H
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace mvcc {
+
+    /// @brief Header of a checkpoint file.
+    /// @details A checkpoint holds all live records of a table seen by one snapshot. All operations with versions less
+    /// than version_ were finished before the snapshot, and all of them are in the log before the first log_batches_
+    /// batches, so recovery only needs to replay the log from batch log_batches_.
+    struct CheckpointHeader {
+        long version_ = 0;
+        uint64_t log_batches_ = 0;
+    };
+
+    /// @brief Writes a checkpoint file in key order.
+    /// @details File layout : | magic | version | log batches | entries | offset of each entry | count | offset of index |
+    /// magic |. An entry is | key size (4) | value size (4) | key | value |. Entries are written to a temp file, which
+    /// is renamed to the final path by finish, so a checkpoint file is either complete or absent.
+    class CheckpointWriter {
+    public:
+
+        /// Create the temp file of given checkpoint path.
+        /// \param path Path of checkpoint
+        /// \param header Header of checkpoint
+        /// @throw std::runtime_error if the file can not be created
+        CheckpointWriter(std::string path, const CheckpointHeader &header);
+
+        /// Remove the temp file if finish was not called.
+        ~CheckpointWriter();
+
+        CheckpointWriter(const CheckpointWriter &other) = delete;
+
+        CheckpointWriter &operator=(const CheckpointWriter &other) = delete;
+
+        /// Append a record. Keys must be appended in ascending order.
+        /// \param key Key of record
+        /// \param value Value of record
+        /// \return Is write succeeded
+        bool add(const std::string &key, const std::string &value);
+
+        /// Write the index, sync the file and rename it to the checkpoint path.
+        /// \return Is checkpoint complete
+        bool finish();
+
+        /// Num of records appended.
+        /// \return num
+        [[nodiscard]] size_t size() const;
+
+    private:
+
+        // Write given bytes and advance offset.
+        bool write(const void *data, size_t n);
+
+    private:
+        std::string path_;
+        std::string tmp_path_;
+        FILE *file_ = nullptr;
+        uint64_t offset_ = 0;
+        std::vector<uint64_t> offsets_;     // 每条记录的起始位置
+        bool ok_ = true;
+    };
+
+    /// @brief Reads a checkpoint file written by CheckpointWriter through a read-only memory map.
+    /// @details The file is mapped rather than read, so pages are loaded lazily when entries are accessed, and entries
+    /// can be read by many threads at the same time. The offset index makes each entry addressable, so a checkpoint can
+    /// be split into ranges and loaded in parallel. Key and value views are valid until the reader is destructed.
+    class CheckpointReader {
+    public:
+
+        /// Map given checkpoint file and check its header and footer.
+        /// \param path Path of checkpoint
+        explicit CheckpointReader(const std::string &path);
+
+        /// Unmap the file.
+        ~CheckpointReader();
+
+        CheckpointReader(const CheckpointReader &other) = delete;
+
+        CheckpointReader &operator=(const CheckpointReader &other) = delete;
+
+        /// Is the file a complete checkpoint.
+        /// \return False if the file does not exist or is not a complete checkpoint
+        [[nodiscard]] bool valid() const;
+
+        /// Header of checkpoint, only meaningful if valid.
+        /// \return Header
+        [[nodiscard]] const CheckpointHeader &header() const;
+
+        /// Num of records in checkpoint.
+        /// \return num
+        [[nodiscard]] size_t size() const;
+
+        /// Read the i-th record in key order. Thread safe.
+        /// \param i Index of record, less than size()
+        /// \param key Key of record
+        /// \param value Value of record
+        /// \return False if the entry is out of the file
+        bool entry(size_t i, std::string_view &key, std::string_view &value) const;
+
+        /// Read all records of a checkpoint in key order.
+        /// \param path Path of checkpoint
+        /// \param header Header of checkpoint
+        /// \param apply Callback of each record
+        /// \return False if the file does not exist or is not a complete checkpoint
+        static bool read(const std::string &path, CheckpointHeader &header,
+                         const std::function<void(const std::string &, const std::string &)> &apply);
+
+    private:
+        const char *data_ = nullptr;
+        size_t length_ = 0;
+        CheckpointHeader header_;
+        const char *index_ = nullptr;   // 每条记录的起始位置，可能不对齐
+        size_t count_ = 0;
+        bool valid_ = false;
+    };
+}
+
+#endif //ALGYOLO_CHECKPOINT_H
@@ -0,0 +1,319 @@
+//
+// Created by 唐仁初 on 2022/12/10.
+//
+
+#ifndef ALGYOLO_HASHINDEX_H
+#define ALGYOLO_HASHINDEX_H
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace mvcc {
+
+    /// @brief An open-addressed hash index mapping keys to value ptrs.
+    /// @details Class HashIndex is a side index used for point lookups. Readers are lock-free: a lookup only loads the
+    /// current slot array and probes it linearly, which usually costs one or two cache misses. Writers are serialized
+    /// by a mutex, because only insertions of new keys need to write the index. Entries and slot arrays replaced by a
+    /// resize are retired rather than freed, and will be released by function reclaim.
+    /// \tparam V Value type pointed by index
+    /// @note The index does not own the values.
+    template<typename V>
+    class HashIndex {
+    private:
+
+        /// An entry of the index. Entries are never moved, so a reader holding an entry ptr is always valid.
+        struct Entry {
+
+            Entry(size_t hash, std::string key, V *value) : hash_(hash), key_(std::move(key)), value_(value) {}
+
+            size_t hash_;
+            std::string key_;
+            std::atomic<V *> value_;    // nullptr 表示已被删除
+        };
+
+        /// A slot array whose capacity is a power of two.
+        struct Table {
+
+            explicit Table(size_t capacity) : mask_(capacity - 1), slots_(new std::atomic<Entry *>[capacity]) {
+                for (size_t i = 0; i < capacity; i++) {
+                    slots_[i].store(nullptr);
+                }
+            }
+
+            ~Table() {
+                delete[] slots_;
+            }
+
+            [[nodiscard]] size_t capacity() const {
+                return mask_ + 1;
+            }
+
+            size_t mask_;
+            std::atomic<Entry *> *slots_;
+        };
+
+    public:
+
+        /// Construct an empty HashIndex with given initial capacity. The capacity will be rounded up to a power of two.
+        /// \param capacity Initial capacity
+        explicit HashIndex(size_t capacity = 1024) : table_(new Table(roundUp(capacity))) {
+            charge(static_cast<long>(tableBytes(table_.load())));
+        }
+
+        /// Release all entries and slot arrays, not thread safe.
+        ~HashIndex() {
+            auto table = table_.load();
+            for (size_t i = 0; i < table->capacity(); i++) {
+                delete table->slots_[i].load();
+            }
+            delete table;
+            reclaim();
+
+            charge(-static_cast<long>(mem_use_.load()));
+        }
+
+        HashIndex(const HashIndex &other) = delete;
+
+        HashIndex &operator=(const HashIndex &other) = delete;
+
+        /// Find the value ptr with given key. If not found, returns nullptr.
+        /// \param key The key to find
+        /// \return Value ptr or nullptr
+        /// @note Thread safe and lock free
+        V *find(const std::string &key) const {
+            auto entry = findEntry(table_.load(), std::hash<std::string>()(key), key);
+            return entry == nullptr ? nullptr : entry->value_.load();
+        }
+
+        /// Find value ptrs of many keys. The slots of a group of keys are all prefetched before any of them is probed,
+        /// so the cache misses of different keys overlap.
+        /// \param keys Keys to find
+        /// \param n Num of keys
+        /// \param values Found value ptrs, nullptr if not found
+        /// @note Thread safe and lock free
+        void findMany(const std::string *const *keys, size_t n, V **values) const {
+            constexpr size_t kGroup = 16;
+            size_t hashes[kGroup];
+
+            auto table = table_.load();
+            for (size_t begin = 0; begin < n; begin += kGroup) {
+                size_t num = std::min(kGroup, n - begin);
+
+                // 先预取所有槽位，再预取槽位指向的条目，最后逐个比较
+                for (size_t i = 0; i < num; i++) {
+                    hashes[i] = std::hash<std::string>()(*keys[begin + i]);
+                    __builtin_prefetch(&table->slots_[hashes[i] & table->mask_]);
+                }
+                for (size_t i = 0; i < num; i++) {
+                    auto entry = table->slots_[hashes[i] & table->mask_].load();
+                    if (entry != nullptr)
+                        __builtin_prefetch(entry);
+                }
+                for (size_t i = 0; i < num; i++) {
+                    auto entry = findEntry(table, hashes[i], *keys[begin + i]);
+                    values[begin + i] = entry == nullptr ? nullptr : entry->value_.load();
+                }
+            }
+        }
+
+        /// Insert a key with given value ptr. If key already exists, function will return old value ptr.
+        /// \param key The key to insert
+        /// \param value The value ptr
+        /// \return Value ptr of given key in index
+        /// @note Thread safe
+        V *insert(const std::string &key, V *value) {
+            auto hash = std::hash<std::string>()(key);
+
+            std::lock_guard<std::mutex> lg(mtx_);
+
+            auto table = table_.load();
+            auto entry = findEntry(table, hash, key);
+
+            if (entry != nullptr) {
+                V *expected = nullptr;
+                // 已删除的条目可以被重新使用
+                if (entry->value_.compare_exchange_strong(expected, value)) {
+                    size_.fetch_add(1);
+                    return value;
+                }
+                return expected;
+            }
+
+            if ((used_ + 1) * 2 > table->capacity()) {
+                table = grow(table);
+            }
+
+            auto entry_node = new Entry(hash, key, value);
+            charge(static_cast<long>(entryBytes(entry_node)));
+            place(table, entry_node);
+            used_++;
+            size_.fetch_add(1);
+
+            return value;
+        }
+
+        /// Erase the record with given key. The entry will be kept until next resize.
+        /// \param key The key to erase
+        /// \return Is key found
+        /// @note Thread safe and lock free
+        bool erase(const std::string &key) {
+            auto entry = findEntry(table_.load(), std::hash<std::string>()(key), key);
+            if (entry == nullptr || entry->value_.exchange(nullptr) == nullptr)
+                return false;
+
+            size_.fetch_sub(1);
+            return true;
+        }
+
+        /// Get num of alive records in index.
+        /// \return num
+        /// @note Thread safe
+        [[nodiscard]] size_t size() const {
+            return size_.load();
+        }
+
+        /// Get the capacity of current slot array.
+        /// \return Capacity
+        [[nodiscard]] size_t capacity() const {
+            return table_.load()->capacity();
+        }
+
+        /// Get approximately memory use of slot arrays and entries, including retired ones.
+        /// \return Memory use in bytes
+        /// @note Thread safe
+        [[nodiscard]] size_t memoryUse() const {
+            return mem_use_.load();
+        }
+
+        /// Bind a memory counter to this index. Memory use will also be added to or subtracted from the counter.
+        /// \param account Memory counter, usually owned by table
+        /// @warning Not thread safe, bind it before the index is shared
+        void setAccount(std::atomic<size_t> *account) {
+            account_ = account;
+            account_->fetch_add(mem_use_.load());
+        }
+
+        /// Release all retired entries and slot arrays.
+        /// @warning Make sure that no reader is using this index.
+        void reclaim() {
+            std::lock_guard<std::mutex> lg(mtx_);
+
+            for (auto table: retired_tables_) {
+                charge(-static_cast<long>(tableBytes(table)));
+                delete table;
+            }
+            for (auto entry: retired_entries_) {
+                charge(-static_cast<long>(entryBytes(entry)));
+                delete entry;
+            }
+            retired_tables_.clear();
+            retired_entries_.clear();
+        }
+
+    private:
+
+        /// Internal interface. Probe given table and find the entry with given key.
+        /// \param table Table to probe
+        /// \param hash Hash of key
+        /// \param key Key to find
+        /// \return Found entry or nullptr
+        static Entry *findEntry(Table *table, size_t hash, const std::string &key) {
+            for (size_t i = hash & table->mask_;; i = (i + 1) & table->mask_) {
+                auto entry = table->slots_[i].load();
+                if (entry == nullptr)
+                    return nullptr;
+                if (entry->hash_ == hash && entry->key_ == key)
+                    return entry;
+            }
+        }
+
+        /// Internal interface. Put the entry to the first empty slot.
+        /// \param table Table to modify
+        /// \param entry Entry to put
+        static void place(Table *table, Entry *entry) {
+            size_t i = entry->hash_ & table->mask_;
+            while (table->slots_[i].load() != nullptr) {
+                i = (i + 1) & table->mask_;
+            }
+            table->slots_[i].store(entry);
+        }
+
+        /// Internal interface. Rehash all alive entries into a larger table, and retire the old one. Erased entries
+        /// will be dropped. Must be called with mutex held.
+        /// \param old Current table
+        /// \return New table
+        Table *grow(Table *old) {
+            auto capacity = old->capacity();
+            if (size_.load() * 4 > capacity) {
+                capacity *= 2;
+            }
+
+            auto table = new Table(capacity);
+            charge(static_cast<long>(tableBytes(table)));
+            used_ = 0;
+
+            for (size_t i = 0; i < old->capacity(); i++) {
+                auto entry = old->slots_[i].load();
+                if (entry == nullptr)
+                    continue;
+
+                if (entry->value_.load() == nullptr) {
+                    retired_entries_.emplace_back(entry);
+                    continue;
+                }
+                place(table, entry);
+                used_++;
+            }
+
+            table_.store(table);
+            retired_tables_.emplace_back(old);
+
+            return table;
+        }
+
+        /// Internal interface. Add given num of bytes to memory use of this index and bound counter.
+        void charge(long delta) {
+            mem_use_.fetch_add(delta);
+            if (account_ != nullptr)
+                account_->fetch_add(delta);
+        }
+
+        /// Internal interface. Get memory use of given slot array.
+        static size_t tableBytes(const Table *table) {
+            return sizeof(Table) + table->capacity() * sizeof(std::atomic<Entry *>);
+        }
+
+        /// Internal interface. Get memory use of given entry.
+        static size_t entryBytes(const Entry *entry) {
+            return sizeof(Entry) + entry->key_.capacity();
+        }
+
+        /// Internal interface. Round given capacity up to a power of two.
+        static size_t roundUp(size_t capacity) {
+            size_t n = 16;
+            while (n < capacity) {
+                n <<= 1;
+            }
+            return n;
+        }
+
+    private:
+
+        std::atomic<Table *> table_;
+        std::mutex mtx_;   // 写入者之间互斥
+
+        size_t used_ = 0;  // 已占用的槽位，包括已删除的条目
+        std::atomic<size_t> size_ = 0;
+        std::atomic<size_t> mem_use_ = 0;
+        std::atomic<size_t> *account_ = nullptr;
+
+        std::vector<Table *> retired_tables_;
+        std::vector<Entry *> retired_entries_;
+    };
+}
+
+#endif //ALGYOLO_HASHINDEX_H
@@ -0,0 +1,95 @@
+//
+// Created by 唐仁初 on 2022/12/27.
+//
+
+#include "LoadPool.h"
+
+#include <algorithm>
+
+namespace mvcc {
+
+    LoadPool::LoadPool(size_t threads) : thread_num_(threads) {}
+
+    LoadPool::~LoadPool() {
+        {
+            std::lock_guard<std::mutex> lg(mtx_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+
+        for (auto &thread: threads_) {
+            if (thread.joinable())
+                thread.join();
+        }
+    }
+
+    void LoadPool::run(size_t parts, const Work &work) {
+        if (parts == 0)
+            return;
+
+        Job job(&work, parts);
+
+        std::unique_lock<std::mutex> lk(mtx_);
+
+        if (parts > 1 && thread_num_ > 0) {
+            // 第一次并行加载时才启动线程
+            while (threads_.size() < thread_num_) {
+                threads_.emplace_back([this] {
+                    this->work();
+                });
+            }
+            jobs_.push_back(&job);
+            cv_.notify_all();
+        }
+
+        // 调用者也领取分区，然后等待其他线程领取的分区结束
+        drain(job, lk);
+        done_cv_.wait(lk, [&job] { return job.finished_ == job.parts_; });
+
+        if (job.error_)
+            std::rethrow_exception(job.error_);
+    }
+
+    void LoadPool::work() {
+
+        std::unique_lock<std::mutex> lk(mtx_);
+
+        while (true) {
+            cv_.wait(lk, [this] { return stop_ || !jobs_.empty(); });
+            if (stop_)
+                return;
+
+            drain(*jobs_.front(), lk);
+        }
+    }
+
+    void LoadPool::drain(Job &job, std::unique_lock<std::mutex> &lk) {
+
+        while (job.next_ < job.parts_) {
+            size_t part = job.next_++;
+
+            // 最后一个分区被领取之后任务出队，之后只有领取了分区的线程会访问它
+            if (job.next_ == job.parts_) {
+                auto it = std::find(jobs_.begin(), jobs_.end(), &job);
+                if (it != jobs_.end())
+                    jobs_.erase(it);
+            }
+
+            lk.unlock();
+            std::exception_ptr error;
+            try {
+                (*job.work_)(part);
+            } catch (...) {
+                error = std::current_exception();
+            }
+            lk.lock();
+
+            if (error && !job.error_)
+                job.error_ = error;
+
+            // 在锁内通知，调用者看到全部分区结束之后才会销毁任务
+            if (++job.finished_ == job.parts_)
+                done_cv_.notify_all();
+        }
+    }
+}
@@ -0,0 +1,79 @@
+//
+// Created by 唐仁初 on 2022/12/27.
+//
+
+#ifndef ALGYOLO_LOADPOOL_H
+#define ALGYOLO_LOADPOOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mvcc {
+
+    /// @brief Dedicated threads applying the partitions of parallel loads of a table.
+    /// @details Class LoadPool runs the partitions of parallel bulk writes, checkpoint loading and log replay. Its threads
+    /// are started at the first parallel load and kept until the pool is destructed, so a load does not spawn threads of
+    /// its own. The calling thread takes partitions too, and concurrent loads share the threads in submission order.
+    /// Loads are kept off the maintenance executor, whose few workers are shared by the maintenance of all tables.
+    class LoadPool {
+    public:
+
+        using Work = std::function<void(size_t)>;
+
+        /// Construct a pool without starting any thread.
+        /// \param threads Num of threads besides the calling one
+        explicit LoadPool(size_t threads);
+
+        LoadPool(const LoadPool &other) = delete;
+
+        LoadPool &operator=(const LoadPool &other) = delete;
+
+        /// Stop and join all threads. Must not be called while a load is running.
+        ~LoadPool();
+
+        /// Run work on every partition and return after all of them finish. An exception thrown by a partition is
+        /// rethrown to the caller after the others finish.
+        /// \param parts Num of partitions
+        /// \param work Work called with the index of each partition
+        /// @note Thread safe
+        void run(size_t parts, const Work &work);
+
+    private:
+
+        struct Job {
+            Job(const Work *work, size_t parts) : work_(work), parts_(parts) {}
+
+            const Work *work_;
+            size_t parts_;
+            size_t next_ = 0;       // 下一个没有被领取的分区
+            size_t finished_ = 0;
+            std::exception_ptr error_;
+        };
+
+        /// Thread loop. Takes partitions of the oldest job until stopped.
+        void work();
+
+        /// Internal interface. Claim and run partitions of given job until none is left.
+        /// \param job Job to run
+        /// \param lk Locked lock of mutex, unlocked while a partition runs
+        void drain(Job &job, std::unique_lock<std::mutex> &lk);
+
+    private:
+
+        std::mutex mtx_;
+        std::condition_variable cv_;        // 有新任务或者停止时唤醒线程
+        std::condition_variable done_cv_;   // 分区结束时唤醒等待的调用者
+
+        std::deque<Job *> jobs_;            // 还有分区没有被领取的任务
+        std::vector<std::thread> threads_;
+        size_t thread_num_;
+        bool stop_ = false;
+    };
+}
+
+#endif //ALGYOLO_LOADPOOL_H
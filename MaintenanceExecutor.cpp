@@ -0,0 +1,184 @@
+//
+// Created by 唐仁初 on 2022/12/14.
+//
+
+#include "MaintenanceExecutor.h"
+
+namespace mvcc {
+
+    MaintenanceExecutor &MaintenanceExecutor::getInstance() {
+        static MaintenanceExecutor executor;
+        return executor;
+    }
+
+    MaintenanceExecutor::MaintenanceExecutor() : target_workers_(0) {
+        setWorkerNum(std::max<size_t>(2, std::thread::hardware_concurrency() / 4));
+    }
+
+    MaintenanceExecutor::~MaintenanceExecutor() {
+        {
+            std::lock_guard<std::mutex> lg(mtx_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+
+        for (auto &worker: workers_) {
+            if (worker.joinable())
+                worker.join();
+        }
+    }
+
+    void MaintenanceExecutor::submit(const void *owner, Priority priority, Task task) {
+        {
+            std::lock_guard<std::mutex> lg(mtx_);
+            queues_[priority].push_back({owner, std::move(task)});
+        }
+        cv_.notify_one();
+    }
+
+    void MaintenanceExecutor::setRateLimit(const void *owner, size_t tasks_per_second) {
+        std::lock_guard<std::mutex> lg(mtx_);
+
+        auto &state = owners_[owner];
+        state.interval_ = tasks_per_second == 0 ? Clock::duration::zero() :
+                          Clock::duration(std::chrono::seconds(1)) / static_cast<Clock::rep>(tasks_per_second);
+    }
+
+    void MaintenanceExecutor::cancel(const void *owner) {
+
+        // 被丢弃的任务在解锁之后析构，它们持有的资源释放时可能会提交新任务
+        std::vector<Item> dropped;
+        std::unique_lock<std::mutex> lk(mtx_);
+
+        auto drop = [this, owner, &dropped] {
+            for (auto &queue: queues_) {
+                for (auto it = queue.begin(); it != queue.end();) {
+                    if (it->owner_ == owner) {
+                        dropped.emplace_back(std::move(*it));
+                        it = queue.erase(it);
+                    } else {
+                        ++it;
+                    }
+                }
+            }
+        };
+
+        drop();
+
+        // 正在运行的任务可能会提交后续任务，等待它结束后再清理一次
+        idle_cv_.wait(lk, [this, owner] {
+            auto it = owners_.find(owner);
+            return it == owners_.end() || !it->second.running_;
+        });
+
+        drop();
+        owners_.erase(owner);
+    }
+
+    void MaintenanceExecutor::setWorkerNum(size_t num) {
+        {
+            std::lock_guard<std::mutex> lg(mtx_);
+
+            target_workers_ = std::max<size_t>(1, num);
+
+            // 多余的工作线程会在取任务前自行退出
+            while (alive_workers_ < target_workers_) {
+                alive_workers_++;
+                workers_.emplace_back([this] {
+                    work();
+                });
+            }
+        }
+        cv_.notify_all();
+    }
+
+    size_t MaintenanceExecutor::workerNum() const {
+        std::lock_guard<std::mutex> lg(mtx_);
+        return target_workers_;
+    }
+
+    size_t MaintenanceExecutor::queueDepth(Priority priority) const {
+        std::lock_guard<std::mutex> lg(mtx_);
+        return queues_[priority].size();
+    }
+
+    size_t MaintenanceExecutor::runningNum() const {
+        std::lock_guard<std::mutex> lg(mtx_);
+        return running_;
+    }
+
+    size_t MaintenanceExecutor::finishedNum() const {
+        return finished_.load();
+    }
+
+    void MaintenanceExecutor::work() {
+
+        std::unique_lock<std::mutex> lk(mtx_);
+
+        while (true) {
+
+            if (stop_ || alive_workers_ > target_workers_) {
+                alive_workers_--;
+                return;
+            }
+
+            Item item;
+            auto wake = Clock::time_point::max();
+
+            if (!pop(item, wake)) {
+                // 没有可以执行的任务，被限速的任务到期后再检查
+                if (wake == Clock::time_point::max())
+                    cv_.wait(lk);
+                else
+                    cv_.wait_until(lk, wake);
+                continue;
+            }
+
+            running_++;
+            lk.unlock();
+
+            try {
+                item.task_();
+            } catch (...) {
+                // 任务自己负责处理错误，异常不能让工作线程退出
+            }
+            item.task_ = nullptr;   // 与 cancel 一样在锁外析构任务
+
+            lk.lock();
+            running_--;
+            finished_.fetch_add(1);
+            owners_[item.owner_].running_ = false;
+
+            // 同一所有者的后续任务现在可以执行了
+            idle_cv_.notify_all();
+            cv_.notify_all();
+        }
+    }
+
+    bool MaintenanceExecutor::pop(Item &item, Clock::time_point &wake) {
+
+        auto now = Clock::now();
+
+        for (auto &queue: queues_) {
+            for (auto it = queue.begin(); it != queue.end(); ++it) {
+
+                auto &state = owners_[it->owner_];
+                if (state.running_)
+                    continue;
+
+                if (now < state.next_start_) {
+                    wake = std::min(wake, state.next_start_);
+                    continue;
+                }
+
+                state.running_ = true;
+                state.next_start_ = now + state.interval_;
+
+                item = std::move(*it);
+                queue.erase(it);
+                return true;
+            }
+        }
+        return false;
+    }
+}
@@ -0,0 +1,141 @@
+//
+// Created by 唐仁初 on 2022/12/14.
+//
+
+#ifndef ALGYOLO_MAINTENANCEEXECUTOR_H
+#define ALGYOLO_MAINTENANCEEXECUTOR_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace mvcc {
+
+    /// @brief Shared executor of background maintenance tasks.
+    /// @details Class MaintenanceExecutor runs compaction, buffer merge and version vacuum tasks of all tables on a bounded
+    /// group of worker threads, so the thread num does not grow with table num. Tasks are queued by priority. Tasks of the
+    /// same owner never run concurrently, and an owner can be rate limited to a max num of task starts per second. A long
+    /// job, such as compaction, is expected to be split into small tasks which submit the next one when finished.
+    class MaintenanceExecutor {
+    public:
+
+        /// Describes the priority of a maintenance task
+        enum Priority {
+            /// Tasks which block writers or keep tables in a degraded mode, such as buffer merge
+            high = 0,
+            /// Regular tasks such as compaction steps
+            normal = 1,
+            /// Opportunistic tasks such as version vacuum
+            low = 2
+        };
+
+        using Task = std::function<void()>;
+
+        /// Singleton call of MaintenanceExecutor.
+        /// \return Singleton impl
+        static MaintenanceExecutor &getInstance();
+
+        MaintenanceExecutor(const MaintenanceExecutor &other) = delete;
+
+        MaintenanceExecutor &operator=(const MaintenanceExecutor &other) = delete;
+
+        /// Stop all workers. Queued tasks are dropped.
+        ~MaintenanceExecutor();
+
+        /// Submit a task to the queue of given priority.
+        /// \param owner Owner of task, usually the table ptr. Tasks of one owner run one at a time
+        /// \param priority Priority of task
+        /// \param task Task to run
+        /// @note Thread safe
+        void submit(const void *owner, Priority priority, Task task);
+
+        /// Limit the task starts of given owner. Tasks exceeding the limit stay in queue and do not block others.
+        /// \param owner Owner to limit
+        /// \param tasks_per_second Max num of task starts per second, 0 means unlimited
+        /// @note Thread safe
+        void setRateLimit(const void *owner, size_t tasks_per_second);
+
+        /// Drop all queued tasks of given owner and wait for the running one to finish. The rate limit of the owner is
+        /// also cleared. Must be called before an owner is destroyed.
+        /// \param owner Owner to cancel
+        /// @warning Do not call it inside a task of the same owner
+        void cancel(const void *owner);
+
+        /// Change the num of worker threads.
+        /// \param num Worker num, at least 1
+        /// @note Thread safe
+        void setWorkerNum(size_t num);
+
+        /// Get the num of worker threads.
+        /// \return Worker num
+        [[nodiscard]] size_t workerNum() const;
+
+        /// Get the num of queued tasks with given priority.
+        /// \param priority Priority of queue
+        /// \return Queue depth
+        [[nodiscard]] size_t queueDepth(Priority priority) const;
+
+        /// Get the num of tasks running now.
+        /// \return Running task num
+        [[nodiscard]] size_t runningNum() const;
+
+        /// Get the num of tasks finished since start.
+        /// \return Finished task num
+        [[nodiscard]] size_t finishedNum() const;
+
+    private:
+
+        using Clock = std::chrono::steady_clock;
+
+        struct Item {
+            const void *owner_;
+            Task task_;
+        };
+
+        struct OwnerState {
+            bool running_ = false;
+            Clock::duration interval_ = Clock::duration::zero();   // 两次任务开始的最小间隔
+            Clock::time_point next_start_ = Clock::time_point::min();
+        };
+
+        /// Default Constructor. Used to impl singleton.
+        MaintenanceExecutor();
+
+        /// Worker loop. Workers exit when alive worker num exceeds target worker num.
+        void work();
+
+        /// Internal interface. Pop the first runnable task in priority order. Must be called with mutex held.
+        /// \param item Popped task
+        /// \param wake Earliest time point a throttled task becomes runnable, unchanged if no task is throttled
+        /// \return Is a task popped
+        bool pop(Item &item, Clock::time_point &wake);
+
+    private:
+
+        mutable std::mutex mtx_;
+        std::condition_variable cv_;        // 有新任务或者所有者空闲时唤醒工作线程
+        std::condition_variable idle_cv_;   // 所有者的任务结束时唤醒 cancel
+
+        std::deque<Item> queues_[3];
+        std::unordered_map<const void *, OwnerState> owners_;
+
+        std::vector<std::thread> workers_;
+        size_t target_workers_;
+        size_t alive_workers_ = 0;
+        bool stop_ = false;
+
+        size_t running_ = 0;
+        std::atomic<size_t> finished_ = 0;
+    };
+}
+
+#define Maintenance MaintenanceExecutor::getInstance()
+
+#endif //ALGYOLO_MAINTENANCEEXECUTOR_H
@@ -0,0 +1,158 @@
+//
+// Created by 唐仁初 on 2022/12/18.
+//
+
+#include "MemTable.h"
+
+namespace mvcc {
+
+    MemTable::MemTable(int max_level, bool hash_index, size_t hash_capacity, int filter_bits_per_key,
+                       std::atomic<size_t> *node_account, std::atomic<size_t> *version_account)
+            : list_(max_level), index_(hash_index ? new HashIndex<Value>(hash_capacity) : nullptr),
+              filter_bits_per_key_(filter_bits_per_key), version_account_(version_account) {
+        list_.setAccount(node_account);
+        if (index_)
+            index_->setAccount(node_account);
+        if (filter_bits_per_key_ > 0)
+            filter_ = new BloomFilter(1024, filter_bits_per_key_);
+    }
+
+    MemTable::~MemTable() {
+        delete filter_.load();
+        for (auto filter: retired_filters_) {
+            delete filter;
+        }
+    }
+
+    Value *MemTable::find(const std::string &key) {
+        // 过滤器判断不存在时，不需要查找索引
+        auto filter = filter_.load();
+        if (filter != nullptr && !filter->mayContain(key))
+            return nullptr;
+
+        if (index_)
+            return index_->find(key);
+
+        auto it = list_.find(key);
+        return it == list_.end() ? nullptr : &*it;
+    }
+
+    void MemTable::findMany(const std::string *const *keys, size_t n, Value **values) {
+        // 过滤器判断不存在的键不参与查找
+        std::vector<const std::string *> probe;
+        std::vector<size_t> index;
+        probe.reserve(n);
+        index.reserve(n);
+
+        auto filter = filter_.load();
+        for (size_t i = 0; i < n; i++) {
+            values[i] = nullptr;
+            if (filter == nullptr || filter->mayContain(*keys[i])) {
+                probe.emplace_back(keys[i]);
+                index.emplace_back(i);
+            }
+        }
+
+        if (index_) {
+            std::vector<Value *> found(probe.size());
+            index_->findMany(probe.data(), probe.size(), found.data());
+            for (size_t i = 0; i < probe.size(); i++) {
+                values[index[i]] = found[i];
+            }
+            return;
+        }
+
+        std::vector<SkipList<Value>::Iterator> its(probe.size(), list_.end());
+        list_.findMany(probe.data(), probe.size(), its.data());
+        for (size_t i = 0; i < probe.size(); i++) {
+            values[index[i]] = its[i] == list_.end() ? nullptr : &*its[i];
+        }
+    }
+
+    Value *MemTable::locate(const std::string &key) {
+        // 过滤器需要在记录可见之前更新，否则读操作可能会漏掉该记录
+        auto filter = filter_.load();
+        if (filter != nullptr && !filter->mayContain(key))
+            filter->add(key);
+
+        Value *value_node = index_ ? index_->find(key) : nullptr;
+
+        if (value_node == nullptr) {
+            auto it = list_.insert(key);
+            if (!it) {
+                // 惰性删除的节点重新写入之前先提交删除标记，旧的版本不会随节点恢复而重新可见，写入回滚时键仍然不存在。
+                // 在值的锁内检查，并发定位同一个节点时只有一个会写入删除标记
+                auto node = &*it;
+                while (!node->getLock()) {}
+                if (!it) {
+                    node->bury();
+                    list_.revive(it);
+                }
+                node->unlock();
+            }
+
+            // 跳跃表会对并发插入去重，所以索引中记录的始终是同一个节点
+            value_node = index_ ? index_->insert(key, &*it) : &*it;
+        }
+
+        value_node->setAccount(version_account_);
+        return value_node;
+    }
+
+    bool MemTable::erase(const std::string &key) {
+        if (index_)
+            index_->erase(key);
+        return list_.erase(key);
+    }
+
+    bool MemTable::compactStep(size_t budget) {
+        return list_.compactStep(budget);
+    }
+
+    void MemTable::rebuildFilter() {
+        auto old = filter_.load();
+        if (old == nullptr)
+            return;
+
+        // 压缩后已删除的键不再存在，重新构建过滤器以降低误判率
+        auto filter = new BloomFilter(list_.size() * 2, filter_bits_per_key_);
+        for (auto it = list_.begin(); it != list_.end(); ++it) {
+            filter->add(it.key());
+        }
+
+        filter_.store(filter);
+        retired_filters_.emplace_back(old);
+    }
+
+    void MemTable::reclaim() {
+        list_.reclaim();
+        if (index_)
+            index_->reclaim();
+
+        for (auto filter: retired_filters_) {
+            delete filter;
+        }
+        retired_filters_.clear();
+    }
+
+    void MemTable::seal(long version) {
+        seal_.store(version);
+    }
+
+    long MemTable::sealVersion() const {
+        return seal_.load();
+    }
+
+    SkipList<Value> &MemTable::list() {
+        return list_;
+    }
+
+    size_t MemTable::size() const {
+        return list_.size();
+    }
+
+    size_t MemTable::filterMemoryUse() const {
+        auto filter = filter_.load();
+        return filter == nullptr ? 0 : filter->memoryUse();
+    }
+}
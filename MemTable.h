@@ -0,0 +1,115 @@
+//
+// Created by 唐仁初 on 2022/12/18.
+//
+
+#ifndef ALGYOLO_MEMTABLE_H
+#define ALGYOLO_MEMTABLE_H
+
+#include "Value.h"
+#include "SkipList.h"
+#include "HashIndex.h"
+#include "BloomFilter.h"
+#include <atomic>
+#include <climits>
+#include <memory>
+#include <vector>
+
+namespace mvcc {
+
+    /// @brief One memtable in the memtable chain of ValueTable.
+    /// @details Class MemTable groups a SkipList with its optional hash side index and bloom filter. ValueTable writes
+    /// to the newest one only, and rotates it into an immutable memtable when compaction is needed. An immutable
+    /// memtable is sealed once all writers on it have finished, after that all versions in it are less than its seal
+    /// version, which lets readers stop searching older memtables early.
+    class MemTable {
+    public:
+
+        /// Constructs an empty MemTable.
+        /// \param max_level Max level of skip list
+        /// \param hash_index Maintain a hash side index
+        /// \param hash_capacity Initial capacity of hash side index
+        /// \param filter_bits_per_key Bits used for each key in bloom filter, 0 means no filter
+        /// \param node_account Memory counter of nodes and index
+        /// \param version_account Memory counter of version records
+        MemTable(int max_level, bool hash_index, size_t hash_capacity, int filter_bits_per_key,
+                 std::atomic<size_t> *node_account, std::atomic<size_t> *version_account);
+
+        ~MemTable();
+
+        MemTable(const MemTable &other) = delete;
+
+        MemTable &operator=(const MemTable &other) = delete;
+
+        /// Find the value of given key. Lazy freed records are not visible.
+        /// \param key The key to find
+        /// \return Value ptr or nullptr
+        /// @note Thread safe
+        Value *find(const std::string &key);
+
+        /// Find values of many keys. Lookups of different keys are interleaved, see SkipList::findMany.
+        /// \param keys Keys to find
+        /// \param n Num of keys
+        /// \param values Found value ptrs, nullptr if not found
+        /// @note Thread safe
+        void findMany(const std::string *const *keys, size_t n, Value **values);
+
+        /// Get the value of given key for write. If not exists, a new record will be constructed.
+        /// \param key The key to locate
+        /// \return Value ptr
+        /// @note Thread safe
+        Value *locate(const std::string &key);
+
+        /// Lazy free the record with given key.
+        /// \param key The key to erase
+        /// \return Is record found
+        /// @note Thread safe
+        bool erase(const std::string &key);
+
+        /// Compact a bounded slice of deleted nodes, see SkipList::compactStep.
+        /// \param budget Max num of nodes to visit
+        /// \return Is whole memtable compacted
+        /// @warning Make sure no insertion in this memtable
+        bool compactStep(size_t budget);
+
+        /// Rebuild the filter after compaction, the old one is retired.
+        void rebuildFilter();
+
+        /// Release retired skip list nodes, index entries and filters.
+        /// @warning Make sure no reader is using retired parts
+        void reclaim();
+
+        /// Mark this memtable as sealed. All versions in it must be less than given version.
+        /// \param version Seal version
+        void seal(long version);
+
+        /// Get the seal version, LONG_MAX if not sealed.
+        /// \return Seal version
+        [[nodiscard]] long sealVersion() const;
+
+        /// Get the underlying SkipList, used to traverse.
+        /// \return SkipList
+        SkipList<Value> &list();
+
+        /// Num of alive records.
+        /// \return num
+        [[nodiscard]] size_t size() const;
+
+        /// Memory use of filter.
+        /// \return Memory use in bytes
+        [[nodiscard]] size_t filterMemoryUse() const;
+
+    private:
+
+        SkipList<Value> list_;
+        std::unique_ptr<HashIndex<Value>> index_;
+
+        int filter_bits_per_key_;
+        std::atomic<BloomFilter *> filter_ = nullptr;
+        std::vector<BloomFilter *> retired_filters_;
+
+        std::atomic<long> seal_ = LONG_MAX;
+        std::atomic<size_t> *version_account_;
+    };
+}
+
+#endif //ALGYOLO_MEMTABLE_H
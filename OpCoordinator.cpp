@@ -6,8 +6,32 @@
 #include "Value.h"
 #include "Operation.h"
 
+#include <climits>
+
 namespace mvcc {
 
+    namespace {
+
+        // 当前线程占用的读槽位，线程退出时归还
+        struct SlotOwner {
+            std::atomic<long> *version_ = nullptr;
+            std::atomic<bool> *owned_ = nullptr;
+            std::atomic<size_t> *released_ = nullptr;
+            int depth_ = 0;             // 嵌套的读快照数量
+            bool exhausted_ = false;    // 没有空闲槽位，有槽位被归还之前的读快照都进行登记
+            size_t scanned_ = 0;        // 上次扫描槽位时已归还的槽位数量
+
+            ~SlotOwner() {
+                if (owned_ != nullptr) {
+                    owned_->store(false);
+                    released_->fetch_add(1);
+                }
+            }
+        };
+
+        thread_local SlotOwner slot_owner;
+    }
+
     op::Transaction OpCoordinator::startTransaction() {
         return op::Transaction(updateVersion());
     }
@@ -18,11 +42,22 @@ namespace mvcc {
 
     op::ReadOperation OpCoordinator::startReadOperation(Value *node) {
 
-        return op::ReadOperation(node, *version_);
+        return op::ReadOperation(node, snapshotVersion());
     }
 
     op::StreamReadOperation OpCoordinator::startStreamReadOperation(Value *node) {
-        return op::StreamReadOperation(node, *version_);
+        return op::StreamReadOperation(node, snapshotVersion());
+    }
+
+    op::ReadOnlyTransaction OpCoordinator::startReadOnlyTransaction() {
+        bool pinned;
+        long version = pinSnapshot(pinned);
+        return op::ReadOnlyTransaction(version, pinned);
+    }
+
+    op::StreamReadOperation OpCoordinator::startFenceReadOperation(Value *node) {
+        // 与写操作一样分配新的版本号并登记，之前开始的操作版本都更小
+        return op::StreamReadOperation(node, updateVersion(false));
     }
 
     op::WriteOperation OpCoordinator::startWriteOperation(Value *node, const std::string &value) {
@@ -36,16 +71,135 @@ namespace mvcc {
     }
 
 
-    Version OpCoordinator::updateVersion() {
-        long version = sequence_.fetch_add(1) + 1;
-
+    Version OpCoordinator::updateVersion(bool write) {
+        // 分配与登记需要在同一个临界区内完成，否则等待低水位的线程可能漏掉刚分配的版本
         mtx->mtx.lock();
+        long version = sequence_.fetch_add(1) + 1;
         versions_.emplace(version);
+        if (write)
+            writes_.emplace_hint(writes_.end(), version);
         mtx->mtx.unlock();
 
-        version_->versionUpdate(1);
+        // 每个写操作拥有独立的引用计数，所有拷贝析构后版本记录会被释放
+        return Version(version, false, write);
+    }
+
+    Version OpCoordinator::snapshotVersion() {
+        std::lock_guard<std::mutex> lg(mtx->mtx);
+
+        // 读操作使用当前最新的版本号，并且需要登记，防止可见的版本链被提前释放
+        long version = sequence_.load();
+        versions_.emplace(version);
+
+        return Version(version);
+    }
+
+    long OpCoordinator::pinSnapshot(bool &pinned) {
+        auto &owner = slot_owner;
+
+        // 外层快照的版本更小，留在槽位中同样保护内层快照可见的版本链
+        if (owner.depth_ > 0) {
+            owner.depth_++;
+            pinned = true;
+            return sequence_.load();
+        }
+
+        // 槽位用完之后，只有其他线程退出归还槽位时才重新扫描。归还数量在扫描之前读取，扫描期间的归还会在下次被发现
+        if (owner.version_ == nullptr && (!owner.exhausted_ || owner.scanned_ != slot_released_.load())) {
+            owner.scanned_ = slot_released_.load();
+            for (size_t i = 0; i < kReadSlots; i++) {
+                if (slots_[i].owned_.load() || slots_[i].owned_.exchange(true))
+                    continue;
+
+                owner.version_ = &slots_[i].version_;
+                owner.owned_ = &slots_[i].owned_;
+                owner.released_ = &slot_released_;
+                size_t num = slot_num_.load();
+                while (num < i + 1 && !slot_num_.compare_exchange_weak(num, i + 1)) {}
+                break;
+            }
+            owner.exhausted_ = owner.version_ == nullptr;
+        }
+
+        if (owner.version_ == nullptr) {
+            pinned = false;
+            std::lock_guard<std::mutex> lg(mtx->mtx);
+            long version = sequence_.load();
+            versions_.emplace(version);
+            return version;
+        }
+
+        // 先公布再重新读取版本号。没有看到该槽位的 getLowestVersion 在公布之前读取版本号，读到的不会大于重新读取的
+        // 版本号，所以使用重新读取的版本号作为快照，槽位中更小的版本号只会让清理更保守
+        long announced = sequence_.load();
+        owner.version_->store(announced);
+        owner.depth_ = 1;
+        pinned = true;
+        return sequence_.load();
+    }
+
+    void OpCoordinator::unpinSnapshot(long version, bool pinned) {
+        if (!pinned) {
+            versionReleaseNotify(version);
+            return;
+        }
+
+        auto &owner = slot_owner;
+        if (--owner.depth_ > 0)
+            return;
+
+        owner.version_->store(-1);
+
+        // 有线程或回调等待版本释放时才需要加锁唤醒，与 waitVersionRelease 中先登记再检查槽位的顺序配合，不会丢失唤醒
+        if (slot_waiters_.load() > 0) {
+            std::vector<std::function<void()>> ready;
+            {
+                std::lock_guard<std::mutex> lg(mtx->mtx);
+                ready = takeReleased();
+            }
+            mtx->cv.notify_all();
+
+            for (auto &callback: ready) {
+                callback();
+            }
+        }
+    }
+
+    long OpCoordinator::lowestPinned() const {
+        long lowest = LONG_MAX;
+        size_t num = slot_num_.load();
+        for (size_t i = 0; i < num; i++) {
+            long version = slots_[i].version_.load();
+            if (version >= 0 && version < lowest)
+                lowest = version;
+        }
+        return lowest;
+    }
+
+    std::vector<std::function<void()>> OpCoordinator::takeReleased() {
+        std::vector<std::function<void()>> ready;
+        if (release_callbacks_.empty())
+            return ready;
+
+        long lowest = versions_.empty() ? LONG_MAX : *versions_.begin();
+        auto last = release_callbacks_.upper_bound(std::min(lowest, lowestPinned()));
+        for (auto it = release_callbacks_.begin(); it != last; ++it) {
+            ready.emplace_back(std::move(it->second));
+        }
+        release_callbacks_.erase(release_callbacks_.begin(), last);
+
+        slot_waiters_.fetch_sub(static_cast<int>(ready.size()));
+        return ready;
+    }
+
+    long OpCoordinator::fenceVersion() {
+        return sequence_.fetch_add(1) + 1;
+    }
 
-        return *version_;
+    void OpCoordinator::restoreVersion(long version) {
+        // 只会增大，并发分配的版本号不会被回退
+        long current = sequence_.load();
+        while (current < version && !sequence_.compare_exchange_weak(current, version)) {}
     }
 
     bool OpCoordinator::isTransaction(long version) {
@@ -63,33 +217,110 @@ namespace mvcc {
 
     long OpCoordinator::getLowestVersion() {
 
-        if (versions_.empty())
-            return sequence_.load();
+        // 版本号需要在检查槽位之前读取，见 pinSnapshot
+        long lowest = sequence_.load();
+        {
+            std::lock_guard<std::mutex> lg(mtx->mtx);
+            if (!versions_.empty())
+                lowest = *versions_.begin();
+        }
 
-        std::lock_guard<std::mutex> lg(mtx->mtx);
-        return *versions_.begin();
+        return std::min(lowest, lowestPinned());
     }
 
-    void OpCoordinator::versionReleaseNotify(long version) {
+    long OpCoordinator::getReleasedVersion() {
 
         std::lock_guard<std::mutex> lg(mtx->mtx);
-        versions_.erase(version);
+
+        // 只看写操作：读操作不发布变更，长时间的快照不会阻挡变更流。写版本的分配与登记在同一个临界区内，没有存活的写
+        // 操作时已分配的写版本都已经结束
+        if (writes_.empty())
+            return sequence_.load();
+
+        return *writes_.begin() - 1;
     }
 
-    size_t OpCoordinator::aliveOperationNum() {
-        if (version_ == nullptr)
-            return 0;
+    void OpCoordinator::waitVersionRelease(long version) {
+
+        slot_waiters_.fetch_add(1);
+        {
+            std::unique_lock<std::mutex> lk(mtx->mtx);
+
+            // 没有存活版本时，之后分配的版本号都不会小于 sequence_，而 version 不会大于 sequence_
+            mtx->cv.wait(lk, [this, version] {
+                return (versions_.empty() || *versions_.begin() >= version) && lowestPinned() >= version;
+            });
+        }
+        slot_waiters_.fetch_sub(1);
+    }
+
+    void OpCoordinator::onVersionRelease(long version, std::function<void()> callback) {
+
+        // 与 waitVersionRelease 一样先登记再检查槽位
+        slot_waiters_.fetch_add(1);
+
+        std::vector<std::function<void()>> ready;
+        {
+            std::lock_guard<std::mutex> lg(mtx->mtx);
+            release_callbacks_.emplace(version, std::move(callback));
+            ready = takeReleased();
+        }
+
+        for (auto &released: ready) {
+            released();
+        }
+    }
+
+    void OpCoordinator::versionReleaseNotify(long version, bool write) {
+
+        bool lowest_changed = false;
+        std::vector<std::function<void()>> ready;
+        {
+            std::lock_guard<std::mutex> lg(mtx->mtx);
+            if (write)
+                writes_.erase(version);
+            auto it = versions_.find(version);
+            if (it != versions_.end()) {
+                // 只有最低版本被释放时，等待者的条件才可能满足
+                lowest_changed = it == versions_.begin();
+                versions_.erase(it);
+            }
+            if (lowest_changed)
+                ready = takeReleased();
+        }
+
+        if (lowest_changed)
+            mtx->cv.notify_all();
+
+        // 回调在锁外调用，可以再开始或者结束操作
+        for (auto &callback: ready) {
+            callback();
+        }
+    }
 
-        if (versions_.size() == 1) {  // 如果只有一个版本存活，他还可能会被协调者持有
-            return version_->count() - 1;
+    size_t OpCoordinator::aliveOperationNum() {
+        size_t pinned = 0;
+        size_t num = slot_num_.load();
+        for (size_t i = 0; i < num; i++) {
+            pinned += slots_[i].version_.load() >= 0;
         }
 
-        return versions_.size();
+        std::lock_guard<std::mutex> lg(mtx->mtx);
+        return versions_.size() + pinned;
+    }
+
+    size_t OpCoordinator::ownedSlotNum() const {
+        size_t owned = 0;
+        size_t num = slot_num_.load();
+        for (size_t i = 0; i < num; i++) {
+            owned += slots_[i].owned_.load();
+        }
+        return owned;
     }
 
-    OpCoordinator::OpCoordinator() : version_(new Version(0)),mtx(new VersionMutex) {}
+    OpCoordinator::OpCoordinator() : mtx(new VersionMutex) {}
 
-    OpCoordinator::OpCoordinator(const OpCoordinator &other) : sequence_(other.sequence_.load()), version_(other.version_),
+    OpCoordinator::OpCoordinator(const OpCoordinator &other) : sequence_(other.sequence_.load()),
                                                                versions_(other.versions_),mtx(other.mtx) {
     }
 
@@ -98,7 +329,6 @@ namespace mvcc {
             return *this;
         }
         sequence_ = other.sequence_.load();
-        version_ = other.version_;
         versions_ = other.versions_;
         return *this;
     }
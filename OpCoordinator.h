@@ -9,7 +9,11 @@
 #include "Version.h"
 #include <atomic>
 #include <set>
+#include <map>
 #include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <vector>
 
 
 #define MAX_LOCK_TIME 1
@@ -19,6 +23,7 @@ namespace mvcc {
     namespace op{
         class ReadOperation;
         class StreamReadOperation;
+        class ReadOnlyTransaction;
         class WriteOperation;
         class DeleteOperation;
         class Transaction;
@@ -57,6 +62,19 @@ namespace mvcc {
         /// \return ReadOperation impl
         op::StreamReadOperation startStreamReadOperation(Value *node);
 
+        /// Start a stream read operation with a newly assigned version. Unlike startStreamReadOperation, the version is
+        /// not shared with operations started before, so after waitVersionRelease(version) no operation visible to the
+        /// snapshot is still running, and the snapshot will not change any more. Used by consistent checkpoints.
+        /// \param node Node to start read
+        /// \return StreamReadOperation impl
+        op::StreamReadOperation startFenceReadOperation(Value *node);
+
+        /// Start a lightweight read-only transaction with the newest version. Its version is announced in a read slot
+        /// owned by the current thread instead of being registered, so readers on different threads write no shared
+        /// cache line. A thread finding no free slot registers the version as startStreamReadOperation does.
+        /// \return ReadOnlyTransaction impl, which must be finished on the current thread
+        op::ReadOnlyTransaction startReadOnlyTransaction();
+
         /// Start a write operation on given node. Max version of this impl will update.
         /// \param node Node to write
         /// \param value Value to write
@@ -74,18 +92,55 @@ namespace mvcc {
          long getNewestVersion();
 
 
-        /// Get lowest alive version. Used by ValueNode to release out of date value record.
+        /// Get lowest alive version, including the ones announced in read slots. Used by ValueNode to release out of
+        /// date value record. If no version is alive, function returns the newest version.
         /// \return Lowest alive version
          long getLowestVersion();
 
+        /// Get the version up to which all write versions are released. Writes are still registered while they publish
+        /// their results, so every write with a version not greater than it has finished. Used by ChangeStream to emit
+        /// changes in version order. Reads publish nothing, so they are not counted, and a long snapshot such as an
+        /// iterator or a checkpoint does not hold it back.
+        /// \return Released version
+        long getReleasedVersion();
+
+        /// Assign a new version without starting an operation. Operations started before get smaller versions, and
+        /// the ones started after get versions not less than it. Used by ValueTable as the boundary of compaction phases.
+        /// \return Assigned version
+        long fenceVersion();
+
+        /// Raise the version sequence to at least given version. Used by recovery so that versions assigned after restart
+        /// are greater than the ones already in the log and checkpoint.
+        /// \param version Max version restored
+        void restoreVersion(long version);
+
+        /// Block until all versions less than given one are released, including the ones announced in read slots.
+        /// Waiters are woken by versionReleaseNotify as soon as the lowest alive version passes given one, or by a
+        /// reader leaving its slot, so no polling interval is added to the wait.
+        /// \param version Version to wait for, usually returned by fenceVersion
+        void waitVersionRelease(long version);
+
+        /// Call given callback once all versions less than given one are released, including the ones announced in read
+        /// slots. Unlike waitVersionRelease no thread is blocked: the callback is called at once on the calling thread if
+        /// the versions are already released, otherwise on the thread releasing the last of them.
+        /// \param version Version to wait for, usually returned by fenceVersion
+        /// \param callback Callback to call, which should be short, such as submitting a maintenance task
+        /// @note The callback is called without any lock of this impl held
+        void onVersionRelease(long version, std::function<void()> callback);
+
         /// Callback used by Version. Release version record in this impl.
         /// \param version Version to release
-        void versionReleaseNotify(long version);
+        /// \param write Is version owned by a write operation
+        void versionReleaseNotify(long version, bool write = false);
 
-        /// Get current alive version num.
+        /// Get current alive version num, including read slots in use.
         /// \return Alive version num
         size_t aliveOperationNum();
 
+        /// Get num of read slots owned by threads. A thread keeps its slot until it exits.
+        /// \return Owned slot num
+        size_t ownedSlotNum() const;
+
         /// Not Used.
         /// \param version
         /// \return
@@ -95,8 +150,33 @@ namespace mvcc {
     private:
 
         /// Fetch add the current version of this impl. Thread safe.
+        /// \param write Is version owned by a write operation, otherwise it is a fence read
         /// \return Updated version
-        Version updateVersion();
+        Version updateVersion(bool write = true);
+
+        /// Register a read snapshot with the newest version. Thread safe.
+        /// \return Snapshot version
+        Version snapshotVersion();
+
+        friend class op::ReadOnlyTransaction;
+
+        /// Announce a read snapshot in the slot of current thread. A nested snapshot keeps the outer version in the slot.
+        /// \param pinned Set to false if no slot is free and the version is registered instead
+        /// \return Snapshot version
+        long pinSnapshot(bool &pinned);
+
+        /// Finish a snapshot started by pinSnapshot.
+        /// \param version Snapshot version
+        /// \param pinned Whether the snapshot is announced in a slot
+        void unpinSnapshot(long version, bool pinned);
+
+        /// Lowest version announced in read slots.
+        /// \return Lowest version, LONG_MAX if no slot is in use
+        long lowestPinned() const;
+
+        /// Take the release callbacks whose versions are all released. Must be called with mutex held.
+        /// \return Callbacks to call after the mutex is released
+        std::vector<std::function<void()>> takeReleased();
 
         /// Default Constructor. Used to impl singleton.
         OpCoordinator();
@@ -114,12 +194,27 @@ namespace mvcc {
 
         struct VersionMutex{
             std::mutex mtx;
+            std::condition_variable cv;   // 最低存活版本前进时唤醒等待者
         };
 
+        /// A read slot owned by one thread. Slots are on separate cache lines, so readers do not share any line.
+        struct alignas(64) ReadSlot {
+            std::atomic<long> version_ = -1;    // 线程当前读快照的版本号，-1 表示空闲
+            std::atomic<bool> owned_ = false;
+        };
+
+        static constexpr size_t kReadSlots = 128;
+
         VersionMutex* mtx;  // 锁解决并发分配事务号
-        std::set<long> versions_;  // 当前存活的 version
+        std::multiset<long> versions_;  // 当前存活的 version，读操作的快照可能会重复
+        std::set<long> writes_;         // 当前存活的写操作版本，写操作的版本互不相同
         std::atomic<long> sequence_ = 0;
-        Version * version_;
+
+        ReadSlot slots_[kReadSlots];
+        std::atomic<size_t> slot_num_ = 0;      // 被占用过的槽位下标上界，检查槽位时只需要扫描这一部分
+        std::atomic<size_t> slot_released_ = 0; // 线程退出时归还的槽位数量，没有槽位的线程据此重新扫描
+        std::atomic<int> slot_waiters_ = 0;     // 正在 waitVersionRelease 中等待的线程以及还未调用的释放回调数量
+        std::multimap<long, std::function<void()>> release_callbacks_;  // 按等待的版本号排序的释放回调
     };
 }
 #define Coordinator OpCoordinator::getInstance()
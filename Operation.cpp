@@ -3,6 +3,9 @@
 //
 
 #include "Operation.h"
+#include "OpCoordinator.h"
+#include <algorithm>
+#include <unordered_set>
 
 namespace mvcc::op {
 
@@ -13,17 +16,29 @@ namespace mvcc::op {
 
     }
 
-    bool WriteOperation::write() {
-        if (node_ == nullptr)
+    bool WriteOperation::write(const CommitHook &before_commit) {
+        if (node_ == nullptr || !node_->getLock())
             return false;
 
-        auto operated = node_->write(value_, version_.version());
-        if (!operated)
-            return false;
+        // 与 Transaction::tryCommit 一样在持有锁时调用回调并提交，同一个键的日志顺序与版本链上的顺序一致
+        bool committed = false;
+        try {
+            auto operated = ValueNodeOperation::updateValue(node_, value_, version_.version());
+            version_.recordOperation(operated);
 
-        version_.recordOperation(operated);
+            // 提交前的回调失败时，写入的版本还未对读操作可见，直接撤销
+            committed = (!before_commit || before_commit(1)) && version_.commit();
+        } catch (std::exception &e) {
+        }
 
-        return version_.commit();
+        if (!committed)
+            version_.undo();
+        node_->unlock();
+        return committed;
+    }
+
+    void WriteOperation::bind(Value *node) {
+        node_ = node;
     }
 
     bool WriteOperation::operator<(const WriteOperation &other) {
@@ -109,20 +124,87 @@ namespace mvcc::op {
 
     }
 
-    BulkWriteOperation::BulkWriteOperation(const Version &version) : Operation(version) {}
+    ReadOnlyTransaction::ReadOnlyTransaction(long version, bool pinned) : version_(version), pinned_(pinned) {}
 
-    void BulkWriteOperation::appendOperation(Value *node, const std::string &value) {
-        ops_.emplace_back(WriteOperation(node, value, version_));
+    ReadOnlyTransaction::~ReadOnlyTransaction() {
+        Coordinator.unpinSnapshot(version_, pinned_);
     }
 
-    bool BulkWriteOperation::run() {
-        std::list<WriteOperation> ops{};    // 确保只运行一次
-        std::swap(ops, ops_);
-        for (auto &op: ops) {
-            if (!op.write())
-                return false;
+    std::string ReadOnlyTransaction::read(Value *node) const {
+        return node->read(version_);
+    }
+
+    long ReadOnlyTransaction::version() const {
+        return version_;
+    }
+
+    BulkWriteOperation::BulkWriteOperation(Version version) : Operation(std::move(version)) {}
+
+    void BulkWriteOperation::appendOperation(Value *node, std::string value) {
+        ops_.push_back({node, std::move(value)});
+    }
+
+    bool BulkWriteOperation::run(const CommitHook &before_commit) {
+        // 先写入所有值，遇到错误时停止，已写入的部分一起提交
+        size_t applied = apply();
+        bool finished = applied == ops_.size();
+
+        if (applied > 0 && before_commit && !before_commit(applied)) {
+            undoApplied();
+            return false;
         }
-        return true;
+
+        commitApplied();
+        return finished;
+    }
+
+    BulkWriteOperation BulkWriteOperation::share() const {
+        return BulkWriteOperation(version_);
+    }
+
+    size_t BulkWriteOperation::apply() {
+        // 所有写入共用本操作的版本，写入的节点记录在版本中一起提交
+        version_.reserveOperations(ops_.size());
+
+        // 写入的值保持加锁直到提交或撤销，回调在持有锁时记录日志，同一个键的日志顺序与版本链上的顺序一致。同一个值
+        // 多次写入时只加锁一次
+        std::unordered_set<Value *> locked(locked_.begin(), locked_.end());
+
+        size_t applied = 0;
+        for (auto &op: ops_) {
+            if (op.node_ == nullptr)
+                break;
+            if (locked.find(op.node_) == locked.end()) {
+                if (!op.node_->getLock())
+                    break;
+                locked.emplace(op.node_);
+                locked_.push_back(op.node_);
+            }
+
+            auto operated = ValueNodeOperation::updateValue(op.node_, op.value_, version_.version());
+            version_.recordOperation(operated);
+            applied++;
+        }
+        return applied;
+    }
+
+    void BulkWriteOperation::commitApplied() {
+        version_.commit();
+        unlockApplied();
+        ops_.clear();
+    }
+
+    void BulkWriteOperation::undoApplied() {
+        version_.undo();
+        unlockApplied();
+        ops_.clear();
+    }
+
+    void BulkWriteOperation::unlockApplied() {
+        for (auto node: locked_) {
+            node->unlock();
+        }
+        locked_.clear();
     }
 
     bool BulkWriteOperation::doWithoutCommit() {
@@ -137,56 +219,78 @@ namespace mvcc::op {
 
     }
 
-    Transaction::Transaction(const Version &version) : version_(version) {
+    Transaction::Transaction(Version version) : version_(std::move(version)) {
 
     }
 
-    void Transaction::appendOperation(Value *node, const std::string &value) {
-        ops_.emplace_back(WriteOperation(node, value, version_));
+    void Transaction::appendOperation(Value *node, std::string value) {
+        ops_.push_back({node, std::move(value)});
     }
 
-    bool Transaction::tryCommit() try {
+    long Transaction::version() const {
+        return version_.version();
+    }
 
-        // 这里需要先进行排序，根据指针地址的大小进行排序
-        // std::sort(ops_.begin(), ops_.end(),[](WriteOperation &a,WriteOperation &b){return a<b;});
+    bool Transaction::tryCommit(const CommitHook &before_commit, int wait_ms) {
 
+        // 按照值的地址排序之后加锁，所有事务以相同的顺序加锁，不会相互等待形成死锁；同一个值只加锁一次
+        SmallVector<Value *, 8> nodes;
+        nodes.reserve(ops_.size());
         for (auto &op: ops_) {
-            // 对每一个需要用到的对象尝试进行加锁，如果不能全部获得锁，则失去所有锁
-            bool locked = op.node_->getLock();
-            if (!locked) {
-                throw std::runtime_error("LOCK ERROR");
-            }
+            nodes.push_back(op.node_);
         }
+        std::sort(nodes.begin(), nodes.end());
+        nodes.resize(std::unique(nodes.begin(), nodes.end()) - nodes.begin());
 
-        for (auto &op: ops_) {
-            // 进行写操作
-            bool done = op.doWithoutCommit();
-            if (!done) {
-                throw std::runtime_error("EXEC ERROR");
+        // 没有定位到节点的写入无法执行，排序之后位于最前面
+        if (!nodes.empty() && nodes[0] == nullptr)
+            return false;
+
+        for (size_t i = 0; i < nodes.size(); i++) {
+            // 不能获得全部锁时只释放已经获得的锁
+            if (!nodes[i]->getLock(wait_ms)) {
+                for (size_t j = 0; j < i; j++) {
+                    nodes[j]->unlock();
+                }
+                return false;
             }
         }
 
-        for (auto &op: ops_) {
+        try {
+            // 所有写入共用事务的版本，写入的节点记录在版本中一起提交或撤销
+            version_.reserveOperations(ops_.size());
+            for (auto &op: ops_) {
+                // 进行写操作
+                auto operated = op.node_ == nullptr ? nullptr :
+                                ValueNodeOperation::updateValue(op.node_, op.value_, version_.version());
+                if (!operated) {
+                    throw std::runtime_error("EXEC ERROR");
+                }
+                version_.recordOperation(operated);
+            }
+
+            // 所有值都已写入但还未提交，此时持有全部锁，同一个键的提交顺序与回调顺序一致
+            if (before_commit && !before_commit(ops_.size()))
+                throw std::runtime_error("HOOK ERROR");
+
             // 进行提交操作，可能会有一部分值在提交过程中就被读
-            if (!op.commit())
+            if (!version_.commit())
                 throw std::runtime_error("COMMIT ERROR");
-        }
 
+        } catch (std::exception &e) {
 
-        for (auto &op: ops_) {
-            op.node_->unlock();
+            version_.undo();
+            for (auto node: nodes) {
+                node->unlock();
+            }
+            return false;
         }
 
-        ops_ = {};
-        return true;
-
-    } catch (std::exception &e) {
-
-        for (auto &op: ops_) {
-            op.undo();
-            op.node_->unlock();
+        for (auto node: nodes) {
+            node->unlock();
         }
 
-        return false;
+        ops_.clear();
+        return true;
     }
-}
\ No newline at end of file
+}
@@ -8,23 +8,59 @@
 
 #include "Value.h"
 #include "Version.h"
+#include <functional>
 #include <utility>
+#include <vector>
+
+namespace mvcc {
+    class OpCoordinator;
+}
 
 namespace mvcc::op {
 
     class Transaction;
 
+    class BulkWriteOperation;
+
+    /// @brief A write appended to Transaction or BulkWriteOperation, which is applied when the operation runs. Writes
+    /// of an operation share the Version of it, so appending one only stores the node and the value.
+    struct PendingWrite {
+        Value *node_;
+        std::string value_;
+    };
+
+    /// Callback invoked after all writes of an operation are applied and before they are committed, so the writes are
+    /// still invisible to readers. It receives the num of applied writes, which are the first ones appended. If it
+    /// returns false, the applied writes will be undone. Used by ValueTable to write ahead log.
+    using CommitHook = std::function<bool(size_t num)>;
+
     /// @brief Abstract Base Class. The parent class of all derived operations
     /// @details Operation is an abstract class of sequenced operation. Each operation class will put revised ValueNode in
     /// assigned Version and commit or undo when operation finishes.
     class Operation {
+    public:
+
+        /// Get the version sequence of this operation.
+        /// \return Version value
+        [[nodiscard]] long version() const {
+            return version_.version();
+        }
+
     protected:
 
         friend class Transaction;
 
         /// Construct an Operation impl with assigned Version
-        /// \param version Assigned version
-        explicit Operation(const Version &version) : version_(version) {}
+        /// \param version Assigned version, moved into the operation
+        explicit Operation(Version version) : version_(std::move(version)) {}
+
+        Operation(const Operation &other) = default;
+
+        Operation(Operation &&other) noexcept = default;
+
+        Operation &operator=(const Operation &other) = default;
+
+        Operation &operator=(Operation &&other) noexcept = default;
 
         /// Transaction interface. Do operation without commit automatically.
         /// \return Is operation succeeded
@@ -52,6 +88,8 @@ namespace mvcc::op {
 
         friend class Transaction;
 
+        friend class BulkWriteOperation;
+
         /// Construct a WriteOperation impl.
         /// \param node Node to write
         /// \param value Value to write
@@ -62,8 +100,13 @@ namespace mvcc::op {
         ~WriteOperation() override = default;
 
         /// Start write process.
+        /// \param before_commit Hook called before the write is committed, can be empty
         /// \return Is operation succeeded
-        bool write();
+        bool write(const CommitHook &before_commit = nullptr);
+
+        /// Change the node to write. Used when the node can only be located after version is assigned.
+        /// \param node Node to write
+        void bind(Value *node);
 
         /// Comparison operator compares the ptr of operated Value node.
         /// \param other Another WriteOperation
@@ -181,6 +224,42 @@ namespace mvcc::op {
         Value *node_ = nullptr;
     };
 
+    /// @brief A lightweight read-only transaction. Generated by OpCoordinator.
+    /// @details Class ReadOnlyTransaction reads any num of nodes at one snapshot like StreamReadOperation. Instead of
+    /// holding a registered Version, whose copies share one atomic counter, it announces its version in a read slot of
+    /// the current thread, so starting and finishing it only writes a cache line owned by the thread. Version cleanup
+    /// and compaction still see the slot and keep everything visible to the snapshot.
+    /// @note It must be finished on the thread which started it, so it can neither be copied nor moved.
+    class ReadOnlyTransaction {
+    public:
+
+        ReadOnlyTransaction(const ReadOnlyTransaction &other) = delete;
+
+        ReadOnlyTransaction &operator=(const ReadOnlyTransaction &other) = delete;
+
+        /// Finish the transaction and leave the read slot.
+        ~ReadOnlyTransaction();
+
+        /// Read a node at the snapshot.
+        /// \param node Node to read
+        /// \return Expected value
+        std::string read(Value *node) const;
+
+        /// Get the snapshot version.
+        /// \return Version value
+        [[nodiscard]] long version() const;
+
+    private:
+
+        friend class mvcc::OpCoordinator;
+
+        ReadOnlyTransaction(long version, bool pinned);
+
+    private:
+        long version_;
+        bool pinned_;   // 是否公布在读槽位中，否则登记在事务协调器中
+    };
+
     /// @brief UpdateOperation is an alias of WriteOperation. Generated by OpCoordinator.
     using UpdateOperation = WriteOperation;
 
@@ -194,22 +273,48 @@ namespace mvcc::op {
     public:
 
         /// Constructs a BulkWriteOperation impl
-        /// \param version Assigned version
-        explicit BulkWriteOperation(const Version &version);
+        /// \param version Assigned version, moved into the operation
+        explicit BulkWriteOperation(Version version);
+
+        BulkWriteOperation(const BulkWriteOperation &other) = default;
+
+        BulkWriteOperation(BulkWriteOperation &&other) noexcept = default;
 
         ~BulkWriteOperation() override = default;
 
         /// Append write operation to this operation stream.
         /// \param node Node to write
-        /// \param value Value to write
-        void appendOperation(Value *node, const std::string &value);
+        /// \param value Value to write, moved into the operation
+        void appendOperation(Value *node, std::string value);
 
-        /// Execute bulk write operation. If one write operation is failed, bulk write operation will stop without undo.
+        /// Execute bulk write operation. If one write operation is failed, bulk write operation will stop without undo,
+        /// and the writes applied before are committed together.
+        /// \param before_commit Hook called before applied writes are committed, can be empty
         /// \return Is all write operation succeeded
-        bool run();
+        bool run(const CommitHook &before_commit = nullptr);
+
+        /// Create an empty bulk write operation sharing the version of this one. Partitions of a large bulk write can be
+        /// appended to and applied by different threads, and then committed together under one version.
+        /// \return Bulk write operation
+        [[nodiscard]] BulkWriteOperation share() const;
+
+        /// Apply appended writes in append order without committing them, stopping at the first failed one. Applied
+        /// writes stay invisible to readers until commitApplied is called, and their values stay locked until then, so
+        /// a hook logging them runs in the same order as the writes of each value.
+        /// \return Num of applied writes
+        size_t apply();
+
+        /// Commit the writes applied by apply and unlock their values.
+        void commitApplied();
+
+        /// Undo the writes applied by apply and unlock their values.
+        void undoApplied();
 
     private:
 
+        /// Unlock the values locked by apply.
+        void unlockApplied();
+
         /// Transaction interface. No use.
         /// \return Is operation succeeded
         bool doWithoutCommit() override;;
@@ -220,7 +325,8 @@ namespace mvcc::op {
 
     private:
 
-        std::list<WriteOperation> ops_;
+        SmallVector<PendingWrite, 8> ops_;
+        std::vector<Value *> locked_;   // apply 加锁的值，提交或撤销时释放
     };
 
     /// @brief Transaction describes a read-committed isolation transaction. Generated by OpCoordinator.
@@ -232,24 +338,40 @@ namespace mvcc::op {
     public:
 
         /// Construct a Transaction impl.
-        /// \param version Assigned version
-        explicit Transaction(const Version &version);
+        /// \param version Assigned version, moved into the transaction
+        explicit Transaction(Version version);
+
+        Transaction(const Transaction &other) = default;
+
+        Transaction(Transaction &&other) noexcept = default;
+
+        Transaction &operator=(const Transaction &other) = default;
+
+        Transaction &operator=(Transaction &&other) noexcept = default;
 
         ~Transaction() = default;
 
         /// Append write operation to this operation stream.
         /// \param node Node to write
-        /// \param value Value to write
-        void appendOperation(Value *node, const std::string &value);
-
-        /// Try do and commit this transaction. If an error occurs, all transaction will rollback.
+        /// \param value Value to write, moved into the operation
+        void appendOperation(Value *node, std::string value);
+
+        /// Try do and commit this transaction. If an error occurs, all transaction will rollback. Values are locked in
+        /// the order of their addresses, so transactions never wait for each other in a cycle, and a transaction
+        /// finding a locked value waits for it to be released instead of failing.
+        /// \param before_commit Hook called before the transaction is committed, can be empty
+        /// \param wait_ms Max time to wait for each lock, 0 to never wait
         /// \return Is committed
-        bool tryCommit() ;
+        bool tryCommit(const CommitHook &before_commit = nullptr, int wait_ms = 50);
+
+        /// Get the version sequence of this transaction.
+        /// \return Version value
+        [[nodiscard]] long version() const;
 
 
     private:
         Version version_;
-        std::list<WriteOperation> ops_;
+        SmallVector<PendingWrite, 8> ops_;
     };
 
 
@@ -0,0 +1,240 @@
+//
+// Created by 唐仁初 on 2022/12/25.
+//
+
+#include "Replication.h"
+#include <cerrno>
+#include <unordered_map>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace mvcc {
+
+    namespace {
+
+        constexpr int kPollIntervalMs = 50;     // 检查停止标志的间隔
+        constexpr int kApplyRetryNum = 10;      // 本地提交失败时的重试次数
+
+        bool sendAll(int fd, const std::string &data) {
+            size_t done = 0;
+            while (done < data.size()) {
+                // 对端关闭时套接字不触发 SIGPIPE，管道则由调用者处理该信号
+                auto n = ::send(fd, data.data() + done, data.size() - done, MSG_NOSIGNAL);
+                if (n < 0 && errno == ENOTSOCK)
+                    n = ::write(fd, data.data() + done, data.size() - done);
+                if (n < 0) {
+                    if (errno == EINTR)
+                        continue;
+                    return false;
+                }
+                done += static_cast<size_t>(n);
+            }
+            return true;
+        }
+    }
+
+    LogShipper::LogShipper(ValueTable &table, int fd, long cursor)
+            : LogShipper([&table](long &cursor, std::vector<ChangeStream::Change> &changes) {
+        return table.pollChanges(cursor, changes, 1024, kPollIntervalMs);
+    }, fd, cursor) {}
+
+    LogShipper::LogShipper(ShardedValueTable &table, int fd, long cursor)
+            : LogShipper([&table](long &cursor, std::vector<ChangeStream::Change> &changes) {
+        return table.pollChanges(cursor, changes, 1024, kPollIntervalMs);
+    }, fd, cursor) {}
+
+    LogShipper::LogShipper(Poll poll, int fd, long cursor) : poll_(std::move(poll)), fd_(fd), shipped_(cursor) {
+        shipper_ = std::thread([this] {
+            work();
+        });
+    }
+
+    LogShipper::~LogShipper() {
+        stop_.store(true);
+        shipper_.join();
+    }
+
+    long LogShipper::shippedVersion() const {
+        return shipped_.load();
+    }
+
+    size_t LogShipper::batchNum() const {
+        return batch_num_.load();
+    }
+
+    bool LogShipper::failed() const {
+        return failed_.load();
+    }
+
+    void LogShipper::work() {
+        long cursor = shipped_.load();
+        std::vector<ChangeStream::Change> changes;
+        std::vector<WriteAheadLog::Record> records;
+        std::string data;
+
+        while (!stop_.load()) {
+            changes.clear();
+            try {
+                if (!poll_(cursor, changes)) {
+                    failed_.store(true);    // 跟随者落后于变更历史，需要重新初始化
+                    return;
+                }
+            } catch (const std::runtime_error &) {
+                failed_.store(true);
+                return;
+            }
+
+            if (changes.empty())
+                continue;
+
+            // 同一个版本的变更编码为一个批次，变更流保证一个版本不会被拆分到两次读取中
+            data.clear();
+            size_t batches = 0;
+            for (size_t i = 0; i < changes.size(); i++) {
+                auto &change = changes[i];
+                records.push_back({change.type_ == ChangeStream::erase ? WriteAheadLog::erase : WriteAheadLog::put,
+                                   std::move(change.key_), std::move(change.value_)});
+
+                if (i + 1 == changes.size() || changes[i + 1].version_ != change.version_) {
+                    WriteAheadLog::encode(data, change.version_, records);
+                    records.clear();
+                    batches++;
+                }
+            }
+
+            if (!sendAll(fd_, data)) {
+                failed_.store(true);
+                return;
+            }
+            batch_num_.fetch_add(batches);
+            shipped_.store(cursor);
+        }
+    }
+
+    Follower::Follower(int fd, const ValueTable::Options &options, long version)
+            : fd_(fd), table_(options), applied_(version) {
+        applier_ = std::thread([this] {
+            work();
+        });
+    }
+
+    Follower::~Follower() {
+        stop_.store(true);
+        applier_.join();
+    }
+
+    std::string Follower::read(const std::string &key, long &version) {
+        std::shared_lock<std::shared_mutex> lk(apply_mtx_);
+        version = applied_.load();
+        return table_.read(key);
+    }
+
+    bool Follower::waitFor(long version, int wait_ms) {
+        std::unique_lock<std::mutex> lk(mtx_);
+        return applied_cv_.wait_for(lk, std::chrono::milliseconds(wait_ms), [this, version] {
+            return applied_.load() >= version || finished_;
+        }) && applied_.load() >= version;
+    }
+
+    long Follower::appliedVersion() const {
+        return applied_.load();
+    }
+
+    size_t Follower::applyNum() const {
+        return apply_num_.load();
+    }
+
+    bool Follower::finished() const {
+        std::lock_guard<std::mutex> lg(mtx_);
+        return finished_;
+    }
+
+    ValueTable &Follower::table() {
+        return table_;
+    }
+
+    void Follower::work() {
+        std::string buffer;
+        std::vector<char> chunk(1 << 16);
+        std::vector<WriteAheadLog::Batch> batches;
+
+        while (!stop_.load()) {
+            pollfd pfd{fd_, POLLIN, 0};
+            auto ready = ::poll(&pfd, 1, kPollIntervalMs);
+            if (ready < 0 && errno != EINTR)
+                break;
+            if (ready <= 0)
+                continue;
+
+            auto n = ::read(fd_, chunk.data(), chunk.size());
+            if (n < 0 && (errno == EINTR || errno == EAGAIN))
+                continue;
+            if (n <= 0)
+                break;
+            buffer.append(chunk.data(), static_cast<size_t>(n));
+
+            // 取出所有完整的批次，不完整的部分留到下次读取之后
+            size_t pos = 0;
+            try {
+                WriteAheadLog::Batch batch;
+                while (size_t used = WriteAheadLog::decode(buffer.data() + pos, buffer.size() - pos, batch)) {
+                    pos += used;
+                    // 种子检查点已经包含的版本不再应用
+                    if (batch.version_ > applied_.load())
+                        batches.emplace_back(std::move(batch));
+                }
+            } catch (const std::runtime_error &) {
+                break;
+            }
+            buffer.erase(0, pos);
+
+            if (!batches.empty() && !apply(batches))
+                break;
+            batches.clear();
+        }
+
+        {
+            std::lock_guard<std::mutex> lg(mtx_);
+            finished_ = true;
+        }
+        applied_cv_.notify_all();
+    }
+
+    bool Follower::apply(std::vector<WriteAheadLog::Batch> &batches) {
+        // 每个键只有最后一条记录决定应用之后的状态
+        std::unordered_map<std::string, WriteAheadLog::Record *> last;
+        for (auto &batch: batches) {
+            for (auto &record: batch.records_) {
+                last[record.key_] = &record;
+            }
+        }
+
+        // 空值表示删除，删除与写入作为一个本地事务提交，读操作不会看到只应用了一部分的批次
+        std::vector<std::pair<std::string, std::string>> kvs;
+        kvs.reserve(last.size());
+        for (auto &kv: last) {
+            if (kv.second->type_ == WriteAheadLog::erase)
+                kv.second->value_.clear();
+            kvs.emplace_back(kv.first, std::move(kv.second->value_));
+        }
+
+        {
+            std::unique_lock<std::shared_mutex> lk(apply_mtx_);
+
+            // 提交只会因为等锁超时或者日志写入失败而失败，多次重试仍然失败时停止应用，应用版本不前进
+            bool committed = kvs.empty();
+            for (int i = 0; i < kApplyRetryNum && !committed && !stop_.load(); i++) {
+                committed = table_.transaction(kvs);
+            }
+            if (!committed)
+                return false;
+            applied_.store(batches.back().version_);
+        }
+        apply_num_.fetch_add(1);
+
+        { std::lock_guard<std::mutex> lg(mtx_); }
+        applied_cv_.notify_all();
+        return true;
+    }
+}
@@ -0,0 +1,158 @@
+//
+// Created by 唐仁初 on 2022/12/25.
+//
+
+#ifndef ALGYOLO_REPLICATION_H
+#define ALGYOLO_REPLICATION_H
+
+#include "ValueTable.h"
+#include "ShardedValueTable.h"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace mvcc {
+
+    /// @brief Ships committed changes of a primary table to a follower.
+    /// @details Class LogShipper follows the change stream of a primary table and writes its changes to a pipe or a
+    /// socket, one batch per commit version in version order. Batches use the same format as the write-ahead log. The
+    /// primary never waits for the shipper: a follower too slow to keep up with the change history makes the shipper
+    /// fail, and the follower needs to be seeded again, such as from a checkpoint.
+    class LogShipper {
+    public:
+
+        /// Start shipping changes of a primary table.
+        /// \param table Primary table with change stream enabled
+        /// \param fd Pipe or socket to the follower, not closed by the shipper
+        /// \param cursor Version the follower has applied, such as the version of the checkpoint it loaded
+        LogShipper(ValueTable &table, int fd, long cursor);
+
+        /// Start shipping changes of a sharded primary table.
+        /// \param table Primary table with change stream enabled
+        /// \param fd Pipe or socket to the follower, not closed by the shipper
+        /// \param cursor Version the follower has applied, such as the version of the checkpoint it loaded
+        LogShipper(ShardedValueTable &table, int fd, long cursor);
+
+        /// Stop shipping. Changes not shipped yet are left to the next shipper.
+        ~LogShipper();
+
+        LogShipper(const LogShipper &other) = delete;
+
+        LogShipper &operator=(const LogShipper &other) = delete;
+
+        /// Version of the last shipped change.
+        /// \return Version
+        [[nodiscard]] long shippedVersion() const;
+
+        /// Num of batches shipped.
+        /// \return num
+        [[nodiscard]] size_t batchNum() const;
+
+        /// Whether shipping has stopped because of a write error or the follower falling behind change history.
+        /// \return True if failed
+        [[nodiscard]] bool failed() const;
+
+    private:
+
+        using Poll = std::function<bool(long &, std::vector<ChangeStream::Change> &)>;
+
+        LogShipper(Poll poll, int fd, long cursor);
+
+        // Shipping loop.
+        void work();
+
+    private:
+
+        Poll poll_;
+        int fd_;
+
+        std::atomic<long> shipped_;
+        std::atomic<size_t> batch_num_ = 0;
+        std::atomic<bool> failed_ = false;
+        std::atomic<bool> stop_ = false;
+
+        std::thread shipper_;
+    };
+
+    /// @brief A follower table applying batches shipped from a primary.
+    /// @details Class Follower reads batches from a pipe or a socket and applies them to its own ValueTable in version
+    /// order. All batches already received are applied together as one local commit, keeping only the last record of
+    /// each key, so a follower behind the primary catches up with few large commits. Reads are served at the applied
+    /// version: a read never sees part of a primary commit, and reports the primary version it reflects.
+    class Follower {
+    public:
+
+        /// Start applying shipped batches.
+        /// \param fd Pipe or socket from the primary, not closed by the follower
+        /// \param options Options of the follower table. A checkpoint of the primary can be loaded to seed it
+        /// \param version Primary version the follower table starts from, such as the version of the checkpoint
+        explicit Follower(int fd, const ValueTable::Options &options = {}, long version = 0);
+
+        /// Stop applying. Batches not applied yet are dropped.
+        ~Follower();
+
+        Follower(const Follower &other) = delete;
+
+        Follower &operator=(const Follower &other) = delete;
+
+        /// Read a value at the applied version.
+        /// \param key Key
+        /// \param version Primary version the read reflects
+        /// \return Value, empty if the key does not exist
+        std::string read(const std::string &key, long &version);
+
+        /// Block until given primary version is applied.
+        /// \param version Primary version
+        /// \param wait_ms Max time to wait
+        /// \return False if timeout or the stream has ended before
+        bool waitFor(long version, int wait_ms);
+
+        /// Primary version of the last applied batch.
+        /// \return Version
+        [[nodiscard]] long appliedVersion() const;
+
+        /// Num of local commits. Each of them applies one or more batches.
+        /// \return num
+        [[nodiscard]] size_t applyNum() const;
+
+        /// Whether the stream has ended, because the primary has closed it, a corrupt batch is received, or received
+        /// batches cannot be committed to the follower table. Batches not applied are not reflected in appliedVersion.
+        /// \return True if ended
+        [[nodiscard]] bool finished() const;
+
+        /// The follower table. It can be read directly, but must not be written while the follower is running.
+        /// \return Table
+        ValueTable &table();
+
+    private:
+
+        // Apply loop.
+        void work();
+
+        // Apply received batches as one local commit. Returns false if the commit still fails after retries.
+        bool apply(std::vector<WriteAheadLog::Batch> &batches);
+
+    private:
+
+        int fd_;
+        ValueTable table_;
+
+        std::shared_mutex apply_mtx_;   // 应用批次时独占，读操作共享，读到的值与应用版本一致
+        std::atomic<long> applied_;
+        std::atomic<size_t> apply_num_ = 0;
+
+        mutable std::mutex mtx_;
+        std::condition_variable applied_cv_;
+        bool finished_ = false;
+        std::atomic<bool> stop_ = false;
+
+        std::thread applier_;
+    };
+}
+
+#endif //ALGYOLO_REPLICATION_H
@@ -0,0 +1,320 @@
+//
+// Created by 唐仁初 on 2022/12/15.
+//
+
+#include "ShardedValueTable.h"
+#include <algorithm>
+
+namespace mvcc {
+
+    ShardedValueTable::ShardedValueTable(size_t shards, const ValueTable::Options &options) : partition_(hash) {
+        for (size_t i = 0; i < std::max<size_t>(shards, 1); i++) {
+            shards_.emplace_back(new ValueTable(shardOptions(options, i)));
+        }
+        shareChanges(options);
+    }
+
+    ShardedValueTable::ShardedValueTable(std::vector<std::string> boundaries, const ValueTable::Options &options)
+            : partition_(range), boundaries_(std::move(boundaries)) {
+        std::sort(boundaries_.begin(), boundaries_.end());
+        for (size_t i = 0; i <= boundaries_.size(); i++) {
+            shards_.emplace_back(new ValueTable(shardOptions(options, i)));
+        }
+        shareChanges(options);
+    }
+
+    ShardedValueTable::Iterator ShardedValueTable::begin() {
+        // 先登记读版本再访问内存表，防止节点在访问过程中被压缩释放
+        auto stream = Coordinator.startStreamReadOperation(nullptr);
+
+        // 所有分片的所有内存表一起归并
+        std::vector<SkipList<Value>::Iterator> its;
+        for (auto &shard: shards_) {
+            for (auto table: shard->chain_.load()->tables_) {
+                its.emplace_back(table->list().begin());
+            }
+        }
+        return Iterator(std::move(its), std::move(stream));
+    }
+
+    ShardedValueTable::Iterator ShardedValueTable::end() {
+        // 结束位置不会被读取，不需要登记读版本
+        return Iterator({}, op::StreamReadOperation(nullptr, Version(0, true)));
+    }
+
+    ShardedValueTable::Iterator ShardedValueTable::find(const std::string &key) {
+        if (!exist(key))
+            return end();
+
+        auto stream = Coordinator.startStreamReadOperation(nullptr);
+
+        // 每个内存表都定位到第一个不小于 key 的位置
+        std::vector<SkipList<Value>::Iterator> its;
+        for (auto &shard: shards_) {
+            for (auto table: shard->chain_.load()->tables_) {
+                its.emplace_back(table->list().findBetween(key).first);
+            }
+        }
+        return Iterator(std::move(its), std::move(stream));
+    }
+
+    bool ShardedValueTable::transaction(const std::vector<std::pair<std::string, std::string>> &kvs) {
+        auto transaction = Coordinator.startTransaction();
+
+        std::vector<bool> touched(shards_.size(), false);
+        for (auto &kv: kvs) {
+            auto i = shardOf(kv.first);
+            transaction.appendOperation(shards_[i]->locateForWrite(kv.first), kv.second);
+            touched[i] = true;
+        }
+
+        size_t applied = 0;
+        bool committed = transaction.tryCommit(commitHook(transaction.version(), kvs, applied));
+        if (committed)
+            shards_.front()->publishChanges(transaction.version(), kvs, kvs.size());
+
+        for (size_t i = 0; i < shards_.size(); i++) {
+            if (touched[i])
+                shards_[i]->tryCompact();
+        }
+        return committed;
+    }
+
+    bool ShardedValueTable::transaction(const ValueTable::TransactionBody &body, ValueTable::Isolation isolation) {
+        auto transaction = Coordinator.startTransaction();
+
+        // 读取的记录按分片保存，提交时由各自的分片验证
+        std::vector<std::vector<ValueTable::ReadRecord>> reads(shards_.size());
+        auto read = [this, &transaction, &reads, isolation](const std::string &key) {
+            auto i = shardOf(key);
+            return shards_[i]->readForTransaction(key, transaction.version(),
+                                                  isolation == ValueTable::serializable ? &reads[i] : nullptr);
+        };
+
+        std::vector<std::pair<std::string, std::string>> kvs;
+        if (!body(read, kvs))
+            return false;
+
+        std::vector<bool> touched(shards_.size(), false);
+        for (auto &kv: kvs) {
+            auto i = shardOf(kv.first);
+            transaction.appendOperation(shards_[i]->locateForWrite(kv.first), kv.second);
+            touched[i] = true;
+        }
+
+        size_t applied = 0;
+        auto log = commitHook(transaction.version(), kvs, applied);
+        bool committed = transaction.tryCommit([this, &reads, &transaction, &log, &applied](size_t num) {
+            for (size_t i = 0; i < shards_.size(); i++) {
+                for (auto &read: reads[i]) {
+                    if (!shards_[i]->validateRead(read, transaction.version())) {
+                        shards_[i]->conflicts_.fetch_add(1);
+                        return false;
+                    }
+                }
+            }
+            if (log)
+                return log(num);
+            applied = num;
+            return true;
+        });
+        if (committed)
+            shards_.front()->publishChanges(transaction.version(), kvs, kvs.size());
+
+        for (size_t i = 0; i < shards_.size(); i++) {
+            if (touched[i])
+                shards_[i]->tryCompact();
+        }
+        return committed;
+    }
+
+    bool ShardedValueTable::bulkWrite(const std::vector<std::pair<std::string, std::string>> &kvs) {
+        auto bulk = Coordinator.startBulkWriteOperation();
+
+        std::vector<bool> touched(shards_.size(), false);
+        for (auto &kv: kvs) {
+            auto i = shardOf(kv.first);
+            bulk.appendOperation(shards_[i]->locateForWrite(kv.first), kv.second);
+            touched[i] = true;
+        }
+
+        size_t applied = 0;
+        bool finished = bulk.run(commitHook(bulk.version(), kvs, applied));
+        shards_.front()->publishChanges(bulk.version(), kvs, applied);
+
+        for (size_t i = 0; i < shards_.size(); i++) {
+            if (touched[i])
+                shards_[i]->tryCompact();
+        }
+        return finished;
+    }
+
+    bool ShardedValueTable::erase(const std::string &key) {
+        return shard(key).erase(key);
+    }
+
+    bool ShardedValueTable::emplace(const std::string &key, const std::string &value) {
+        return shard(key).emplace(key, value);
+    }
+
+    bool ShardedValueTable::update(const std::string &key, const std::string &value) {
+        return shard(key).update(key, value);
+    }
+
+    std::string ShardedValueTable::read(const std::string &key) {
+        return shard(key).read(key);
+    }
+
+    std::vector<std::string> ShardedValueTable::multiGet(const std::vector<std::string> &keys) {
+        // 所有分片使用同一个快照版本
+        auto read = Coordinator.startReadOnlyTransaction();
+
+        std::vector<std::vector<const std::string *>> parts(shards_.size());
+        std::vector<std::vector<size_t>> index(shards_.size());
+        for (size_t i = 0; i < keys.size(); i++) {
+            auto shard = shardOf(keys[i]);
+            parts[shard].emplace_back(&keys[i]);
+            index[shard].emplace_back(i);
+        }
+
+        std::vector<std::string> res(keys.size());
+        std::vector<Value *> values;
+        for (size_t shard = 0; shard < shards_.size(); shard++) {
+            if (parts[shard].empty())
+                continue;
+
+            values.assign(parts[shard].size(), nullptr);
+            shards_[shard]->findValues(parts[shard].data(), parts[shard].size(), read.version(), values.data());
+            for (size_t j = 0; j < values.size(); j++) {
+                if (values[j] != nullptr)
+                    res[index[shard][j]] = read.read(values[j]);
+            }
+        }
+        return res;
+    }
+
+    bool ShardedValueTable::exist(const std::string &key) {
+        return shard(key).exist(key);
+    }
+
+    size_t ShardedValueTable::size() const {
+        size_t size = 0;
+        for (auto &shard: shards_) {
+            size += shard->size();
+        }
+        return size;
+    }
+
+    size_t ShardedValueTable::memoryUse() const {
+        size_t mem = 0;
+        for (auto &shard: shards_) {
+            mem += shard->memoryUse();
+        }
+        return mem;
+    }
+
+    void ShardedValueTable::compact() {
+        for (auto &shard: shards_) {
+            shard->compact();
+            shard->waitForCompaction();
+        }
+    }
+
+    size_t ShardedValueTable::conflictNum() const {
+        size_t num = 0;
+        for (auto &shard: shards_) {
+            num += shard->conflictNum();
+        }
+        return num;
+    }
+
+    bool ShardedValueTable::flushLog() {
+        bool flushed = true;
+        for (auto &shard: shards_) {
+            flushed &= shard->flushLog();
+        }
+        return flushed;
+    }
+
+    bool ShardedValueTable::pollChanges(long &cursor, std::vector<ChangeStream::Change> &changes, size_t max,
+                                        int wait_ms) {
+        return shards_.front()->pollChanges(cursor, changes, max, wait_ms);
+    }
+
+    long ShardedValueTable::lastChangeVersion() const {
+        return shards_.front()->lastChangeVersion();
+    }
+
+    size_t ShardedValueTable::shardNum() const {
+        return shards_.size();
+    }
+
+    ValueTable &ShardedValueTable::shard(const std::string &key) {
+        return *shards_[shardOf(key)];
+    }
+
+    ValueTable::Options ShardedValueTable::shardOptions(const ValueTable::Options &options, size_t i) {
+        // 每个分片使用独立的日志文件和检查点
+        auto shard_options = options;
+        if (!options.wal_path.empty())
+            shard_options.wal_path = options.wal_path + "." + std::to_string(i);
+        if (!options.checkpoint_path.empty())
+            shard_options.checkpoint_path = options.checkpoint_path + "." + std::to_string(i);
+        // 变更流由所有分片共用，在分片创建之后统一设置
+        shard_options.change_stream = false;
+        return shard_options;
+    }
+
+    void ShardedValueTable::shareChanges(const ValueTable::Options &options) {
+        if (!options.change_stream)
+            return;
+
+        // 跨分片的事务只有一个版本号，所有分片发布到同一个变更流中才能保证整体的版本顺序
+        auto changes = std::make_shared<ChangeStream>(options.change_history);
+        for (auto &shard: shards_) {
+            shard->changes_ = changes;
+        }
+    }
+
+    op::CommitHook ShardedValueTable::commitHook(long version,
+                                                 const std::vector<std::pair<std::string, std::string>> &kvs,
+                                                 size_t &applied) {
+        if (shards_.front()->log_ == nullptr) {
+            if (shards_.front()->changes_ == nullptr)
+                return nullptr;
+            return [&applied](size_t num) {
+                applied = num;
+                return true;
+            };
+        }
+
+        return [this, version, &kvs, &applied](size_t num) {
+            // 按分片拆分为多个批次，分别写入各自的日志
+            std::vector<std::vector<WriteAheadLog::Record>> records(shards_.size());
+            for (size_t i = 0; i < num; i++) {
+                auto type = kvs[i].second.empty() ? WriteAheadLog::erase : WriteAheadLog::put;
+                records[shardOf(kvs[i].first)].push_back({type, kvs[i].first, kvs[i].second});
+            }
+
+            for (size_t i = 0; i < shards_.size(); i++) {
+                if (!records[i].empty() && !shards_[i]->logBatch(version, records[i]))
+                    return false;
+            }
+            applied = num;
+            return true;
+        };
+    }
+
+    size_t ShardedValueTable::shardOf(const std::string &key) const {
+        if (partition_ == range) {
+            return std::upper_bound(boundaries_.begin(), boundaries_.end(), key) - boundaries_.begin();
+        }
+
+        // 哈希索引与过滤器使用了同一个哈希函数的低位，这里需要重新混合，避免分片内的键聚集在同一批槽位上
+        uint64_t h = std::hash<std::string>()(key);
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h % shards_.size();
+    }
+}
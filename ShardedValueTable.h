@@ -0,0 +1,179 @@
+//
+// Created by 唐仁初 on 2022/12/15.
+//
+
+#ifndef ALGYOLO_SHARDEDVALUETABLE_H
+#define ALGYOLO_SHARDEDVALUETABLE_H
+
+#include "ValueTable.h"
+#include <memory>
+#include <vector>
+
+
+namespace mvcc {
+
+    /// @brief ShardedValueTable splits the key space into independent ValueTable shards.
+    /// @details Every shard owns its own memtables, counters and compaction, so writes on different shards do not
+    /// touch the same cache lines and compaction only works on one shard. Point operations are routed by key hash or by
+    /// key range. Scans merge all shards under a single snapshot version.
+    class ShardedValueTable {
+    public:
+
+        /// Iterator provides a snapshot-read interface to ShardedValueTable. It merges the memtables of all shards,
+        /// and all of them are read with the same StreamReadOperation, so the scan is a snapshot read.
+        using Iterator = ValueTable::Iterator;
+
+        /// Describes how keys are routed to shards
+        enum Partition {
+            /// Route by key hash
+            hash,
+            /// Route by key range
+            range
+        };
+
+        /// Constructs a hash-partitioned ShardedValueTable.
+        /// \param shards Num of shards
+        /// \param options Options of each shard
+        explicit ShardedValueTable(size_t shards = 8, const ValueTable::Options &options = {});
+
+        /// Constructs a range-partitioned ShardedValueTable. Shard i holds keys in [boundaries[i-1],boundaries[i]).
+        /// \param boundaries Sorted boundary keys, shard num is boundaries.size() + 1
+        /// \param options Options of each shard
+        explicit ShardedValueTable(std::vector<std::string> boundaries, const ValueTable::Options &options = {});
+
+        ~ShardedValueTable() = default;
+
+        /// Get the begin of all values.
+        /// \return Iterator of first value
+        Iterator begin();
+
+        /// Get the end of all values.
+        /// \return Iterator of end
+        Iterator end();
+
+        /// Find a record with given key and get it's iterator. The iterator will continue with the following keys
+        /// of all shards.
+        /// \param key The key of record
+        /// \return Iterator of record
+        Iterator find(const std::string &key);
+
+        /// Start a transaction across shards. If there is any error while processing, all operations will roll back.
+        /// \param kvs vector of key-value pair to write
+        /// \return Is transaction succeeded
+        /// @note Each shard logs its part of the transaction separately, so a crash during commit may leave only part
+        /// of a cross-shard transaction in the logs
+        bool transaction(const std::vector<std::pair<std::string, std::string>> &kvs);
+
+        /// Run a read-write transaction across shards. See ValueTable::transaction.
+        /// \param body Body of transaction
+        /// \param isolation Isolation level
+        /// \return Is transaction committed
+        bool transaction(const ValueTable::TransactionBody &body,
+                         ValueTable::Isolation isolation = ValueTable::serializable);
+
+        /// Start a bulk write across shards. Operation will pause after error occurs.
+        /// \param kvs vector of key-value pair to write
+        /// \return Is all operation finished
+        bool bulkWrite(const std::vector<std::pair<std::string, std::string>> &kvs);
+
+        /// Erase a record with given key.
+        /// \param key The key of record
+        /// \return Is ok
+        bool erase(const std::string &key);
+
+        /// Emplace a record with given key and value.
+        /// \param key The key of record
+        /// \param value The value of record
+        /// \return Is ok
+        bool emplace(const std::string &key, const std::string &value);
+
+        /// Update a record with given key and value.
+        /// \param key The key of record
+        /// \param value The value of record
+        /// \return Is ok
+        bool update(const std::string &key, const std::string &value);
+
+        /// Read a record with given key. If not exists, returns "" means empty.
+        /// \param key The key of record
+        /// \return value or ""
+        std::string read(const std::string &key);
+
+        /// Read records of many keys under one snapshot of all shards. See ValueTable::multiGet.
+        /// \param keys Keys of records
+        /// \return Values in the order of keys, "" if not exists
+        std::vector<std::string> multiGet(const std::vector<std::string> &keys);
+
+        /// Check is record with given key exists.
+        /// \param key The key of record
+        /// \return Is record exists
+        bool exist(const std::string &key);
+
+        /// The num of records of all shards.
+        /// \return The num of records
+        [[nodiscard]] size_t size() const;
+
+        /// The approximately memory use of all shards.
+        /// \return Memory use
+        [[nodiscard]] size_t memoryUse() const;
+
+        /// Compact all shards one by one, so only one shard is frozen at a time. Function returns after all shards
+        /// are compacted.
+        /// @note Costly action.
+        void compact();
+
+        /// Block until all writes acknowledged before are synced to the log of every shard.
+        /// \return False if any log has failed to write
+        bool flushLog();
+
+        /// Num of serializable transactions failed because a record they read was written concurrently.
+        /// \return Conflict num
+        [[nodiscard]] size_t conflictNum() const;
+
+        /// Get committed changes of all shards after given cursor in version order. See ValueTable::pollChanges.
+        /// \param cursor Version of the last consumed change, advanced to the version of the last returned change
+        /// \param changes Returned changes are appended
+        /// \param max Max num of changes returned
+        /// \param wait_ms Max time to wait if there is no change after cursor
+        /// \return False if changes after cursor have been dropped, subscriber needs to resync with a scan
+        /// @throw std::runtime_error if change stream is not enabled
+        bool pollChanges(long &cursor, std::vector<ChangeStream::Change> &changes, size_t max = 1024, int wait_ms = 0);
+
+        /// Version of the newest change in change stream. See ValueTable::lastChangeVersion.
+        /// \return Version
+        /// @throw std::runtime_error if change stream is not enabled
+        [[nodiscard]] long lastChangeVersion() const;
+
+        /// Get the num of shards.
+        /// \return Num of shards
+        [[nodiscard]] size_t shardNum() const;
+
+        /// Get the shard which the key will be routed to.
+        /// \param key The key of record
+        /// \return Shard
+        ValueTable &shard(const std::string &key);
+
+    private:
+
+        // Get the options of shard i. Each shard owns a log file named by suffix ".i" of the log path.
+        static ValueTable::Options shardOptions(const ValueTable::Options &options, size_t i);
+
+        // Create one change stream shared by all shards if it is enabled.
+        void shareChanges(const ValueTable::Options &options);
+
+        // Build a commit hook logging the first num kvs into the logs of their shards and recording num to applied,
+        // empty if there is neither log nor change stream.
+        op::CommitHook commitHook(long version, const std::vector<std::pair<std::string, std::string>> &kvs,
+                                  size_t &applied);
+
+        // Get the index of shard which the key will be routed to.
+        [[nodiscard]] size_t shardOf(const std::string &key) const;
+
+    private:
+
+        Partition partition_;
+        std::vector<std::string> boundaries_;   // 范围分区的边界
+        std::vector<std::unique_ptr<ValueTable>> shards_;
+    };
+}
+
+#endif //ALGYOLO_SHARDEDVALUETABLE_H
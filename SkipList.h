@@ -9,6 +9,7 @@
 #include <atomic>
 #include <random>
 #include <iostream>
+#include <cstdint>
 
 namespace mvcc {
 
@@ -50,7 +51,7 @@ namespace mvcc {
             /// \param level
             /// \return Is operation succeeded
             bool setNextNode(SkipListNode *new_node, SkipListNode *old_node, int level){
-                return backward[level - 1].compare_exchange_weak(old_node, new_node);
+                return backward[level - 1].compare_exchange_strong(old_node, new_node);
             }
 
 
@@ -74,6 +75,13 @@ namespace mvcc {
                 deleted.store(false);
             }
 
+            /// Cancel the lazy free of this node. Thread safe.
+            /// \return Is node lazy freed before
+            bool revive(){
+                bool expected = true;
+                return deleted.compare_exchange_strong(expected, false);
+            }
+
             /// Check if node is lazy freed. Thread safe.
             /// \return Is node lazy freed
             bool isDeleted() {
@@ -156,6 +164,69 @@ namespace mvcc {
             SkipListNode *node_;
         };
 
+        /// @brief Reverse iterator of SkipList
+        /// @details Class ReverseIterator traverses SkipList in descending key order. The bottom level only has forward
+        /// links, so every step is a seek-for-prev search started from the top level, which costs O(log n) and keeps
+        /// the lock-free insertion of SkipList unchanged.
+        class ReverseIterator {
+        public:
+
+            friend class SkipList;
+
+            /// Constructor a reverse iterator points to given node.
+            /// \param node Node pointed to
+            /// \param list SkipList which owns the node
+            explicit ReverseIterator(SkipListNode *node, const SkipList *list = nullptr) : node_(node), list_(list) {
+
+            }
+
+            /// ReverseIterator::end is a special iterator witch points to nullptr.
+            /// \return ReverseIterator::end
+            static ReverseIterator end() {
+                return ReverseIterator(nullptr);
+            }
+
+            /// Get reference of warp value.
+            /// \return Refer of type V
+            V &operator*() const {
+                if (node_ == nullptr)
+                    throw std::runtime_error("Using operator * on invalid ReverseIterator");
+                return node_->value_;
+            }
+
+            /// Move to the node whose key is the largest one less than current key.
+            /// \return Changed impl
+            ReverseIterator &operator++() {
+                node_ = list_->findLessThan(node_->key_);
+                return *this;
+            }
+
+            bool operator==(const ReverseIterator &other) const {
+                return node_ == other.node_;
+            }
+
+            bool operator!=(const ReverseIterator &other) const {
+                return node_ != other.node_;
+            }
+
+            /// Check validity. If iterator points to nullptr or a lazy freed node, it is invalid.
+            /// \return Is iterator valid
+            explicit operator bool() const {
+                return node_ != nullptr && !node_->isDeleted();
+            }
+
+            [[nodiscard]] std::string key() const {
+                if (node_ == nullptr)
+                    throw std::runtime_error("Request key on invalid ReverseIterator");
+
+                return node_->key_;
+            }
+
+        private:
+            SkipListNode *node_;
+            const SkipList *list_;
+        };
+
     public:
 
         /// Construct an empty SkipList with given max level.
@@ -175,9 +246,13 @@ namespace mvcc {
                 delete cur;
                 cur = nxt;
             }
+            reclaim();
+
+            charge(-static_cast<long>(mem_use_.load()));  // 表中节点析构时没有逐个统计
         }
 
         /// Insert a node without value in SkipList. Thread safe. If key already exists, function will return old node's iterator.
+        /// A lazy freed node with the same key is returned as it is, and stays invisible until revive is called.
         /// Otherwise, a new node will be construct and return.
         /// \param key The key of node.
         /// \return Iterator of node with given key
@@ -208,6 +283,7 @@ namespace mvcc {
             }
 
             auto node = new SkipListNode(key, level);
+            charge(static_cast<long>(nodeBytes(node)));
 
             // 在检查的基础上，重新进行搜索，然后将值更替掉
             for (int i = level; i > 0; i--) {
@@ -252,6 +328,8 @@ namespace mvcc {
                 auto prev = findPrevByKey(i, key, start);
                 if (prev->key_ == key) {
                     prev->value_ = value;
+                    if (prev->revive())
+                        size_.fetch_add(1);
                     return Iterator(prev);
                 }
                 prev_nodes[i - 1] = prev;
@@ -259,6 +337,7 @@ namespace mvcc {
             }
 
             auto node = new SkipListNode(key, value, level);
+            charge(static_cast<long>(nodeBytes(node)));
 
             // 在检查的基础上，重新进行搜索，然后将值更替掉
             for (int i = level; i > 0; i--) {
@@ -289,6 +368,7 @@ namespace mvcc {
             int level = randomLevel();
 
             auto node = new SkipListNode(key, value, level);
+            charge(static_cast<long>(nodeBytes(node)));
 
             auto start = root_;
 
@@ -303,6 +383,7 @@ namespace mvcc {
             for (int i = level; i > 0; i--) {
                 auto prev = findPrevByKey(i, key, start);
                 if (prev->key_ == key) {
+                    charge(-static_cast<long>(nodeBytes(node)));
                     delete node;
                     return Iterator(nullptr);
                 }
@@ -359,6 +440,49 @@ namespace mvcc {
             return Iterator(nullptr);
         }
 
+        /// Find nodes of many keys. Searches of different keys are interleaved: each step of a search prefetches the
+        /// memory its next step reads and switches to another search, so the cache misses of all searches overlap
+        /// instead of being paid one after another.
+        /// \param keys Keys to find
+        /// \param n Num of keys
+        /// \param its Iterators of found nodes, iterator end if not found
+        /// @note Thread safe
+        void findMany(const std::string *const *keys, size_t n, Iterator *its) {
+
+            struct Lane {
+                size_t idx_;
+                Probe probe_;
+            };
+
+            constexpr size_t kLanes = 16;
+            Lane lanes[kLanes];
+            size_t started = 0;
+            size_t active = 0;
+
+            auto start = [&](Lane &lane) {
+                if (started == n)
+                    return false;
+                lane = {started++, {root_, nullptr, MAX_L, false}};
+                return true;
+            };
+
+            while (active < kLanes && start(lanes[active])) {
+                active++;
+            }
+
+            while (active > 0) {
+                for (size_t l = 0; l < active;) {
+                    auto &lane = lanes[l];
+                    if (step(lane.probe_, *keys[lane.idx_], its[lane.idx_])) {
+                        l++;
+                    } else if (!start(lane)) {
+                        // 没有更多的键时用最后一路替换已结束的一路
+                        lane = lanes[--active];
+                    }
+                }
+            }
+        }
+
         /// Find nodes whose key between min and max, [min,max]. Function returns the startup iterator and concluding iterator。
         /// User must check validity of iterator when traversing.
         /// \param min The lower bound of key, default MIN
@@ -408,6 +532,17 @@ namespace mvcc {
             return true;
         }
 
+        /// Cancel the lazy free of the node iterator points to, so that it is visible again. Thread safe.
+        /// \param iterator Node to revive
+        /// \return Is node lazy freed before
+        bool revive(const Iterator &iterator) {
+            auto node = iterator.node_;
+            if (node == nullptr || !node->revive())
+                return false;
+            size_.fetch_add(1);
+            return true;
+        }
+
         /// Lazy free a node with given iterator. Thread Safe. If not found, function will return false.
         /// \param iterator Node to lazy free
         /// \return Is operation succeeded
@@ -451,6 +586,42 @@ namespace mvcc {
             return Iterator::end();
         }
 
+        /// Get the reverse iterator of last element in SkipList.
+        /// \return The reverse iterator of last node
+        /// @note Thread safe
+        ReverseIterator rbegin() const {
+            SkipListNode *node = root_;
+
+            for (int i = MAX_L; i > 0; i--) {
+                auto nxt = node->getNextNode(i);
+                while (nxt != nullptr) {
+                    node = nxt;
+                    nxt = node->getNextNode(i);
+                }
+            }
+            return ReverseIterator(node == root_ ? nullptr : node, this);
+        }
+
+        /// Get the reverse iterator of end. ReverseIterator::end is a iterator points to null.
+        /// \return The reverse iterator of end
+        ReverseIterator rend() const {
+            return ReverseIterator::end();
+        }
+
+        /// Seek for the node whose key is the largest one less than or equal to given key. If not found, returns
+        /// reverse iterator end.
+        /// \param key The key to seek
+        /// \return Reverse iterator of found node
+        /// @note Thread safe
+        ReverseIterator seekForPrev(const std::string &key) const {
+            SkipListNode *node = root_;
+
+            for (int i = MAX_L; i > 0; i--) {
+                node = findPrevByKey(i, key, node);
+            }
+            return ReverseIterator(node == root_ ? nullptr : node, this);
+        }
+
         /// Get the reference of node's value with given key. If node not exists, a new node will be constructed.
         /// \param key The key of node
         /// \return The reference of value
@@ -480,6 +651,7 @@ namespace mvcc {
 
             while (cur != nullptr) {
                 auto nxt = cur->getNextNode(1);
+                charge(-static_cast<long>(nodeBytes(cur)));
                 delete cur;
                 cur = nxt;
             }
@@ -489,32 +661,80 @@ namespace mvcc {
         /// Compact this SkipList and release all deleted nodes. This function is not thread safe.
         /// @warning Not Thread Safe.
         void compact(){
+            while (!compactStep(SIZE_MAX)) {}
+            reclaim();
+        }
 
-            // 需要遍历每一个层级
-            for(int level = MAX_L; level > 0;level--){
-
-                auto slow = root_;
-                auto fast = root_->getNextNode(level);
+        /// Compact a bounded slice of this SkipList. Every call continues from the position where last call stopped, and
+        /// visits at most given num of nodes on the bottom level. Deleted nodes are unlinked from all levels in one pass
+        /// and retired instead of released, so readers traversing them are still safe. Retired nodes will be released
+        /// by function reclaim.
+        /// \param budget Max num of nodes to visit
+        /// \return Is whole SkipList compacted
+        /// @warning Make sure no insertion in this SkipList. Reading is allowed.
+        bool compactStep(size_t budget) {
 
-                while (fast != nullptr) {
+            if (compact_prev_.empty()) {
+                compact_prev_.assign(MAX_L, root_);
+                compact_cur_ = root_->getNextNode(1);
+            }
 
-                    if(fast->isDeleted()){
-                        auto nxt = fast->getNextNode(level);
-                        slow->setNextNode(nxt,fast,level);  // new,old,level
+            // 每一层都记录最后一个未删除的节点，被删除的节点可以在一次遍历中从所有层级中移出
+            while (compact_cur_ != nullptr && budget-- > 0) {
+                auto node = compact_cur_;
+                compact_cur_ = node->getNextNode(1);
 
-                        if(level == 1)
-                            delete fast;    // 防止重复删除
-                        fast = nxt;
-                        continue;
+                if (node->isDeleted()) {
+                    for (int level = node->level(); level > 0; level--) {
+                        compact_prev_[level - 1]->setNextNode(node->getNextNode(level), node, level);
                     }
+                    retired_.emplace_back(node);
+                    continue;
+                }
 
-                    auto nxt = fast->getNextNode(level);
-                    slow = fast;
-                    fast = nxt;
+                for (int level = node->level(); level > 0; level--) {
+                    compact_prev_[level - 1] = node;
                 }
+            }
+
+            if (compact_cur_ != nullptr)
+                return false;
 
+            compact_prev_.clear();
+            return true;
+        }
+
+        /// Release all nodes retired by compaction.
+        /// @warning Make sure no reader is using retired nodes.
+        void reclaim() {
+            for (auto node: retired_) {
+                charge(-static_cast<long>(nodeBytes(node)));
+                delete node;
             }
+            retired_.clear();
+        }
 
+        /// Get approximately memory use of all nodes, including keys, towers and retired nodes. Memory owned by values
+        /// out of the node is not included.
+        /// \return Memory use in bytes
+        /// @note Thread safe
+        [[nodiscard]] size_t memoryUse() const {
+            return mem_use_.load();
+        }
+
+        /// Bind a memory counter to this SkipList. Memory use of nodes will also be added to or subtracted from the
+        /// counter, including the nodes already in list.
+        /// \param account Memory counter, usually owned by table
+        /// @warning Not thread safe, bind it before the SkipList is shared
+        void setAccount(std::atomic<size_t> *account) {
+            account_ = account;
+            account_->fetch_add(mem_use_.load());
+        }
+
+        /// Get num of nodes retired by compaction and waiting to be released.
+        /// \return num
+        [[nodiscard]] size_t retiredNum() const {
+            return retired_.size();
         }
 
         /// Merge this SkipList and other one. It will use copy rather than view. Make sure that other SkipList will not
@@ -572,7 +792,7 @@ namespace mvcc {
         /// \param key Key to search
         /// \param start Node to start with
         /// \return Search result.
-        SkipListNode *findPrevByKey(int level, const std::string &key, SkipListNode *start) {
+        SkipListNode *findPrevByKey(int level, const std::string &key, SkipListNode *start) const {
             if (start->level() < level)
                 return nullptr;
 
@@ -587,6 +807,80 @@ namespace mvcc {
         }
 
 
+        /// State of an interleaved search. The successor needs to be loaded before it is compared if loaded_ is false.
+        struct Probe {
+            SkipListNode *node_;
+            SkipListNode *next_;
+            int level_;
+            bool loaded_;
+        };
+
+        /// Internal interface. Run one step of an interleaved search, which either loads the successor of current node
+        /// on current level, or compares the loaded successor with key and moves right or down. Every step only reads
+        /// memory prefetched by the previous step.
+        /// \param probe State of the search
+        /// \param key Key to find
+        /// \param it Result, set when search finishes
+        /// \return Is search still running
+        static bool step(Probe &probe, const std::string &key, Iterator &it) {
+            if (!probe.loaded_) {
+                probe.next_ = probe.node_->getNextNode(probe.level_);
+                probe.loaded_ = true;
+                if (probe.next_ != nullptr)
+                    __builtin_prefetch(probe.next_);
+                return true;
+            }
+
+            probe.loaded_ = false;
+            int cmp = probe.next_ == nullptr ? 1 : probe.next_->key_.compare(key);
+            if (cmp == 0) {
+                it = probe.next_->isDeleted() ? Iterator(nullptr) : Iterator(probe.next_);
+                return false;
+            }
+
+            if (cmp < 0) {
+                probe.node_ = probe.next_;
+            } else if (--probe.level_ == 0) {
+                it = Iterator(nullptr);
+                return false;
+            }
+
+            __builtin_prefetch(&probe.node_->backward[probe.level_ - 1]);
+            return true;
+        }
+
+        /// Internal interface. Find the node whose key is the largest one less than given key. If not found,
+        /// function will return nullptr.
+        /// \param key Key to search
+        /// \return Search result
+        SkipListNode *findLessThan(const std::string &key) const {
+            SkipListNode *node = root_;
+
+            for (int i = MAX_L; i > 0; i--) {
+                auto nxt = node->getNextNode(i);
+                while (nxt != nullptr && nxt->key_ < key) {
+                    node = nxt;
+                    nxt = node->getNextNode(i);
+                }
+            }
+            return node == root_ ? nullptr : node;
+        }
+
+        /// Internal interface. Add given num of bytes to memory use of this list and bound counter.
+        /// \param delta Changed bytes, negative if released
+        void charge(long delta) {
+            mem_use_.fetch_add(delta);
+            if (account_ != nullptr)
+                account_->fetch_add(delta);
+        }
+
+        /// Internal interface. Get memory use of given node, including key and tower.
+        /// \param node Node to count
+        /// \return Memory use in bytes
+        static size_t nodeBytes(const SkipListNode *node) {
+            return sizeof(SkipListNode) + node->key_.capacity() + node->backward.capacity() * sizeof(void *);
+        }
+
         /// Internal interface. Generate a random level used to construct new node.
         /// \return Generated level
         int randomLevel() {
@@ -605,6 +899,12 @@ namespace mvcc {
         SkipListNode *root_;
         int MAX_L;
         std::atomic<size_t> size_ = 0;
+        std::atomic<size_t> mem_use_ = 0;   // 所有节点的内存占用，包括未释放的已移出节点
+        std::atomic<size_t> *account_ = nullptr;    // 所属表的内存计数
+
+        std::vector<SkipListNode *> compact_prev_;  // 增量压缩时每一层的前驱节点
+        SkipListNode *compact_cur_ = nullptr;       // 增量压缩的当前位置
+        std::vector<SkipListNode *> retired_;       // 已经移出但是还未释放的节点
     };
 
 
@@ -0,0 +1,223 @@
+//
+// Created by 唐仁初 on 2022/12/26.
+//
+
+#ifndef ALGYOLO_SMALLVECTOR_H
+#define ALGYOLO_SMALLVECTOR_H
+
+#include <cstddef>
+#include <new>
+#include <utility>
+
+namespace mvcc {
+
+    /// @brief A vector keeping its first N elements inside the object.
+    /// @details Class SmallVector stores up to N elements in inline storage, and only moves them to heap when it grows
+    /// beyond N. Operations record their writes with it, so an operation with a few writes, which most of them are,
+    /// allocates nothing for its bookkeeping. Moving a vector on heap only takes its buffer.
+    /// \tparam T Element type, should be nothrow move constructible
+    /// \tparam N Num of elements stored inline
+    template<typename T, size_t N>
+    class SmallVector {
+    public:
+
+        using iterator = T *;
+        using const_iterator = const T *;
+
+        /// Constructs an empty vector using inline storage.
+        SmallVector() = default;
+
+        /// Copy constructor. Elements are copied one by one.
+        /// \param other Source object
+        SmallVector(const SmallVector &other) {
+            append(other);
+        }
+
+        /// Move constructor. Buffer on heap is taken, and elements in inline storage are moved one by one.
+        /// \param other Source object, left empty
+        SmallVector(SmallVector &&other) noexcept {
+            take(other);
+        }
+
+        SmallVector &operator=(const SmallVector &other) {
+            if (this != &other) {
+                clear();
+                append(other);
+            }
+            return *this;
+        }
+
+        SmallVector &operator=(SmallVector &&other) noexcept {
+            if (this != &other) {
+                release();
+                take(other);
+            }
+            return *this;
+        }
+
+        ~SmallVector() {
+            release();
+        }
+
+        /// Construct an element at the end.
+        /// \param args Arguments of element constructor
+        /// \return Constructed element
+        template<typename... Args>
+        T &emplace_back(Args &&... args) {
+            if (size_ < capacity_)
+                return *new(data_ + size_++) T(std::forward<Args>(args)...);
+
+            // 参数可能引用本数组中的元素，需要在扩容之前构造
+            T value(std::forward<Args>(args)...);
+            grow(capacity_ * 2);
+            return *new(data_ + size_++) T(std::move(value));
+        }
+
+        void push_back(const T &value) {
+            emplace_back(value);
+        }
+
+        void push_back(T &&value) {
+            emplace_back(std::move(value));
+        }
+
+        /// Make room for given num of elements, so that the vector grows at most once.
+        /// \param capacity Num of elements
+        void reserve(size_t capacity) {
+            if (capacity > capacity_)
+                grow(capacity);
+        }
+
+        /// Change the num of elements. New elements are default constructed.
+        /// \param size Num of elements
+        void resize(size_t size) {
+            reserve(size);
+            while (size_ > size) {
+                data_[--size_].~T();
+            }
+            while (size_ < size) {
+                new(data_ + size_++) T();
+            }
+        }
+
+        /// Destroy all elements. Capacity is kept.
+        void clear() {
+            while (size_ > 0) {
+                data_[--size_].~T();
+            }
+        }
+
+        [[nodiscard]] size_t size() const {
+            return size_;
+        }
+
+        [[nodiscard]] bool empty() const {
+            return size_ == 0;
+        }
+
+        [[nodiscard]] size_t capacity() const {
+            return capacity_;
+        }
+
+        /// Whether elements are still stored inline.
+        /// \return Is inline
+        [[nodiscard]] bool isInline() const {
+            return data_ == inlineData();
+        }
+
+        T &operator[](size_t i) {
+            return data_[i];
+        }
+
+        const T &operator[](size_t i) const {
+            return data_[i];
+        }
+
+        T &back() {
+            return data_[size_ - 1];
+        }
+
+        iterator begin() {
+            return data_;
+        }
+
+        iterator end() {
+            return data_ + size_;
+        }
+
+        const_iterator begin() const {
+            return data_;
+        }
+
+        const_iterator end() const {
+            return data_ + size_;
+        }
+
+    private:
+
+        T *inlineData() {
+            return reinterpret_cast<T *>(inline_);
+        }
+
+        const T *inlineData() const {
+            return reinterpret_cast<const T *>(inline_);
+        }
+
+        // Move elements to a heap buffer of given capacity.
+        void grow(size_t capacity) {
+            auto data = static_cast<T *>(::operator new(sizeof(T) * capacity));
+            for (size_t i = 0; i < size_; i++) {
+                new(data + i) T(std::move(data_[i]));
+                data_[i].~T();
+            }
+            if (!isInline())
+                ::operator delete(data_);
+            data_ = data;
+            capacity_ = capacity;
+        }
+
+        // Copy all elements of other to the end.
+        void append(const SmallVector &other) {
+            reserve(size_ + other.size_);
+            for (auto &value: other) {
+                new(data_ + size_++) T(value);
+            }
+        }
+
+        // Take the elements of other, which is left empty. Must be called with this one empty and inline.
+        void take(SmallVector &other) {
+            if (!other.isInline()) {
+                data_ = other.data_;
+                capacity_ = other.capacity_;
+                size_ = other.size_;
+                other.data_ = other.inlineData();
+                other.capacity_ = N;
+                other.size_ = 0;
+                return;
+            }
+
+            for (auto &value: other) {
+                new(data_ + size_++) T(std::move(value));
+            }
+            other.clear();
+        }
+
+        // Destroy all elements and free heap buffer, then go back to inline storage.
+        void release() {
+            clear();
+            if (!isInline())
+                ::operator delete(data_);
+            data_ = inlineData();
+            capacity_ = N;
+        }
+
+    private:
+
+        alignas(T) unsigned char inline_[sizeof(T) * N];
+        T *data_ = inlineData();    // 当前存储位置，内联存储或者堆上的缓冲
+        size_t size_ = 0;
+        size_t capacity_ = N;
+    };
+}
+
+#endif //ALGYOLO_SMALLVECTOR_H
@@ -4,11 +4,15 @@
 
 #include "Value.h"
 #include "OpCoordinator.h"
+#include "ValueLog.h"
+
+#include <climits>
 
 namespace mvcc{
 
     ValueNode::ValueNode(std::string value, long version, ValueNode *prev, ValueNode *nxt, ValueNode::Status status) : value_(
-            std::move(value)), prev_(prev), nxt_(nxt), version_(version), status_(status) {
+            std::move(value)), prev_(prev), nxt_(nxt), version_(version), status_(status),
+            committed_(status == Uncommitted ? LONG_MAX : -1) {
     }
 
     bool ValueNode::commit() {
@@ -16,21 +20,12 @@ namespace mvcc{
         if (status_ != ValueNode::Uncommitted)
             return false;
 
-        // 得到当前活跃的最低版本号
-        long lowest_version = Coordinator.getLowestVersion();
-
-        auto prev = prev_.load();
-
-        // 只有最旧的事务可以进行移出
-        while (prev != nullptr && prev->version_ < lowest_version && prev->status_ != ValueNode::Uncommitted) {
-            prev_.store(nullptr);
-            auto nxt = prev->prev_.load();
-            delete prev;
-            prev = nxt;
-        }
-
         status_ = value_.empty() ? ValueNode::Deleted : ValueNode::Committed;
 
+        // 状态写入之后再读取版本号，跳过了未提交状态的读操作的快照版本都不会大于读到的版本号
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        committed_ = Coordinator.getNewestVersion();
+
         return true;
     }
 
@@ -39,9 +34,15 @@ namespace mvcc{
         return true;
     }
 
+    std::string ValueNode::value() const {
+        return spill_ == nullptr ? value_ : spill_->read(value_);
+    }
+
 
 
     Value::~Value() {
+        charge(-static_cast<long>(mem_use_.load()));
+
         auto cur = latest.load();
         while(cur!= nullptr){
             auto nxt = cur->prev_.load();
@@ -52,7 +53,7 @@ namespace mvcc{
 
     Value::Value(const std::string &value, long version)
             : latest(new ValueNode(value, version, nullptr, nullptr, ValueNode::Committed)) {
-        mem_use_.fetch_add(value.size() + sizeof(long) + sizeof(ValueNode::status_));
+        mem_use_.store(nodeBytes(latest.load()));
     }
 
     Value::Value(const Value &other) : mtx(){
@@ -62,8 +63,8 @@ namespace mvcc{
             throw std::runtime_error("Copy a value with status uncommitted");
         }
 
-        latest = new ValueNode(node->value_,node->version_,nullptr, nullptr,node->status_);
-        mem_use_ = other.mem_use_.load();
+        latest = new ValueNode(node->value(),node->version_,nullptr, nullptr,node->status_);
+        mem_use_ = nodeBytes(latest.load());
         mtx.unlock();
     }
 
@@ -76,8 +77,8 @@ namespace mvcc{
             throw std::runtime_error("Copy a value with status uncommitted");
         }
 
-        latest = new ValueNode(node->value_,node->version_,nullptr, nullptr,node->status_);
-        mem_use_ = other.mem_use_.load();
+        latest = new ValueNode(node->value(),node->version_,nullptr, nullptr,node->status_);
+        charge(static_cast<long>(nodeBytes(latest.load())) - static_cast<long>(mem_use_.load()));
         mtx.unlock();
         return *this;
     }
@@ -92,8 +93,10 @@ namespace mvcc{
         }
 
         auto node = new ValueNode(value, version, latest, nullptr);
+        charge(static_cast<long>(nodeBytes(node)));
 
         latest.exchange(node);
+        removeOutdated(node);
         return node;
     }
 
@@ -103,6 +106,10 @@ namespace mvcc{
 
     std::string Value::read(long version, bool read_latest) {
 
+        // 先读再写，避免热点值的每次读取都写同一个缓存行
+        if (!accessed_.load(std::memory_order_relaxed))
+            accessed_.store(true, std::memory_order_relaxed);
+
         auto node = latest.load();
 
         if (read_latest) {
@@ -110,7 +117,7 @@ namespace mvcc{
             while (node != nullptr) {
 
                 if (node->status_ == ValueNode::Committed)
-                    return node->value_;
+                    return node->value();
 
                 if (node->status_ == ValueNode::Deleted)
                     return {};
@@ -123,7 +130,7 @@ namespace mvcc{
             while (node != nullptr) {
 
                 if (node->status_ == ValueNode::Committed && node->version_ <= version)
-                    return node->value_;
+                    return node->value();
 
                 if (node->status_ == ValueNode::Deleted)
                     return {};
@@ -135,35 +142,235 @@ namespace mvcc{
         return {};
     }
 
-    bool Value::getLock(int wait_ms) {
-        auto locked = mtx.try_lock_for(std::chrono::milliseconds(wait_ms));
-        if (!locked)
+    std::string Value::read(long version, const ValueNode *&visible) {
+        if (!accessed_.load(std::memory_order_relaxed))
+            accessed_.store(true, std::memory_order_relaxed);
+
+        // 与快照读相同，同时记录停下的位置
+        auto node = latest.load();
+        while (node != nullptr) {
+            if ((node->status_ == ValueNode::Committed && node->version_ <= version) ||
+                node->status_ == ValueNode::Deleted)
+                break;
+            node = node->prev_.load();
+        }
+
+        visible = node;
+        return node == nullptr || node->status_ == ValueNode::Deleted ? std::string() : node->value();
+    }
+
+    bool Value::validate(const ValueNode *visible, long version) const {
+        // 跳过回滚的版本和事务自身写入的版本，之后的第一个版本必须仍是读到的版本
+        auto node = latest.load();
+        while (node != nullptr && (node->status_ == ValueNode::Undo || node->version_ == version)) {
+            node = node->prev_.load();
+        }
+        return node == visible;
+    }
+
+    void Value::prefetch() const {
+        __builtin_prefetch(latest.load(std::memory_order_relaxed));
+    }
+
+    long Value::visibleVersion(long version) const {
+        auto node = latest.load();
+
+        while (node != nullptr) {
+            if ((node->status_ == ValueNode::Committed && node->version_ <= version) ||
+                node->status_ == ValueNode::Deleted)
+                return node->version_;
+
+            node = node->prev_.load();
+        }
+        return -1;
+    }
+
+    bool Value::visible(long version) const {
+        auto node = latest.load();
+
+        while (node != nullptr) {
+            if (node->status_ == ValueNode::Committed && node->version_ <= version)
+                return true;
+            if (node->status_ == ValueNode::Deleted)
+                return false;
+
+            node = node->prev_.load();
+        }
+        return false;
+    }
+
+    bool Value::merge(const Value &other, int wait_ms) {
+
+        std::unique_lock<std::timed_mutex> lg(mtx, std::defer_lock);
+        auto locked = lg.try_lock_for(std::chrono::milliseconds(wait_ms));
+
+        if (!locked) {
             return false;
-        in_transaction = true;
-        return in_transaction;
+        }
+
+        // 找到另一个值最新的已提交版本
+        auto src = other.latest.load();
+        while (src != nullptr && src->status_ != ValueNode::Committed && src->status_ != ValueNode::Deleted) {
+            src = src->prev_.load();
+        }
+
+        if (src == nullptr)
+            return true;
+
+        // 回滚的版本不参与比较
+        auto cur = latest.load();
+        while (cur != nullptr && cur->status_ == ValueNode::Undo) {
+            cur = cur->prev_.load();
+        }
+
+        if (cur != nullptr && cur->version_ >= src->version_)
+            return true;
+
+        // 已换出的值只需要复制位置，值日志属于同一张表
+        auto node = new ValueNode(src->value_, src->version_, latest, nullptr, src->status_);
+        node->spill_ = src->spill_;
+        charge(static_cast<long>(nodeBytes(node)));
+
+        latest.exchange(node);
+        removeOutdated(node);
+        return true;
+    }
+
+    bool Value::vacuum() {
+
+        std::unique_lock<std::timed_mutex> lg(mtx, std::try_to_lock);
+        if (!lg.owns_lock())
+            return false;
+
+        auto node = latest.load();
+        if (node != nullptr)
+            removeOutdated(node);
+        return true;
+    }
+
+    ValueNode *Value::spill(ValueLog *log, size_t min_size) {
+
+        // 最近被读过的值再保留一轮
+        if (accessed_.exchange(false, std::memory_order_relaxed))
+            return nullptr;
+
+        std::unique_lock<std::timed_mutex> lg(mtx, std::try_to_lock);
+        if (!lg.owns_lock())
+            return nullptr;
+
+        // 只剩下一个已提交的版本时，所有操作看到的都是这个版本，换出之后版本号不变
+        auto node = latest.load();
+        if (node == nullptr || node->status_ != ValueNode::Committed || node->prev_.load() != nullptr ||
+            node->spill_ != nullptr || node->value_.size() < min_size)
+            return nullptr;
+
+        std::string location;
+        if (!log->append(node->value_, location))
+            return nullptr;
+
+        auto spilled = new ValueNode(std::move(location), node->version_, nullptr, nullptr, ValueNode::Committed);
+        spilled->spill_ = log;
+        charge(static_cast<long>(nodeBytes(spilled)) - static_cast<long>(nodeBytes(node)));
+
+        // 正在读取旧版本的读操作可能仍持有它，由调用者在这些操作结束之后释放
+        latest.store(spilled);
+        return node;
+    }
+
+    bool Value::getLock(int wait_ms) {
+        return mtx.try_lock_for(std::chrono::milliseconds(wait_ms));
     }
 
     void Value::unlock() {
-        if (in_transaction)
-            mtx.unlock();
+        mtx.unlock();
+    }
+
+    void Value::bury() {
+        // 删除标记对所有快照都隐藏更旧的版本，版本号沿用最新的记录，合并进来的更新版本仍然可以追加在它之后
+        auto prev = latest.load();
+        auto node = new ValueNode({}, prev == nullptr ? 0 : prev->version_, prev, nullptr, ValueNode::Deleted);
+        charge(static_cast<long>(nodeBytes(node)));
+
+        latest.store(node);
+        removeOutdated(node);
     }
 
     size_t Value::memoryUse() const {
         return mem_use_.load();
     }
 
+    void Value::setAccount(std::atomic<size_t> *account) {
+        if (account_.load() != nullptr)
+            return;
+
+        // 绑定前的内存占用在绑定时一次性计入，之后的变化在写入和清理时计入
+        std::atomic<size_t> *expected = nullptr;
+        if (account_.compare_exchange_strong(expected, account))
+            account->fetch_add(mem_use_.load());
+    }
+
     ValueNode *Value::updateValue(const std::string &value, long version) {
 
         // 这里要检查有没有被锁
         mtx.try_lock();
 
         auto node = new ValueNode(value, version, latest, nullptr);
+        charge(static_cast<long>(nodeBytes(node)));
 
         latest.exchange(node);
+        removeOutdated(node);
 
         return node;
     }
 
+    void Value::removeOutdated(ValueNode *node) {
+
+        // 得到当前活跃的最低版本号
+        long lowest_version = Coordinator.getLowestVersion();
+
+        // 找到最低活跃版本可见的节点，所有活跃的读操作都会在该节点或更新的节点处停止，比它更旧的节点可以移出。
+        // 读操作会跳过未提交的节点，所以该节点需要在所有活跃的读操作开始之前已经提交
+        auto keep = node;
+        while (keep != nullptr && (keep->version_ > lowest_version || keep->status_ == ValueNode::Uncommitted ||
+                                   keep->status_ == ValueNode::Undo || keep->committed_ >= lowest_version)) {
+            keep = keep->prev_.load();
+        }
+
+        if (keep == nullptr)
+            return;
+
+        // 写入顺序与版本号顺序不一定一致，更旧的位置上可能还有未提交的节点，此时它仍被所属操作持有，不能移出
+        for (auto cur = keep->prev_.load(); cur != nullptr; cur = cur->prev_.load()) {
+            if (cur->status_ == ValueNode::Uncommitted)
+                return;
+        }
+
+        long released = 0;
+        auto prev = keep->prev_.exchange(nullptr);
+        while (prev != nullptr) {
+            auto nxt = prev->prev_.load();
+            released += static_cast<long>(nodeBytes(prev));
+            delete prev;
+            prev = nxt;
+        }
+        charge(-released);
+    }
+
+    void Value::charge(long delta) {
+        if (delta == 0)
+            return;
+
+        mem_use_.fetch_add(delta);
+
+        auto account = account_.load();
+        if (account != nullptr)
+            account->fetch_add(delta);
+    }
+
+    size_t Value::nodeBytes(const ValueNode *node) {
+        return sizeof(ValueNode) + node->value_.capacity();
+    }
+
 
 
 
@@ -12,6 +12,8 @@
 
 namespace mvcc {
 
+    class ValueLog;
+
     namespace op {
 
         class Operation;
@@ -19,6 +21,8 @@ namespace mvcc {
         class Transaction;
 
         class WriteOperation;
+
+        class BulkWriteOperation;
     }
 
 
@@ -61,12 +65,20 @@ namespace mvcc {
         /// \return Is operation OK
         bool undo();
 
+    private:
+
+        /// Get the value of this node, fetched from value log if it is spilled.
+        /// \return Value
+        [[nodiscard]] std::string value() const;
+
     private:
 
         long version_;
-        std::string value_;
+        std::string value_;     // 换出到值日志之后保存值的位置
         Status status_;
+        long committed_;        // 提交之后读到的最新版本号，之前开始的读操作可能看到过未提交的状态
         std::atomic<ValueNode *> prev_, nxt_;
+        ValueLog *spill_ = nullptr;     // 值所在的值日志，为空表示值在内存中
     };
 
 
@@ -124,18 +136,84 @@ namespace mvcc {
         /// \return Read value
         std::string read(long version, bool read_latest = false);
 
-        /// Lock this value. Only used in transaction operations.Operation will wait for given time to get mutex.
+        /// Snapshot read which also returns the version record it stops at, so that a serializable transaction can check
+        /// at commit whether the value has been written since.
+        /// \param version Operation version
+        /// \param visible Version record read, nullptr if there is no visible one
+        /// \return Read value
+        std::string read(long version, const ValueNode *&visible);
+
+        /// Check a read of a serializable transaction. The read is still valid if, apart from rolled back ones and the
+        /// ones written by the transaction itself, no version record is newer than the one read, committed or not.
+        /// \param visible Version record returned by read, nullptr if nothing was visible
+        /// \param version Version of the transaction
+        /// \return Is read still valid
+        bool validate(const ValueNode *visible, long version) const;
+
+        /// Prefetch the newest version record, so that the cache misses of reading many values overlap.
+        void prefetch() const;
+
+        /// Get the version of the node which a snapshot read with given version will return.
+        /// \param version Operation version
+        /// \return Version of visible node, -1 if no node is visible
+        long visibleVersion(long version) const;
+
+        /// Check whether a snapshot read with given version returns a value, rather than a tombstone or nothing.
+        /// \param version Operation version
+        /// \return Is value visible
+        bool visible(long version) const;
+
+        /// Merge the latest committed value of other impl into this one as a new version. If this impl already owns a
+        /// newer version, nothing will be changed. Operation will wait for given time to get mutex.
+        /// \param other Other Value impl
+        /// \param wait_ms Max wait time
+        /// \return Is operation succeeded
+        bool merge(const Value &other, int wait_ms = 50);
+
+        /// Release the version records which no alive operation can see. It is used by background vacuum for values
+        /// which are not written any more. If the value is locked, nothing will be done.
+        /// \return Is operation succeeded
+        bool vacuum();
+
+        /// Spill the value to given value log if it is cold. A value is cold if it has not been read since the last call,
+        /// and only its latest committed version is left. Otherwise the read mark is cleared, so the value will be
+        /// spilled by next call if it is not read again. The spilled version is replaced by a new record holding the
+        /// location of the value, and the replaced one is returned because concurrent readers may still access it.
+        /// \param log Value log to append
+        /// \param min_size Min size of value worth spilling
+        /// \return Replaced version record, which must be released after all operations alive now have finished.
+        /// nullptr if nothing is spilled
+        ValueNode *spill(ValueLog *log, size_t min_size);
+
+        /// Lock this value. Only used in transaction operations. Transactions lock their values in a canonical order,
+        /// so they never wait for each other in a cycle, and waiting for the holder is always safe. The timeout only
+        /// bounds the wait behind a slow holder.
         /// \param wait_ms Max wait time
         /// \return Is operation succeeded
         bool getLock(int wait_ms = 50);
 
-        /// Release the lock.
+        /// Release the lock acquired by getLock.
         void unlock();
 
-        /// Get approximately memory use of this node.
-        /// \return Memory use
+        /// Hide all versions with a committed tombstone. Used before a lazy freed record is written again, so that
+        /// neither its old value nor an aborted write makes it visible. Must be called with the value locked.
+        void bury();
+
+        /// Get memory use of all version records of this value.
+        /// \return Memory use in bytes
         size_t memoryUse() const;
 
+        /// Bind a memory counter to this value. Memory use of version records will also be added to or subtracted from
+        /// the counter. Only the first bound counter takes effect.
+        /// \param account Memory counter, usually owned by table
+        /// @warning Bind before the value is written, otherwise concurrent writes may be counted twice
+        void setAccount(std::atomic<size_t> *account);
+
+        /// Get memory use of given version record.
+        /// \param node Version record
+        /// \return Memory use in bytes
+        static size_t nodeBytes(const ValueNode *node);
+
     private:
 
         friend class ValueNodeOperation;
@@ -146,12 +224,21 @@ namespace mvcc {
         /// \return Ptr of operated ValueNode.
         ValueNode *updateValue(const std::string &value, long version);
 
+        /// Release the nodes older than the one visible to lowest alive version. Must be called with mutex held.
+        /// \param node Node to start search, included
+        void removeOutdated(ValueNode *node);
+
+        /// Add given num of bytes to memory use of this value and bound counter.
+        /// \param delta Changed bytes, negative if released
+        void charge(long delta);
+
     private:
         std::timed_mutex mtx;
         std::atomic<ValueNode *> latest = nullptr;
         std::atomic<size_t> mem_use_ = 0;
+        std::atomic<std::atomic<size_t> *> account_ = nullptr;   // 所属表的内存计数
 
-        bool in_transaction = false;    // 用于区分节点是被单个写操作锁住，还是事务锁住
+        std::atomic<bool> accessed_ = false;    // 上次换出检查之后是否被读过
     };
 
 
@@ -165,6 +252,10 @@ namespace mvcc {
 
         friend class op::WriteOperation;
 
+        friend class op::Transaction;
+
+        friend class op::BulkWriteOperation;
+
         /// Decorate interface of ValueNode::updateValue.
         /// \param node ValueNode to run
         /// \param value Value to write
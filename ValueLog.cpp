@@ -0,0 +1,112 @@
+//
+// Created by 唐仁初 on 2022/12/22.
+//
+
+#include "ValueLog.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace mvcc {
+
+    ValueLog::ValueLog(const std::string &path, size_t cache_size, size_t block_size)
+            : path_(path), cache_(cache_size, block_size) {
+
+        fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd_ < 0)
+            throw std::runtime_error("Open value log failed : " + path);
+    }
+
+    ValueLog::~ValueLog() {
+        ::close(fd_);
+        ::unlink(path_.c_str());
+    }
+
+    bool ValueLog::append(const std::string &value, std::string &location) {
+        std::lock_guard<std::mutex> lg(mtx_);
+
+        uint64_t offset = size_.load();
+        size_t done = 0;
+        while (done < value.size()) {
+            auto n = ::pwrite(fd_, value.data() + done, value.size() - done, static_cast<off_t>(offset + done));
+            if (n < 0) {
+                if (errno == EINTR)
+                    continue;
+                return false;
+            }
+            done += static_cast<size_t>(n);
+        }
+
+        // 写入完成之后才更新长度，读操作不会读到写了一半的值
+        size_.store(offset + value.size());
+
+        auto size = static_cast<uint32_t>(value.size());
+        location.resize(kLocationSize);
+        std::memcpy(&location[0], &offset, sizeof(offset));
+        std::memcpy(&location[8], &size, sizeof(size));
+        return true;
+    }
+
+    std::string ValueLog::read(const std::string &location) const {
+        if (location.size() != kLocationSize)
+            throw std::runtime_error("Invalid value log location");
+
+        uint64_t offset;
+        uint32_t size;
+        std::memcpy(&offset, location.data(), sizeof(offset));
+        std::memcpy(&size, location.data() + 8, sizeof(size));
+
+        std::string value;
+        value.reserve(size);
+
+        // 值可能跨越多个块，逐块从缓存中拷贝
+        auto block_size = cache_.blockSize();
+        auto end = offset + size;
+        while (offset < end) {
+            auto block = offset / block_size;
+            auto data = cache_.get(block, [this](uint64_t block, std::string &data) {
+                return load(block, data);
+            });
+
+            auto begin = offset - block * block_size;
+            if (data == nullptr || data->size() <= begin)
+                throw std::runtime_error("Read value log failed : " + path_);
+
+            auto n = std::min<uint64_t>(end - offset, data->size() - begin);
+            value.append(*data, begin, n);
+            offset += n;
+        }
+        return value;
+    }
+
+    size_t ValueLog::size() const {
+        return size_.load();
+    }
+
+    const BlockCache &ValueLog::cache() const {
+        return cache_;
+    }
+
+    bool ValueLog::load(uint64_t block, std::string &data) const {
+        auto block_size = cache_.blockSize();
+        auto begin = block * block_size;
+        auto size = size_.load();
+        if (begin >= size)
+            return false;
+
+        data.resize(std::min<uint64_t>(block_size, size - begin));
+        size_t done = 0;
+        while (done < data.size()) {
+            auto n = ::pread(fd_, &data[done], data.size() - done, static_cast<off_t>(begin + done));
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            done += static_cast<size_t>(n);
+        }
+        return true;
+    }
+}
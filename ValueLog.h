@@ -0,0 +1,76 @@
+//
+// Created by 唐仁初 on 2022/12/22.
+//
+
+#ifndef ALGYOLO_VALUELOG_H
+#define ALGYOLO_VALUELOG_H
+
+#include "BlockCache.h"
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+namespace mvcc {
+
+    /// @brief Append-only on-disk segment holding values spilled out of memory.
+    /// @details Class ValueLog stores cold values of a table. A spilled value is replaced in memory by its location,
+    /// which is small enough to be kept in the inline buffer of std::string, and reads fetch it back through a
+    /// BlockCache. The log is a cache of values still owned by memory records, it is not used for recovery, so it is
+    /// truncated when opened and removed when closed.
+    /// @note Space of values overwritten or erased later is not reclaimed until the log is reopened.
+    class ValueLog {
+    public:
+
+        /// Size of an encoded location
+        static constexpr size_t kLocationSize = 12;
+
+        /// Create or truncate the log file.
+        /// \param path Path of log file
+        /// \param cache_size Max bytes of block cache
+        /// \param block_size Size of cached blocks
+        /// @throw std::runtime_error if the file can not be opened
+        explicit ValueLog(const std::string &path, size_t cache_size = 8 << 20, size_t block_size = 4096);
+
+        /// Close and remove the log file.
+        ~ValueLog();
+
+        ValueLog(const ValueLog &other) = delete;
+
+        ValueLog &operator=(const ValueLog &other) = delete;
+
+        /// Append a value. Thread safe.
+        /// \param value Value to append
+        /// \param location Encoded location of the value
+        /// \return Is write succeeded
+        bool append(const std::string &value, std::string &location);
+
+        /// Read a value by its location. Thread safe.
+        /// \param location Location returned by append
+        /// \return Value
+        /// @throw std::runtime_error if the value can not be read
+        [[nodiscard]] std::string read(const std::string &location) const;
+
+        /// Bytes appended to log.
+        /// \return Size of log
+        [[nodiscard]] size_t size() const;
+
+        /// Block cache of this log.
+        /// \return Cache
+        [[nodiscard]] const BlockCache &cache() const;
+
+    private:
+
+        // Load a block from file, the last block may be partial.
+        bool load(uint64_t block, std::string &data) const;
+
+    private:
+        std::string path_;
+        int fd_ = -1;
+        std::mutex mtx_;                    // 追加操作互斥
+        std::atomic<uint64_t> size_ = 0;    // 已经完整写入的长度
+        mutable BlockCache cache_;
+    };
+}
+
+#endif //ALGYOLO_VALUELOG_H
@@ -3,14 +3,49 @@
 //
 
 #include "ValueTable.h"
+#include <algorithm>
 
 namespace mvcc {
 
-    ValueTable::ValueTable(int max_level, ValueTable::CleanThreshold threshold) : skipList_(max_level),
-                                                                                  buffer_(max_level),
-                                                                                  deleted_nums(0),
-                                                                                  threshold_(threshold),
-                                                                                  status_(0) {
+    namespace {
+        constexpr size_t kLoadBatch = 1024;     // 加载检查点时每个批量写入的记录数
+        constexpr std::chrono::microseconds kAsyncRetryMin(50);     // 异步事务第一次重试的间隔
+        constexpr std::chrono::microseconds kAsyncRetryMax(1000);   // 异步事务重试间隔的上限
+
+        // 异步事务在提交与日志落盘都完成之后才通知调用者，两者完成的先后顺序不确定
+        struct AsyncAck {
+            std::atomic<int> pending_{2};
+            std::atomic<bool> durable_{false};
+            ValueTable::CommitCallback callback_;
+
+            void arrive() {
+                if (pending_.fetch_sub(1) == 1)
+                    callback_(durable_.load());
+            }
+        };
+    }
+
+    ValueTable::ValueTable(int max_level, ValueTable::CleanThreshold threshold)
+            : ValueTable([max_level, threshold] {
+        Options options;
+        options.max_level = max_level;
+        options.threshold = threshold;
+        return options;
+    }()) {}
+
+    ValueTable::ValueTable(const Options &options) : options_(options),
+                                                     load_pool_(loadThreads() - 1),
+                                                     memory_budget_(options.memory_budget),
+                                                     stall_ratio_(options.stall_ratio),
+                                                     stall_timeout_ms_(options.stall_timeout_ms),
+                                                     vacuum_interval_(std::chrono::milliseconds(options.vacuum_interval_ms)),
+                                                     threshold_(options.threshold),
+                                                     deleted_nums(0),
+                                                     compact_step_(options.compact_step) {
+
+        chain_.store(new Chain{{newMemTable()}});
+
+        auto threshold = options.threshold;
         if (threshold == high) {
             percent = 0.5;
         } else if (threshold == medium) {
@@ -20,58 +55,516 @@ namespace mvcc {
         } else {
             percent = 1;
         }
+
+        if (options.maintenance_rate > 0)
+            Maintenance.setRateLimit(this, options.maintenance_rate);
+
+        if (!options.value_log_path.empty())
+            value_log_ = std::make_unique<ValueLog>(options.value_log_path, options.value_cache_size);
+
+        // 恢复过程中的写入不属于变更，之后再创建变更流
+        size_t skip = 0;
+        if (!options.checkpoint_path.empty())
+            skip = loadCheckpoint(options.checkpoint_path);
+
+        if (!options.wal_path.empty()) {
+            // 先回放已有的日志，此时还没有打开日志，回放的写操作不会被再次记录
+            recover(options.wal_path, skip);
+            log_ = std::make_unique<WriteAheadLog>(options.wal_path, options.wal_durability,
+                                                   options.wal_sync_interval_ms);
+        }
+
+        if (options.change_stream)
+            changes_ = std::make_shared<ChangeStream>(options.change_history);
+    }
+
+    ValueTable::~ValueTable() {
+        // 停止重试线程，还在等待的异步事务失败
+        {
+            std::lock_guard<std::mutex> lg(async_mtx_);
+            async_stop_ = true;
+        }
+        async_cv_.notify_all();
+        if (async_thread_.joinable())
+            async_thread_.join();
+
+        // 版本释放之后不再提交任务。丢弃未执行的维护任务，并等待正在执行的任务结束，然后等待还未调用的释放回调
+        {
+            std::lock_guard<std::mutex> lg(compact_mtx_);
+            closing_ = true;
+        }
+        Maintenance.cancel(this);
+        {
+            std::unique_lock<std::mutex> lk(compact_mtx_);
+            compact_cv_.wait(lk, [this] { return release_waits_ == 0; });
+        }
+
+        std::shared_ptr<std::promise<bool>> checkpoint;
+        {
+            std::lock_guard<std::mutex> lg(checkpoint_mtx_);
+            checkpoint = checkpoint_;
+        }
+        if (checkpoint != nullptr) {
+            Maintenance.cancel(checkpoint.get());
+
+            // 检查点任务还没有开始就被丢弃了
+            std::lock_guard<std::mutex> lg(checkpoint_mtx_);
+            if (checkpoint_ != nullptr)
+                checkpoint_->set_value(false);
+        }
+
+        auto chain = chain_.load();
+        for (auto table: chain->tables_) {
+            delete table;
+        }
+        delete chain;
+
+        for (auto retired: retired_chains_) {
+            delete retired;
+        }
+
+        // 压缩在等待读操作结束时被中止
+        for (auto releasing: releasing_chains_) {
+            delete releasing;
+        }
+        for (auto table: merged_) {
+            delete table;
+        }
+
+        releaseSpilled(true);
     }
 
     ValueTable::Iterator ValueTable::begin() {
-        return Iterator(skipList_.begin());
+        // 先登记读版本再访问内存表，防止节点在访问过程中被压缩释放
+        auto stream = Coordinator.startStreamReadOperation(nullptr);
+
+        std::vector<SkipList<Value>::Iterator> its;
+        for (auto table: chain_.load()->tables_) {
+            its.emplace_back(table->list().begin());
+        }
+        return Iterator(std::move(its), std::move(stream));
     }
 
     ValueTable::Iterator ValueTable::end() {
-        return Iterator(skipList_.end());
+        // 结束位置不会被读取，不需要登记读版本
+        return Iterator({}, op::StreamReadOperation(nullptr, Version(0, true)));
+    }
+
+    ValueTable::ReverseIterator ValueTable::rbegin() {
+        auto stream = Coordinator.startStreamReadOperation(nullptr);
+
+        std::vector<SkipList<Value>::ReverseIterator> its;
+        for (auto table: chain_.load()->tables_) {
+            its.emplace_back(table->list().rbegin());
+        }
+        return ReverseIterator(std::move(its), std::move(stream));
+    }
+
+    ValueTable::ReverseIterator ValueTable::rend() {
+        return ReverseIterator({}, op::StreamReadOperation(nullptr, Version(0, true)));
+    }
+
+    ValueTable::ReverseIterator ValueTable::seekForPrev(const std::string &key) {
+        auto stream = Coordinator.startStreamReadOperation(nullptr);
+
+        std::vector<SkipList<Value>::ReverseIterator> its;
+        for (auto table: chain_.load()->tables_) {
+            its.emplace_back(table->list().seekForPrev(key));
+        }
+        return ReverseIterator(std::move(its), std::move(stream));
     }
 
     bool ValueTable::transaction(const std::vector<std::pair<std::string, std::string>> &kvs) {
+        throttleWrite();
+
+        if (options_.group_commit)
+            return groupCommit(kvs);
+        return commitWrites(kvs);
+    }
+
+    bool ValueTable::commitWrites(const std::vector<std::pair<std::string, std::string>> &kvs) {
         auto transaction = Coordinator.startTransaction();
 
-        // 如果正在压缩则写缓冲区
-        if (status_ == 1) {
-            for (auto &kv: kvs) {
-                Value *value_node = &buffer_[kv.first];
-                transaction.appendOperation(value_node, kv.second);
+        // 写操作总是写入活跃的内存表
+        for (auto &kv: kvs) {
+            Value *value_node = locateForWrite(kv.first);
+            transaction.appendOperation(value_node, kv.second);
+        }
+
+        size_t applied = 0;
+        bool committed = transaction.tryCommit(commitHook(transaction.version(), kvs, applied));
+        if (committed)
+            publishChanges(transaction.version(), kvs, kvs.size());
+
+        tryCompact();
+
+        return committed;
+    }
+
+    bool ValueTable::groupCommit(const std::vector<std::pair<std::string, std::string>> &kvs) {
+        CommitRequest request{&kvs};
+
+        std::unique_lock<std::mutex> lk(group_mtx_);
+        group_queue_.push_back(&request);
+
+        // 已有事务正在提交时排队，直到被其他事务一起提交，或者轮到自己提交队列中的所有事务
+        group_cv_.wait(lk, [this, &request] {
+            return request.done_ || !group_leader_;
+        });
+        if (request.done_)
+            return request.committed_;
+
+        group_leader_ = true;
+        std::vector<CommitRequest *> group;
+        std::swap(group, group_queue_);
+        lk.unlock();
+
+        commitGroup(group);
+
+        lk.lock();
+        for (auto member: group) {
+            member->done_ = true;
+        }
+        group_leader_ = false;
+        lk.unlock();
+        group_cv_.notify_all();
+
+        return request.committed_;
+    }
+
+    void ValueTable::commitGroup(const std::vector<CommitRequest *> &group) {
+        // 合并所有事务的写入，同一个键以队列中靠后的事务为准，相当于按排队顺序依次提交
+        std::vector<std::pair<std::string, std::string>> kvs;
+        std::unordered_map<std::string, size_t> positions;
+        for (auto member: group) {
+            for (auto &kv: *member->kvs_) {
+                auto position = positions.emplace(kv.first, kvs.size());
+                if (position.second)
+                    kvs.emplace_back(kv);
+                else
+                    kvs[position.first->second].second = kv.second;
+            }
+        }
+
+        group_num_.fetch_add(1);
+        if (commitWrites(kvs)) {
+            for (auto member: group) {
+                member->committed_ = true;
+            }
+            return;
+        }
+
+        if (group.size() == 1)
+            return;
+
+        for (auto member: group) {
+            group_num_.fetch_add(1);
+            member->committed_ = commitWrites(*member->kvs_);
+        }
+    }
+
+    void ValueTable::transactionAsync(std::vector<std::pair<std::string, std::string>> kvs, CommitCallback callback,
+                                      int wait_ms) {
+        auto now = std::chrono::steady_clock::now();
+        auto commit = std::unique_ptr<AsyncCommit>(new AsyncCommit{std::move(kvs), std::move(callback),
+                                                                   std::chrono::milliseconds(wait_ms),
+                                                                   now + std::chrono::milliseconds(stall_timeout_ms_)});
+        if (!attemptAsync(*commit))
+            scheduleRetry(std::move(commit));
+    }
+
+    std::future<bool> ValueTable::transactionAsync(std::vector<std::pair<std::string, std::string>> kvs,
+                                                   int wait_ms) {
+        auto promise = std::make_shared<std::promise<bool>>();
+        auto future = promise->get_future();
+        transactionAsync(std::move(kvs), [promise](bool committed) {
+            promise->set_value(committed);
+        }, wait_ms);
+        return future;
+    }
+
+    bool ValueTable::attemptAsync(AsyncCommit &commit) {
+        auto now = std::chrono::steady_clock::now();
+
+        // 写入停顿时不阻塞，稍后再试，超过停顿时间上限之后照常写入
+        if (now < commit.stall_deadline_ && writeStalled())
+            return false;
+
+        // 每次尝试都分配新的版本，再在当前的活跃内存表中定位节点。沿用第一次分配的版本会把更旧的版本压在等待期间提交
+        // 的更新版本之上，快照读会先后看到两个值，并且等待期间一直阻挡最低存活版本
+        auto transaction = Coordinator.startTransaction();
+        for (auto &kv: commit.kvs_) {
+            transaction.appendOperation(locateForWrite(kv.first), kv.second);
+        }
+
+        // 钩子在获得全部锁之后才会调用，没有调用说明有值被其他事务锁定
+        bool locked = false;
+        std::shared_ptr<AsyncAck> ack;
+        auto version = transaction.version();
+        bool committed = transaction.tryCommit([this, &commit, &locked, &ack, version](size_t num) {
+            locked = true;
+            if (!log_)
+                return true;
+
+            std::vector<WriteAheadLog::Record> records;
+            records.reserve(num);
+            for (size_t i = 0; i < num; i++) {
+                auto &kv = commit.kvs_[i];
+                records.push_back({kv.second.empty() ? WriteAheadLog::erase : WriteAheadLog::put, kv.first, kv.second});
+            }
+            if (log_->durability() != WriteAheadLog::sync)
+                return log_->append(version, records);
+
+            // 不等待批次落盘就提交并释放锁，落盘之后再通知调用者
+            ack = std::make_shared<AsyncAck>();
+            ack->callback_ = commit.callback_;
+            if (log_->append(version, records, [ack](bool durable) {
+                ack->durable_.store(durable);
+                ack->arrive();
+            }))
+                return true;
+            ack = nullptr;
+            return false;
+        }, 0);
+
+        if (!locked) {
+            if (commit.deadline_ == std::chrono::steady_clock::time_point{})
+                commit.deadline_ = now + commit.wait_;
+            if (now < commit.deadline_)
+                return false;
+        }
+
+        if (committed) {
+            publishChanges(version, commit.kvs_, commit.kvs_.size());
+            tryCompact();
+        }
+        if (ack != nullptr)
+            ack->arrive();
+        else
+            commit.callback_(committed);
+        return true;
+    }
+
+    void ValueTable::scheduleRetry(std::unique_ptr<AsyncCommit> commit) {
+        commit->backoff_ = std::min(std::max(commit->backoff_ * 2, kAsyncRetryMin), kAsyncRetryMax);
+        commit->retry_at_ = std::chrono::steady_clock::now() + commit->backoff_;
+        async_retry_num_.fetch_add(1);
+
+        {
+            std::lock_guard<std::mutex> lg(async_mtx_);
+            async_queue_.emplace_back(std::move(commit));
+            if (!async_thread_.joinable()) {
+                async_thread_ = std::thread([this] {
+                    retryAsync();
+                });
+            }
+        }
+        async_cv_.notify_one();
+    }
+
+    void ValueTable::retryAsync() {
+        std::unique_lock<std::mutex> lk(async_mtx_);
+
+        while (!async_stop_) {
+            if (async_queue_.empty()) {
+                async_cv_.wait(lk);
+                continue;
+            }
+
+            // 先重试到期最早的事务，都没有到期时等待
+            auto next = std::min_element(async_queue_.begin(), async_queue_.end(), [](auto &a, auto &b) {
+                return a->retry_at_ < b->retry_at_;
+            });
+            if (std::chrono::steady_clock::now() < (*next)->retry_at_) {
+                async_cv_.wait_until(lk, (*next)->retry_at_);
+                continue;
             }
-            return transaction.tryCommit();
+
+            auto commit = std::move(*next);
+            async_queue_.erase(next);
+            lk.unlock();
+
+            if (!attemptAsync(*commit))
+                scheduleRetry(std::move(commit));
+
+            lk.lock();
         }
 
+        auto pending = std::move(async_queue_);
+        lk.unlock();
+        for (auto &commit: pending) {
+            commit->callback_(false);
+        }
+    }
+
+    bool ValueTable::transaction(const TransactionBody &body, Isolation isolation) {
+        auto transaction = startTransaction(isolation);
+
+        auto read = [&transaction](const std::string &key) {
+            return transaction.get(key);
+        };
+
+        std::vector<std::pair<std::string, std::string>> kvs;
+        if (!body(read, kvs))
+            return false;
+
         for (auto &kv: kvs) {
-            Value *value_node = &skipList_[kv.first];
-            transaction.appendOperation(value_node, kv.second);
+            transaction.put(kv.first, kv.second);
         }
+        return transaction.commit();
+    }
 
-        tryCompact();
+    ValueTable::ReadWriteTransaction ValueTable::startTransaction(Isolation isolation) {
+        throttleWrite();
+        return {this, Coordinator.startTransaction(), isolation};
+    }
+
+    std::string ValueTable::readForTransaction(const std::string &key, long version, std::vector<ReadRecord> *reads) {
+        Value *value_node = findValue(key, version);
+
+        const ValueNode *visible = nullptr;
+        auto value = value_node == nullptr ? std::string() : value_node->read(version, visible);
 
-        return transaction.tryCommit();
+        if (reads != nullptr)
+            reads->push_back({key, value_node, visible});
+        return value;
     }
 
-    bool ValueTable::bulkWrite(const std::vector<std::pair<std::string, std::string>> &kvs) {
+    bool ValueTable::validateRead(const ReadRecord &read, long version) {
+        // 从新到旧查找，比读到的值更新的内存表中不能有其他事务写入的版本
+        for (auto table: chain_.load()->tables_) {
+            auto value_node = table->find(read.key_);
+            if (value_node == nullptr)
+                continue;
 
-        auto bulk = Coordinator.startBulkWriteOperation();
+            if (value_node == read.value_)
+                return value_node->validate(read.visible_, version);
+
+            if (!value_node->validate(nullptr, version))
+                return false;
+        }
+
+        // 读到的值已经被删除或者被合并到其他内存表中
+        return read.value_ == nullptr;
+    }
+
+    void ValueTable::scanForTransaction(const std::string &lower, const std::string &upper, long version,
+                                        std::vector<ReadRecord> *reads,
+                                        const std::function<bool(const std::string &, const std::string &)> &visit) {
+        std::vector<SkipList<Value>::Iterator> its;
+        for (auto table: chain_.load()->tables_) {
+            its.emplace_back(table->list().findBetween(lower).first);
+        }
+
+        // 迭代器使用事务的版本读取，版本已由事务登记
+        auto last = end();
+        for (Iterator it(std::move(its), op::StreamReadOperation(nullptr, Version(version, true))); it != last; ++it) {
+            auto key = it.key();
+            if (!upper.empty() && key >= upper)
+                break;
 
-        // 如果正在压缩则写缓冲区
-        if (status_ == 1) {
-            for (auto &kv: kvs) {
-                Value *value_node = &buffer_[kv.first];
-                bulk.appendOperation(value_node, kv.second);
+            auto value = reads == nullptr ? *it : readForTransaction(key, version, reads);
+            if (!visit(key, value))
+                break;
+        }
+    }
+
+    bool ValueTable::validateRange(const std::string &lower, const std::string &upper,
+                                   const std::vector<std::string> &keys, long version) {
+        // 扫描时没有遇到的键必须从未被其他事务写入过，否则就是幻读
+        for (auto table: chain_.load()->tables_) {
+            auto it = table->list().findBetween(lower).first;
+            for (; it != SkipList<Value>::Iterator::end(); ++it) {
+                if (!it)
+                    continue;
+
+                auto key = it.key();
+                if (!upper.empty() && key >= upper)
+                    break;
+
+                if (!std::binary_search(keys.begin(), keys.end(), key) && !(*it).validate(nullptr, version))
+                    return false;
             }
-            return bulk.run();
         }
+        return true;
+    }
+
+    bool ValueTable::bulkWrite(const std::vector<std::pair<std::string, std::string>> &kvs) {
+        throttleWrite();
+
+        auto bulk = Coordinator.startBulkWriteOperation();
+
+        // 写操作总是写入活跃的内存表
         for (auto &kv: kvs) {
-            Value *value_node = &skipList_[kv.first];
+            Value *value_node = locateForWrite(kv.first);
             bulk.appendOperation(value_node, kv.second);
         }
 
+        // 写入失败时已写入的部分仍然会被提交
+        size_t applied = 0;
+        bool finished = bulk.run(commitHook(bulk.version(), kvs, applied));
+        publishChanges(bulk.version(), kvs, applied);
+
         tryCompact();
 
-        return bulk.run();
+        return finished;
+    }
+
+    std::vector<ValueTable::BulkPartition>
+    ValueTable::parallelBulkWrite(const std::vector<std::pair<std::string, std::string>> &kvs, size_t partitions) {
+        throttleWrite();
+
+        size_t num = partitions > 0 ? partitions : loadThreads();
+
+        // 按键的哈希值划分记录，同一个键的记录总是由同一个线程按写入顺序处理
+        std::vector<std::vector<size_t>> indexes(num);
+        for (size_t i = 0; i < kvs.size(); i++) {
+            indexes[std::hash<std::string>()(kvs[i].first) % num].push_back(i);
+        }
+
+        auto bulk = Coordinator.startBulkWriteOperation();
+        std::vector<op::BulkWriteOperation> parts;
+        parts.reserve(num);
+        for (size_t part = 0; part < num; part++) {
+            parts.emplace_back(bulk.share());
+        }
+
+        // 每个线程自己定位跳跃表节点并写入，写入的版本在全部分区结束之前对读操作不可见
+        std::vector<BulkPartition> results(num);
+        auto apply = [this, &kvs, &indexes, &parts, &results](size_t part) {
+            for (auto i: indexes[part]) {
+                parts[part].appendOperation(locateForWrite(kvs[i].first), kvs[i].second);
+            }
+            results[part] = {indexes[part].size(), parts[part].apply()};
+        };
+
+        load_pool_.run(num, apply);
+
+        // 所有分区写入的记录作为一个批次记录日志
+        std::vector<std::pair<std::string, std::string>> done;
+        for (size_t part = 0; part < num; part++) {
+            for (size_t j = 0; j < results[part].applied_; j++) {
+                done.emplace_back(kvs[indexes[part][j]]);
+            }
+        }
+
+        size_t applied = 0;
+        auto log = commitHook(bulk.version(), done, applied);
+        if (!done.empty() && log && !log(done.size())) {
+            for (size_t part = 0; part < num; part++) {
+                parts[part].undoApplied();
+                results[part].applied_ = 0;
+            }
+        } else {
+            for (auto &part: parts) {
+                part.commitApplied();
+            }
+            publishChanges(bulk.version(), done, applied);
+        }
+
+        tryCompact();
+
+        return results;
     }
 
     bool ValueTable::emplace(const std::string &key, const std::string &value) {
@@ -82,202 +575,950 @@ namespace mvcc {
         if (key.empty())
             return false;
 
-        // 如果正在开启清理，则写入缓冲区中
-        if (status_.load() == 1) {
-            Value *value_node = &buffer_[key];
+        throttleWrite();
 
-            auto write = Coordinator.startWriteOperation(value_node, value);
+        // 先分配版本再定位节点，压缩过程等待该版本结束后，就可以确定不可变表上没有写操作
+        auto write = Coordinator.startWriteOperation(nullptr, value);
 
-            bool write_res = write.write();
+        write.bind(locateForWrite(key));
+
+        // 日志在写入之后、提交之前记录，日志落盘之前新版本对读操作不可见
+        bool write_res = write.write(log_ ? op::CommitHook([this, &write, &key, &value](size_t) {
+            return log_->append(write.version(), {{WriteAheadLog::put, key, value}});
+        }) : nullptr);
+
+        // 变更在版本释放之前发布，变更流据此确定版本顺序
+        if (write_res && changes_)
+            changes_->publish(write.version(), ChangeStream::put, key, value);
+
+        tryCompact();   // 写操作时会进行清理检查，压缩过程在后台进行，不会阻塞写操作
+
+        return write_res;
+    }
 
-            if (write_res) {
-                mem_use_.fetch_add(key.size() + value.size());
+    std::string ValueTable::read(const std::string &key) {
+        // 点查只在当前线程的读槽位中公布快照，不修改共享的引用计数
+        auto read = Coordinator.startReadOnlyTransaction();
+
+        Value *value_node = findValue(key, read.version());
+        if (value_node == nullptr)
+            return {};
+
+        return read.read(value_node);
+    }
+
+    Value *ValueTable::findValue(const std::string &key, long version) {
+        Value *value_node = nullptr;
+        long visible = -1;
+
+        // 从新到旧查找所有内存表，同一个键可能存在于多个表中，使用快照可见的最新版本
+        for (auto table: chain_.load()->tables_) {
+
+            // 已封存的表中所有版本都小于封存版本，找到的版本不小于它时，更旧的表中不会有更新的版本
+            if (value_node != nullptr && visible >= table->sealVersion())
+                break;
+
+            auto found = table->find(key);
+            if (found == nullptr)
+                continue;
+
+            auto found_visible = found->visibleVersion(version);
+            if (value_node == nullptr || found_visible > visible) {
+                value_node = found;
+                visible = found_visible;
             }
-            return write_res;
         }
+        return value_node;
+    }
 
+    std::vector<std::string> ValueTable::multiGet(const std::vector<std::string> &keys) {
+        auto read = Coordinator.startReadOnlyTransaction();
 
-        Value *value_node = &skipList_[key];
+        std::vector<const std::string *> ptrs;
+        ptrs.reserve(keys.size());
+        for (auto &key: keys) {
+            ptrs.emplace_back(&key);
+        }
 
-        auto write = Coordinator.startWriteOperation(value_node, value);
+        std::vector<Value *> values(keys.size());
+        findValues(ptrs.data(), ptrs.size(), read.version(), values.data());
 
-        bool write_res = write.write();
+        std::vector<std::string> res(keys.size());
+        for (size_t i = 0; i < keys.size(); i++) {
+            if (values[i] != nullptr)
+                res[i] = read.read(values[i]);
+        }
+        return res;
+    }
+
+    void ValueTable::findValues(const std::string *const *keys, size_t n, long version, Value **values) {
+        std::vector<long> visible(n, -1);
+        std::vector<const std::string *> probe;
+        std::vector<size_t> index;
+        std::vector<Value *> found;
 
-        if (write_res) {
-            mem_use_.fetch_add(key.size() + value.size());
+        for (size_t i = 0; i < n; i++) {
+            values[i] = nullptr;
         }
 
-        tryCompact();   // 写操作时会进行清理检查
+        // 与 findValue 相同，从新到旧查找所有内存表，已经确定结果的键不再查找更旧的表
+        for (auto table: chain_.load()->tables_) {
+            probe.clear();
+            index.clear();
+            for (size_t i = 0; i < n; i++) {
+                if (values[i] != nullptr && visible[i] >= table->sealVersion())
+                    continue;
+                probe.emplace_back(keys[i]);
+                index.emplace_back(i);
+            }
+            if (probe.empty())
+                break;
+
+            found.assign(probe.size(), nullptr);
+            table->findMany(probe.data(), probe.size(), found.data());
 
-        return write_res;
+            // 比较版本之前先预取所有找到的版本链
+            for (auto value: found) {
+                if (value != nullptr)
+                    value->prefetch();
+            }
+
+            for (size_t j = 0; j < probe.size(); j++) {
+                if (found[j] == nullptr)
+                    continue;
+
+                auto i = index[j];
+                auto found_visible = found[j]->visibleVersion(version);
+                if (values[i] == nullptr || found_visible > visible[i]) {
+                    values[i] = found[j];
+                    visible[i] = found_visible;
+                }
+            }
+        }
     }
 
-    std::string ValueTable::read(const std::string &key) {
-        auto it = skipList_.find(key);
-        if (it == skipList_.end()) {
-            // 缓冲区无内容，直接返回
-            if (status_.load() == 0)
-                return {};
+    Value *ValueTable::locateForWrite(const std::string &key) {
+        return chain_.load()->tables_.front()->locate(key);
+    }
+
+    void ValueTable::recover(const std::string &path, size_t skip) {
+        size_t threads = loadThreads();
+
+        // 按键的哈希值划分记录，同一个键的记录总是由同一个线程按日志顺序处理
+        std::vector<std::vector<WriteAheadLog::Record>> parts(threads);
+        long max_version = 0;
+        WriteAheadLog::replay(path, [&parts, &max_version, threads](WriteAheadLog::Batch &batch) {
+            max_version = std::max(max_version, batch.version_);
+            for (auto &record: batch.records_) {
+                parts[std::hash<std::string>()(record.key_) % threads].emplace_back(std::move(record));
+            }
+        }, skip);
+
+        auto apply = [this, &parts](size_t part) {
+            auto &records = parts[part];
 
-            // 如果缓冲区有内容，还需要查找缓冲区
-            it = buffer_.find(key);
-            if (it == buffer_.end()) {
-                return {};
+            // 只有每个键的最后一条记录决定恢复之后的状态
+            std::vector<bool> latest(records.size(), false);
+            {
+                std::unordered_map<std::string_view, size_t> last;
+                for (size_t i = 0; i < records.size(); i++) {
+                    last[records[i].key_] = i;
+                }
+                for (auto &kv: last) {
+                    latest[kv.second] = true;
+                }
             }
+
+            std::vector<std::pair<std::string, std::string>> kvs;
+            for (size_t i = 0; i < records.size(); i++) {
+                auto &record = records[i];
+                if (!latest[i])
+                    continue;
+
+                // 被删除的键可能存在于检查点中，需要删除
+                if (record.type_ == WriteAheadLog::erase) {
+                    erase(record.key_);
+                    continue;
+                }
+
+                kvs.emplace_back(std::move(record.key_), std::move(record.value_));
+                if (kvs.size() == kLoadBatch) {
+                    bulkLoad(kvs);
+                    kvs.clear();
+                }
+            }
+            bulkLoad(kvs);
+        };
+
+        load_pool_.run(threads, apply);
+
+        Coordinator.restoreVersion(max_version);
+    }
+
+    void ValueTable::bulkLoad(const std::vector<std::pair<std::string, std::string>> &kvs) {
+        if (kvs.empty())
+            return;
+
+        auto bulk = Coordinator.startBulkWriteOperation();
+        for (auto &kv: kvs) {
+            bulk.appendOperation(locateForWrite(kv.first), kv.second);
+        }
+        bulk.run();
+    }
+
+    size_t ValueTable::loadThreads() const {
+        if (options_.load_threads > 0)
+            return options_.load_threads;
+        return std::max<size_t>(1, std::thread::hardware_concurrency());
+    }
+
+    size_t ValueTable::loadCheckpoint(const std::string &path) {
+        CheckpointReader reader(path);
+
+        // 检查点不完整时从头回放日志
+        if (!reader.valid())
+            return 0;
+
+        size_t threads = std::min(loadThreads(), reader.size() / kLoadBatch + 1);
+
+        // 检查点中的键互不相同，按范围切分之后由多个线程并发插入跳跃表，每一批记录共用一个版本
+        std::atomic<bool> loaded = true;
+        auto load = [this, &reader, &loaded, threads](size_t part) {
+            size_t i = reader.size() * part / threads, end = reader.size() * (part + 1) / threads;
+            std::string_view key, value;
+
+            while (i < end && loaded.load()) {
+                auto bulk = Coordinator.startBulkWriteOperation();
+                for (size_t n = 0; n < kLoadBatch && i < end; n++, i++) {
+                    if (!reader.entry(i, key, value)) {
+                        loaded.store(false);
+                        break;
+                    }
+                    bulk.appendOperation(locateForWrite(std::string(key)), std::string(value));
+                }
+                bulk.run();
+            }
+        };
+
+        load_pool_.run(threads, load);
+
+        if (!loaded.load())
+            return 0;
+
+        Coordinator.restoreVersion(reader.header().version_);
+        return reader.header().log_batches_;
+    }
+
+    std::future<bool> ValueTable::checkpoint(const std::string &path) {
+        auto promise = std::make_shared<std::promise<bool>>();
+        auto future = promise->get_future();
+
+        std::lock_guard<std::mutex> lg(checkpoint_mtx_);
+
+        // 同时只能进行一个检查点
+        if (checkpoint_ != nullptr) {
+            promise->set_value(false);
+            return future;
+        }
+        checkpoint_ = promise;
+
+        CheckpointHeader header;
+
+        // 先记录日志位置再分配版本，位置之前的批次版本都更小，它们的结果都会在快照中
+        header.log_batches_ = log_ ? log_->batchNum() : 0;
+
+        auto stream = std::make_shared<op::StreamReadOperation>(Coordinator.startFenceReadOperation(nullptr));
+        header.version_ = stream->version();
+
+        // 之前开始的操作全部结束之后快照不会再发生变化，此时再提交任务，不占用工作线程等待。检查点任务持有快照的时间
+        // 很长，使用独立的所有者，不会阻塞本表的其他维护任务排队执行
+        submitAfterRelease(promise.get(), header.version_, MaintenanceExecutor::low, [this, path, promise, header, stream] {
+            bool written = false;
+            try {
+                written = writeCheckpoint(path, header, std::move(*stream));
+            } catch (...) {
+            }
+
+            {
+                std::lock_guard<std::mutex> lg(checkpoint_mtx_);
+                checkpoint_ = nullptr;
+            }
+            promise->set_value(written);
+        });
+        return future;
+    }
+
+    bool ValueTable::writeCheckpoint(const std::string &path, const CheckpointHeader &header,
+                                     op::StreamReadOperation stream) {
+        std::vector<SkipList<Value>::Iterator> its;
+        for (auto table: chain_.load()->tables_) {
+            its.emplace_back(table->list().begin());
         }
 
-        Value *value_node = &(*it);
+        CheckpointWriter writer(path, header);
+        auto last = end();
+        for (Iterator it(std::move(its), std::move(stream)); it != last; ++it) {
+            auto value = *it;
+            if (!value.empty() && !writer.add(it.key(), value))
+                return false;
+        }
+
+        // 被检查点覆盖的日志批次需要先落盘，否则崩溃之后新的批次会占据这些位置而被跳过
+        if (log_ && !log_->flush())
+            return false;
 
-        auto read = Coordinator.startReadOperation(value_node);
+        return writer.finish();
+    }
+
+    bool ValueTable::logBatch(long version, const std::vector<WriteAheadLog::Record> &records) {
+        return !log_ || log_->append(version, records);
+    }
+
+    op::CommitHook ValueTable::commitHook(long version, const std::vector<std::pair<std::string, std::string>> &kvs,
+                                          size_t &applied) {
+        if (!log_ && !changes_)
+            return nullptr;
+
+        return [this, version, &kvs, &applied](size_t num) {
+            if (log_) {
+                std::vector<WriteAheadLog::Record> records;
+                records.reserve(num);
+                for (size_t i = 0; i < num; i++) {
+                    // 空值表示删除，与 erase 写入相同的记录，重放时才会删除检查点中的键
+                    records.push_back({kvs[i].second.empty() ? WriteAheadLog::erase : WriteAheadLog::put, kvs[i].first,
+                                       kvs[i].second});
+                }
+                if (!log_->append(version, records))
+                    return false;
+            }
+            applied = num;
+            return true;
+        };
+    }
+
+    void ValueTable::publishChanges(long version, const std::vector<std::pair<std::string, std::string>> &kvs,
+                                    size_t num) {
+        if (!changes_)
+            return;
+
+        for (size_t i = 0; i < num; i++) {
+            changes_->publish(version, kvs[i].second.empty() ? ChangeStream::erase : ChangeStream::put, kvs[i].first,
+                              kvs[i].second);
+        }
+    }
 
-        return read.read();
+    bool ValueTable::pollChanges(long &cursor, std::vector<ChangeStream::Change> &changes, size_t max, int wait_ms) {
+        if (!changes_)
+            throw std::runtime_error("Change stream is not enabled");
+        return changes_->poll(cursor, changes, max, wait_ms);
+    }
+
+    long ValueTable::lastChangeVersion() const {
+        if (!changes_)
+            throw std::runtime_error("Change stream is not enabled");
+        return changes_->lastVersion();
+    }
+
+    bool ValueTable::flushLog() {
+        return !log_ || log_->flush();
+    }
+
+    MemTable *ValueTable::newMemTable() {
+        return new MemTable(options_.max_level, options_.hash_index, options_.hash_capacity,
+                            options_.filter ? options_.filter_bits_per_key : 0, &node_mem_, &version_mem_);
+    }
+
+    void ValueTable::publish(Chain *chain) {
+        retired_chains_.emplace_back(chain_.exchange(chain));
+    }
+
+    void ValueTable::rotate() {
+        std::lock_guard<std::mutex> lg(chain_mtx_);
+
+        auto chain = chain_.load();
+
+        // 空的活跃表不需要轮转
+        auto active = chain->tables_.front();
+        if (active->list().begin() == active->list().end())
+            return;
+
+        auto rotated = new Chain{{newMemTable()}};
+        rotated->tables_.insert(rotated->tables_.end(), chain->tables_.begin(), chain->tables_.end());
+        publish(rotated);
+    }
+
+    size_t ValueTable::memtableNum() const {
+        auto guard = Coordinator.startReadOperation(nullptr);
+        return chain_.load()->tables_.size();
     }
 
     void ValueTable::tryCompact() {
 
+        if (options_.memtable_size > 0 && chain_.load()->tables_.front()->size() >= options_.memtable_size) {
+            // 活跃表已满，轮转之后由后台合并，正在压缩时新的不可变表会在下一轮处理
+            rotate();
+            scheduleCompaction();
+        }
+
+        if (memory_budget_ > 0) {
+            // 内存增长较多，或者距离上次清理已经过了一段时间（期间快照可能已经结束），才会再次清理
+            auto usage = trackedMemory();
+            if (usage > memory_budget_ && (usage > vacuum_mark_.load() + memory_budget_ / 16 ||
+                                           std::chrono::steady_clock::now() > vacuum_time_.load() + vacuum_interval_))
+                vacuum();
+        }
+
         if(threshold_ == never)
             return ;
 
-        auto hl = static_cast<double >(skipList_.size()) * percent;
+        size_t size = 0;
+        for (auto table: chain_.load()->tables_) {
+            size += table->size();
+        }
+
+        auto hl = static_cast<double >(size) * percent;
         if(hl < static_cast<double >(deleted_nums))
             compact();
     }
 
-    void ValueTable::clearBuffer() {
-        std::thread th([this] {
+    bool ValueTable::writeStalled() {
 
-            status_.store(2);   // 当前事务都重新写入到表中
+        if (memory_budget_ == 0)
+            return false;
 
-            // 获取最新事务号，等待所有写入事务执行完毕，确保buffer不会更新
-            auto newest = Coordinator.getNewestVersion();
-            while (newest > Coordinator.getLowestVersion()) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(100));
-            }
+        auto limit = static_cast<size_t>(static_cast<double>(memory_budget_) * stall_ratio_);
+        if (trackedMemory() <= limit)
+            return false;
 
-            // 等待当前事务提交完毕后，融合缓冲区
-            skipList_.merge(buffer_);
+        {
+            auto guard = Coordinator.startReadOperation(nullptr);
+            tryCompact();
+        }
 
-            // 所有数据已经放入主表，不需要再进行读取
-            status_.store(0);
+        // 没有正在进行的后台任务时，阻塞写操作也无法释放内存
+        return vacuuming_.load() || compacting_.load();
+    }
 
-            // 确保所有的读事务都已经结束，然后释放缓冲区
-            newest = Coordinator.getNewestVersion();
-            while (newest > Coordinator.getLowestVersion()) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(100));
-            }
+    void ValueTable::throttleWrite() {
+
+        if (!writeStalled())
+            return;
+
+        stalled_writes_.fetch_add(1);
 
-            buffer_.clear();
+        auto limit = static_cast<size_t>(static_cast<double>(memory_budget_) * stall_ratio_);
+
+        // 等待后台任务释放内存。当前线程可能持有快照，压缩会等待它结束，所以等待时间是有上限的
+        std::unique_lock<std::mutex> lk(compact_mtx_);
+        compact_cv_.wait_for(lk, std::chrono::milliseconds(stall_timeout_ms_), [this, limit] {
+            return trackedMemory() <= limit || (!vacuuming_.load() && !compacting_.load());
         });
-        th.detach();
     }
 
-    void ValueTable::compact() {
+    size_t ValueTable::trackedMemory() const {
+        return node_mem_.load() + version_mem_.load() + spill_retired_mem_.load();
+    }
 
-        if (status_.load() != 0)
-            return;
+    size_t ValueTable::groupCommitNum() const {
+        return group_num_.load();
+    }
+
+    size_t ValueTable::asyncRetryNum() const {
+        return async_retry_num_.load();
+    }
+
+    size_t ValueTable::conflictNum() const {
+        return conflicts_.load();
+    }
+
+    size_t ValueTable::spilledNum() const {
+        return spilled_.load();
+    }
+
+    void ValueTable::spillCold(size_t target) {
+        std::vector<ValueNode *> retired;
+        size_t freed = 0, retired_mem = 0;
+
+        auto visit = [this, &retired, &freed, &retired_mem](SkipList<Value>::Iterator &it) {
+            if (!it)
+                return;     // 已删除的键
+
+            auto &value = *it;
+            auto before = value.memoryUse();
+            auto node = value.spill(value_log_.get(), options_.spill_min_size);
+            if (node == nullptr)
+                return;
+
+            freed += before - value.memoryUse();
+            retired_mem += Value::nodeBytes(node);
+            retired.emplace_back(node);
+            spill_hand_ = it.key();
+        };
+
+        // 从上次停止的位置扫描到末尾，再从头扫描到上次停止的位置
+        for (auto table: chain_.load()->tables_) {
+            auto &list = table->list();
+            for (auto it = list.findBetween(spill_hand_).first; it != list.end() && freed < target; ++it) {
+                visit(it);
+            }
+        }
+        for (auto table: chain_.load()->tables_) {
+            auto &list = table->list();
+            for (auto it = list.begin(); it != list.end() && freed < target && it.key() < spill_hand_; ++it) {
+                visit(it);
+            }
+        }
 
-        // 确保缓冲区已经被清空了
-        if (buffer_.size() != 0) {
+        // 整圈都没有可以换出的值时，下一轮从头开始
+        if (retired.empty()) {
+            spill_hand_.clear();
             return;
         }
 
-        // 判断是否无活跃事务
-        if (Coordinator.aliveOperationNum() != 0) {
+        spilled_.fetch_add(retired.size());
+        spill_retired_mem_.fetch_add(retired_mem);
+        spill_retired_.emplace_back(Coordinator.fenceVersion(), std::move(retired));
+    }
+
+    void ValueTable::releaseSpilled(bool force) {
+        if (spill_retired_.empty())
             return;
+
+        // 早于栅栏开始的读操作都结束之后，不会再有读操作访问被替换的版本记录
+        long lowest = force ? LONG_MAX : Coordinator.getLowestVersion();
+
+        size_t released = 0;
+        auto it = spill_retired_.begin();
+        for (; it != spill_retired_.end() && it->first <= lowest; ++it) {
+            for (auto node: it->second) {
+                released += Value::nodeBytes(node);
+                delete node;
+            }
         }
+        spill_retired_.erase(spill_retired_.begin(), it);
+        spill_retired_mem_.fetch_sub(released);
+    }
 
-        // 锁住表
-        int ex = 0;
-        int dt = 1;
-        // 只能有一个线程锁住表
+    size_t ValueTable::stalledWriteNum() const {
+        return stalled_writes_.load();
+    }
+
+    void ValueTable::compact() {
 
-        if (!status_.compare_exchange_weak(ex, dt))
+        // 正在压缩时，新写入的数据留在活跃表中等待下一轮
+        if (compacting_.load())
             return;
 
-        // 判断是否无活跃事务，若无则开始压缩表
-        if (Coordinator.aliveOperationNum() != 0) {
+        rotate();
+        scheduleCompaction();
+    }
+
+    void ValueTable::scheduleCompaction() {
 
-            // 合并缓冲区内容
-            clearBuffer();
+        // 只能有一个线程开启压缩
+        bool expected = false;
+        if (!compacting_.compare_exchange_strong(expected, true))
             return;
-        }
 
+        Maintenance.submit(this, MaintenanceExecutor::normal, [this] {
+            compactTask(0);
+        });
+    }
 
-        // 先压缩表，然后开始合并缓冲区内容
-        std::thread th([this] {
+    void ValueTable::submitAfterRelease(const void *owner, long version, MaintenanceExecutor::Priority priority,
+                                        MaintenanceExecutor::Task task) {
+        {
+            std::lock_guard<std::mutex> lg(compact_mtx_);
+            release_waits_++;
+        }
 
-            try{
-                // 获取表中已删除的个数（不太准确）
-                size_t deleted = deleted_nums.load();
+        Coordinator.onVersionRelease(version, [this, owner, priority, task = std::move(task)]() mutable {
+            std::lock_guard<std::mutex> lg(compact_mtx_);
+            if (!closing_)
+                Maintenance.submit(owner, priority, std::move(task));
+            release_waits_--;
+            compact_cv_.notify_all();
+        });
+    }
+
+    void ValueTable::waitForCompaction() const {
+        std::unique_lock<std::mutex> lk(compact_mtx_);
+        compact_cv_.wait(lk, [this] { return !compacting_.load(); });
+    }
 
-                // 安全清理所有删除掉的节点
-                skipList_.compact();
+    void ValueTable::vacuum() {
 
-                status_.store(2);   // 当前事务都重新写入到表中
+        // 同时只保留一个清理任务
+        bool expected = false;
+        if (!vacuuming_.compare_exchange_strong(expected, true))
+            return;
 
-                // 获取最新事务号，等待所有写入事务执行完毕，确保buffer不会更新
-                auto newest = Coordinator.getNewestVersion();
-                while (newest > Coordinator.getLowestVersion()) {
-                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        Maintenance.submit(this, MaintenanceExecutor::low, [this] {
+            // 同一张表的维护任务不会并发执行，所以遍历过程中不会有内存表或者节点被释放
+            for (auto table: chain_.load()->tables_) {
+                for (auto it = table->list().begin(); it != table->list().end(); ++it) {
+                    (*it).vacuum();
                 }
+            }
 
-                // 等待当前事务提交完毕后，融合缓冲区
-                skipList_.merge(buffer_);
+            auto usage = trackedMemory();
 
-                // 更新已删除计数
-                deleted_nums.fetch_sub(deleted);
+            // 清理之后仍然超出预算，把冷值换出到值日志
+            if (value_log_ && memory_budget_ > 0 && usage > memory_budget_) {
+                spillCold(usage - memory_budget_);
+                releaseSpilled(false);
+                usage = trackedMemory();
+            }
+            vacuum_mark_.store(usage);
+            vacuum_time_.store(std::chrono::steady_clock::now());
+
+            {
+                std::lock_guard<std::mutex> lg(compact_mtx_);
+                vacuuming_.store(false);
+            }
+            compact_cv_.notify_all();
 
-                // 所有数据已经放入主表，不需要再进行读取
-                status_.store(0);
+            // 清理过期版本之后仍然超出预算，只能压缩已删除的节点
+            if (memory_budget_ > 0 && usage > memory_budget_ && deleted_nums.load() > 0)
+                compact();
+        });
+    }
 
-                // 确保所有的读事务都已经结束，然后释放缓冲区
-                newest = Coordinator.getNewestVersion();
-                while (newest > Coordinator.getLowestVersion()) {
-                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    void ValueTable::compactTask(int phase) {
+
+        bool again = false;
+
+        try {
+            // 只有维护任务会移除内存表，所以基础表在整个压缩过程中不会改变
+            auto base = chain_.load()->tables_.back();
+
+            if (phase == 0) {
+                std::vector<MemTable *> tables;
+                {
+                    std::lock_guard<std::mutex> lg(chain_mtx_);
+                    tables = chain_.load()->tables_;
                 }
 
-                buffer_.clear();
+                // 活跃表之外还有其他内存表时才需要压缩
+                if (tables.size() > 1) {
+                    // 轮转之前开始的写操作全部结束之后，除合并之外不会再写入不可变表和基础表
+                    auto fence = Coordinator.fenceVersion();
+                    submitAfterRelease(this, fence, MaintenanceExecutor::normal, [this, tables, fence] {
+                        // 基础表会被合并写入，不能封存
+                        for (size_t i = 1; i + 1 < tables.size(); i++) {
+                            if (tables[i]->sealVersion() == LONG_MAX)
+                                tables[i]->seal(fence);
+                        }
+
+                        // 获取表中已删除的个数（不太准确）
+                        compact_deleted_ = deleted_nums.load();
+
+                        compactTask(1);
+                    });
+                    return;
+                }
 
+            } else if (phase == 1) {
+                // 分片清理基础表中删除掉的节点，每一片作为单独的任务，其他表的任务可以穿插执行
+                if (!base->compactStep(compact_step_)) {
+                    Maintenance.submit(this, MaintenanceExecutor::normal, [this] {
+                        compactTask(1);
+                    });
+                    return;
+                }
+                base->rebuildFilter();
 
-            } catch (...) {
+                // 更新已删除计数
+                deleted_nums.fetch_sub(compact_deleted_);
+
+                // 不可变表会拖慢读操作，合并任务优先执行
+                Maintenance.submit(this, MaintenanceExecutor::high, [this] {
+                    compactTask(2);
+                });
+                return;
+
+            } else if (phase == 2) {
+                auto &tables = chain_.load()->tables_;
+
+                // 从旧到新将已封存的不可变表合并到基础表中，合并时只会追加更新的版本
+                for (auto i = static_cast<int>(tables.size()) - 2; i > 0; i--) {
+                    auto table = tables[i];
+                    if (table->sealVersion() == LONG_MAX)
+                        break;
+
+                    for (auto it = table->list().begin(); it != table->list().end(); ++it) {
+                        if (!it)
+                            continue;   // 已删除的键不需要合并
+                        Value *value_node = base->locate(it.key());
+                        while (!value_node->merge(*it)) {}
+                    }
+                    merged_.emplace_back(table);
+                }
+
+                {
+                    std::lock_guard<std::mutex> lg(chain_mtx_);
+
+                    if (!merged_.empty()) {
+                        auto chain = new Chain;
+                        for (auto table: chain_.load()->tables_) {
+                            if (std::find(merged_.begin(), merged_.end(), table) == merged_.end())
+                                chain->tables_.emplace_back(table);
+                        }
+                        publish(chain);
+                    }
+                    releasing_chains_.swap(retired_chains_);
+                }
+
+                // 所有读取已合并的表以及已移出节点的读操作都结束之后再释放
+                submitAfterRelease(this, Coordinator.fenceVersion(), MaintenanceExecutor::high, [this] {
+                    compactTask(3);
+                });
+                return;
+
+            } else {
+                for (auto chain: releasing_chains_) {
+                    delete chain;
+                }
+                releasing_chains_.clear();
+                for (auto table: merged_) {
+                    delete table;
+                }
+                merged_.clear();
+                releaseSpilled(false);
+                base->reclaim();
 
+                // 压缩过程中轮转出的不可变表在下一轮处理
+                again = chain_.load()->tables_.size() > 2;
             }
 
+        } catch (...) {
+            merged_.clear();
+        }
+
+        vacuum_mark_.store(0);  // 压缩之后内存重新增长时需要再次清理
 
-        });
+        {
+            std::lock_guard<std::mutex> lg(compact_mtx_);
+            compacting_.store(false);
+        }
+        compact_cv_.notify_all();
 
-        th.join();
+        if (again)
+            scheduleCompaction();
     }
 
     bool ValueTable::erase(const std::string &key) {
+        // 惰性删除期间持有一个写版本，防止节点在删除过程中被压缩释放，检查点也会等待删除结束
+        auto guard = Coordinator.startDeleteOperation(nullptr);
+
+        // 删除之前日志需要先落盘
+        if (log_ && !log_->append(guard.version(), {{WriteAheadLog::erase, key, {}}}))
+            return false;
+
         deleted_nums.fetch_add(1);  // 增加删除计数
-        return skipList_.erase(key);
+
+        // 所有内存表中的记录都需要删除，否则更旧的表中的记录会重新可见
+        bool erased = false;
+        for (auto table: chain_.load()->tables_) {
+            erased |= table->erase(key);
+        }
+
+        if (erased && changes_)
+            changes_->publish(guard.version(), ChangeStream::erase, key, {});
+        return erased;
     }
 
     bool ValueTable::exist(const std::string &key) {
-        return skipList_.find(key) != skipList_.end();
+        auto guard = Coordinator.startReadOperation(nullptr);
+
+        // 节点存在但只有删除标记或者未提交的写入时，键不存在
+        auto value_node = findValue(key, guard.version());
+        return value_node != nullptr && value_node->visible(guard.version());
     }
 
     ValueTable::Iterator ValueTable::find(const std::string &key) {
-        auto pos = skipList_.find(key);
-        if (pos == skipList_.end()){
-            if (status_.load() == 0)
-                return end();
-            pos = buffer_.find(key);
-            if (pos == buffer_.end()) {
-                return end();
-            }
+        auto stream = Coordinator.startStreamReadOperation(nullptr);
+
+        if (findValue(key, stream.version()) == nullptr)
+            return end();
+
+        // 每个内存表都定位到第一个不小于 key 的位置
+        std::vector<SkipList<Value>::Iterator> its;
+        for (auto table: chain_.load()->tables_) {
+            its.emplace_back(table->list().findBetween(key).first);
         }
-        return Iterator(pos);
+        return Iterator(std::move(its), std::move(stream));
     }
 
     size_t ValueTable::size() const {
-        return skipList_.size();
+        auto guard = Coordinator.startReadOperation(nullptr);
+
+        size_t size = 0;
+        for (auto table: chain_.load()->tables_) {
+            size += table->size();
+        }
+        return size;
     }
 
     size_t ValueTable::memoryUse() const {
-        return mem_use_.load();
+        // 内存表可能被压缩过程释放，读取期间需要登记读版本
+        auto guard = Coordinator.startReadOperation(nullptr);
+
+        size_t filter_mem = 0;
+        for (auto table: chain_.load()->tables_) {
+            filter_mem += table->filterMemoryUse();
+        }
+
+        return trackedMemory() + filter_mem;
     }
 
+    ValueTable::ReadWriteTransaction::ReadWriteTransaction(ValueTable *table, op::Transaction transaction,
+                                                           Isolation isolation)
+            : table_(table), transaction_(std::move(transaction)), isolation_(isolation) {}
+
+    std::string ValueTable::ReadWriteTransaction::get(const std::string &key) {
+        checkActive();
+
+        auto write = lowerBound(key);
+        if (write != writes_.end() && write->first == key)
+            return write->second;
+
+        return table_->readForTransaction(key, version(), isolation_ == serializable ? &reads_ : nullptr);
+    }
 
-}
\ No newline at end of file
+    void ValueTable::ReadWriteTransaction::put(const std::string &key, const std::string &value) {
+        checkActive();
+
+        auto write = lowerBound(key);
+        if (write != writes_.end() && write->first == key)
+            write->second = value;
+        else
+            writes_.emplace(write, key, value);
+    }
+
+    void ValueTable::ReadWriteTransaction::erase(const std::string &key) {
+        put(key, "");
+    }
+
+    std::vector<std::pair<std::string, std::string>>
+    ValueTable::ReadWriteTransaction::scan(const std::string &lower, const std::string &upper, size_t limit) {
+        checkActive();
+
+        std::vector<std::pair<std::string, std::string>> records;
+        if (limit == 0)
+            return records;
+
+        // 事务自己的写入覆盖快照中的记录，删除的记录不返回
+        auto emit = [&records, limit](const std::string &key, const std::string &value) {
+            if (!value.empty())
+                records.emplace_back(key, value);
+            return records.size() < limit;
+        };
+
+        bool record = isolation_ == serializable;
+        ScanRecord scan{lower, upper, {}};
+        auto write = lowerBound(lower);
+        bool more = true;
+
+        table_->scanForTransaction(lower, upper, version(), record ? &reads_ : nullptr,
+                                   [&](const std::string &key, const std::string &value) {
+            if (record)
+                scan.keys_.push_back(key);
+
+            for (; more && write != writes_.end() && write->first < key; ++write) {
+                more = emit(write->first, write->second);
+            }
+            if (!more)
+                return false;
+
+            if (write != writes_.end() && write->first == key)
+                more = emit(key, (write++)->second);
+            else
+                more = emit(key, value);
+            return more;
+        });
+
+        for (; more && write != writes_.end() && (upper.empty() || write->first < upper); ++write) {
+            more = emit(write->first, write->second);
+        }
+
+        if (record) {
+            // 达到数量限制时只验证返回的最后一个键之前的部分
+            if (!more)
+                scan.upper_ = records.back().first + std::string(1, '\0');
+            scans_.emplace_back(std::move(scan));
+        }
+        return records;
+    }
+
+    bool ValueTable::ReadWriteTransaction::commit() {
+        checkActive();
+
+        auto &transaction = *transaction_;
+        for (auto &kv: writes_) {
+            transaction.appendOperation(table_->locateForWrite(kv.first), kv.second);
+        }
+
+        // 持有所有写入的锁并且写入已经生效之后验证读取的记录：两个相互读写的事务中，后验证的一方总能看到另一方的写入
+        size_t applied = 0;
+        auto log = table_->commitHook(transaction.version(), writes_, applied);
+        bool committed = transaction.tryCommit([this, &transaction, &log, &applied](size_t num) {
+            for (auto &read: reads_) {
+                if (!table_->validateRead(read, transaction.version())) {
+                    table_->conflicts_.fetch_add(1);
+                    return false;
+                }
+            }
+            for (auto &scan: scans_) {
+                if (!table_->validateRange(scan.lower_, scan.upper_, scan.keys_, transaction.version())) {
+                    table_->conflicts_.fetch_add(1);
+                    return false;
+                }
+            }
+            if (log)
+                return log(num);
+            applied = num;
+            return true;
+        });
+        if (committed)
+            table_->publishChanges(transaction.version(), writes_, writes_.size());
+
+        table_->tryCompact();
+
+        abort();
+        return committed;
+    }
+
+    void ValueTable::ReadWriteTransaction::abort() {
+        transaction_.reset();
+        writes_.clear();
+        reads_.clear();
+        scans_.clear();
+    }
+
+    bool ValueTable::ReadWriteTransaction::active() const {
+        return transaction_.has_value();
+    }
+
+    long ValueTable::ReadWriteTransaction::version() const {
+        checkActive();
+        return transaction_->version();
+    }
+
+    size_t ValueTable::ReadWriteTransaction::writeNum() const {
+        return writes_.size();
+    }
+
+    void ValueTable::ReadWriteTransaction::checkActive() const {
+        if (!transaction_)
+            throw std::runtime_error("Transaction has finished");
+    }
+
+    ValueTable::ReadWriteTransaction::Writes::iterator
+    ValueTable::ReadWriteTransaction::lowerBound(const std::string &key) {
+        return std::lower_bound(writes_.begin(), writes_.end(), key,
+                                [](const std::pair<std::string, std::string> &write, const std::string &key) {
+                                    return write.first < key;
+                                });
+    }
+}
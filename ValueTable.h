@@ -9,29 +9,53 @@
 #include "OpCoordinator.h"
 #include "Operation.h"
 #include "SkipList.h"
-#include <unordered_map>
+#include "MemTable.h"
+#include "MaintenanceExecutor.h"
+#include "LoadPool.h"
+#include "WriteAheadLog.h"
+#include "Checkpoint.h"
+#include "ValueLog.h"
+#include "ChangeStream.h"
+#include <future>
 #include <thread>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <condition_variable>
 
 
 namespace mvcc {
 
     /// @brief ValueTable is a read-write concurrent table.
     /// @details ValueTable provides a container to user. The operations of this container is thread safe. The read strategy is read
-    /// latest. Write operation on same node is not allowed.
+    /// latest. Write operation on same node is not allowed. Records are kept in a chain of memtables: writes always go to
+    /// the active one, and reads search from the newest to the oldest one.
     class ValueTable {
     public:
 
-        /// @brief Iterator provides a snapshot-read interface to ValueTable.
-        /// @details Iterator warps a StreamReadOperation to provide a snapshot-read. Iterator only uses SkipList's bottom
-        /// level to implement traversal.
-        class Iterator {
+        friend class ShardedValueTable;
+
+        /// @brief MergingIterator provides a snapshot-read interface over all memtables of ValueTable.
+        /// @details MergingIterator holds a SkipList iterator for each memtable and always points to the smallest key
+        /// (or the largest one in reverse order) among them. If a key exists in more than one memtable, the value with
+        /// the newest version visible to the snapshot is used. All memtables are read with the same
+        /// StreamReadOperation, so the scan is a snapshot read.
+        /// \tparam It SkipList<Value>::Iterator or SkipList<Value>::ReverseIterator
+        /// \tparam Reverse Is traversal in descending key order
+        template<typename It, bool Reverse>
+        class MergingIterator {
         public:
 
-            /// Constructs an Iterator impl with given SkipList<Value>::Iterator.
-            /// \param it SkipList<Value>::Iterator to warp
-            explicit Iterator(const SkipList<Value>::Iterator &it)
-                    : it_(it), stream_(Coordinator.startStreamReadOperation(&*it)) {
-
+            /// Constructs an iterator impl with the start position of each memtable.
+            /// \param its Start position of each memtable
+            /// \param stream StreamReadOperation whose version is used
+            MergingIterator(std::vector<It> its, op::StreamReadOperation stream)
+                    : stream_(std::move(stream)), its_(std::move(its)), keys_(its_.size()) {
+                for (size_t i = 0; i < its_.size(); i++) {
+                    if (its_[i] != It::end())
+                        keys_[i] = its_[i].key();
+                }
+                seek();
             }
 
             /// Read the value of current position.
@@ -40,33 +64,109 @@ namespace mvcc {
                 return stream_.read();
             }
 
-            /// Change this StreamReadOperation position to next node.
+            /// Change this iterator position to the next key among all memtables.
             /// \return Changed impl.
-            Iterator &operator++() {
-                ++it_;
-                stream_.next(&*it_);
+            MergingIterator &operator++() {
+                if (!valid_)
+                    return *this;
+
+                advance();
+                seek();
                 return *this;
             }
 
+            /// Get the key of current position.
+            /// \return Key of current record
+            [[nodiscard]] std::string key() const {
+                if (!valid_)
+                    throw std::runtime_error("Request key on invalid Iterator");
+                return key_;
+            }
+
             /// Compares the contents of the current two iterators to be equal.
-            /// \param other Another Iterator impl
+            /// \param other Another iterator impl
             /// \return Results of comparison
-            bool operator==(const Iterator &other) const {
-                return it_ == other.it_;
+            bool operator==(const MergingIterator &other) const {
+                if (!valid_ || !other.valid_)
+                    return valid_ == other.valid_;
+                return key_ == other.key_;
             }
 
             /// Compares the contents of the current two iterators to be not equal.
-            /// \param other Another Iterator impl
+            /// \param other Another iterator impl
             /// \return Results of comparison
-            bool operator!=(const Iterator &other) const {
-                return it_ != other.it_;
+            bool operator!=(const MergingIterator &other) const {
+                return !(*this == other);
+            }
+
+        private:
+
+            // Advance all iterators positioned at current key.
+            void advance() {
+                for (size_t i = 0; i < its_.size(); i++) {
+                    if (its_[i] == It::end() || keys_[i] != key_)
+                        continue;
+                    ++its_[i];
+                    if (its_[i] != It::end())
+                        keys_[i] = its_[i].key();
+                }
+            }
+
+            // Find the memtable with the next key and move stream to the newest visible value of it. Keys lazy freed in
+            // all memtables or without a visible value are skipped.
+            void seek() {
+                while (true) {
+                    int cur = -1;
+                    for (int i = 0; i < static_cast<int>(its_.size()); i++) {
+                        if (its_[i] == It::end())
+                            continue;
+                        if (cur < 0 || (Reverse ? keys_[i] > keys_[cur] : keys_[i] < keys_[cur]))
+                            cur = i;
+                    }
+
+                    valid_ = cur >= 0;
+                    if (!valid_) {
+                        stream_.next(nullptr);
+                        return;
+                    }
+                    key_ = keys_[cur];
+
+                    // 同一个键可能存在于多个内存表中，使用快照可见的最新版本
+                    Value *value_node = nullptr;
+                    long version = -1;
+                    for (int i = cur; i < static_cast<int>(its_.size()); i++) {
+                        if (its_[i] == It::end() || keys_[i] != key_ || !its_[i])
+                            continue;
+                        long other = (*its_[i]).visibleVersion(stream_.version());
+                        if (value_node == nullptr || other > version) {
+                            value_node = &*its_[i];
+                            version = other;
+                        }
+                    }
+
+                    // 只有删除标记或者未提交写入的键同样跳过
+                    if (value_node != nullptr && value_node->visible(stream_.version())) {
+                        stream_.next(value_node);
+                        return;
+                    }
+                    advance();
+                }
             }
 
         private:
             op::StreamReadOperation stream_;
-            SkipList<Value>::Iterator it_;
+            std::vector<It> its_;
+            std::vector<std::string> keys_;     // 每个内存表当前位置的键，避免重复拷贝
+            std::string key_;
+            bool valid_ = false;
         };
 
+        /// Iterator traverses ValueTable in ascending key order.
+        using Iterator = MergingIterator<SkipList<Value>::Iterator, false>;
+
+        /// ReverseIterator traverses ValueTable in descending key order.
+        using ReverseIterator = MergingIterator<SkipList<Value>::ReverseIterator, true>;
+
     public:
 
         /// Describes garbage cleanup level
@@ -81,13 +181,101 @@ namespace mvcc {
             never
         };
 
+        /// Describes the isolation level of a read-write transaction
+        enum Isolation {
+            /// Reads see the snapshot of the transaction, and the records read are not checked at commit
+            snapshot,
+            /// Records read are validated at commit, and the transaction fails if any of them has been written by a
+            /// concurrent one, so committed transactions behave as if they ran one by one
+            serializable
+        };
+
+        /// Read a record in a read-write transaction, "" if not exists
+        using TransactionRead = std::function<std::string(const std::string &key)>;
+
+        /// Body of a read-write transaction. It reads records and appends the records to write, returns false to abort
+        using TransactionBody = std::function<bool(const TransactionRead &read,
+                                                   std::vector<std::pair<std::string, std::string>> &writes)>;
+
+        class ReadWriteTransaction;
+
+        /// @brief Result of one partition of a parallel bulk write.
+        struct BulkPartition {
+            /// Num of records in the partition
+            size_t size_ = 0;
+            /// Num of records applied. The partition stopped at its first failed record if it is less than size
+            size_t applied_ = 0;
+        };
+
+        /// @brief Options used to construct a ValueTable.
+        struct Options {
+            /// Max level of skip list
+            int max_level = 18;
+            /// Garbage cleanup threshold
+            CleanThreshold threshold = never;
+            /// Maintain a hash side index for point lookups. The skip list is still used for ordered scans
+            bool hash_index = false;
+            /// Max num of nodes visited by each compaction step
+            size_t compact_step = 1024;
+            /// Initial capacity of hash side index
+            size_t hash_capacity = 1024;
+            /// Maintain a bloom filter on each memtable to short-circuit negative lookups
+            bool filter = false;
+            /// Bits used for each key in bloom filter
+            int filter_bits_per_key = 10;
+            /// Max num of maintenance tasks of this table started per second, 0 means unlimited
+            size_t maintenance_rate = 0;
+            /// Memory budget of this table in bytes, 0 means unlimited. Exceeding the budget starts version vacuum, and
+            /// then compaction if vacuum is not enough
+            size_t memory_budget = 0;
+            /// Writers are stalled while memory use exceeds budget multiplied by this ratio
+            double stall_ratio = 1.5;
+            /// Max time a writer is stalled for each write
+            int stall_timeout_ms = 100;
+            /// Min interval between two vacuums when memory use stays over budget without growing
+            int vacuum_interval_ms = 100;
+            /// Rotate the active memtable once it holds this num of records, 0 means only rotate on compaction
+            size_t memtable_size = 0;
+            /// Path of checkpoint loaded when the table is constructed, empty means no checkpoint. Only the log batches
+            /// after the checkpoint are replayed
+            std::string checkpoint_path;
+            /// Num of threads loading the checkpoint and replaying the log, 0 means the num of hardware threads
+            size_t load_threads = 0;
+            /// Path of write-ahead log, empty means no log. An existing log is replayed when the table is constructed
+            std::string wal_path;
+            /// When a write is acknowledged, see WriteAheadLog::Durability
+            WriteAheadLog::Durability wal_durability = WriteAheadLog::sync;
+            /// Max interval between two log syncs in batched mode
+            int wal_sync_interval_ms = 10;
+            /// Path of value log which cold values are spilled to when memory use exceeds budget, empty means values are
+            /// always kept in memory. The file is removed when the table is destructed
+            std::string value_log_path;
+            /// Max bytes of block cache used to read spilled values
+            size_t value_cache_size = 8 << 20;
+            /// Values smaller than this size are never spilled
+            size_t spill_min_size = 64;
+            /// Publish committed changes to a change stream, which can be followed by pollChanges
+            bool change_stream = false;
+            /// Max num of changes kept in change stream
+            size_t change_history = 1 << 16;
+            /// Commit concurrent transactions of key-value pairs in groups. While one group is committing, later
+            /// transactions are queued, and the next committer commits all of them under one version with one log batch
+            bool group_commit = false;
+        };
+
 
         /// Constructs a ValueTable impl using given skip list level.
         /// \param max_level skip list's max level
         /// \param threshold Garbage cleanup threshold. If it is set to 1, no cleanup is performed
         explicit ValueTable(int max_level = 18, CleanThreshold threshold = never);
 
-        ~ValueTable() = default;
+        /// Constructs a ValueTable impl using given options. If a log path is given, records of the existing log are
+        /// replayed before the table is returned.
+        /// \param options Options of table
+        /// @throw std::runtime_error if the log file can not be opened
+        explicit ValueTable(const Options &options);
+
+        ~ValueTable();
 
         /// Get the begin of all values.
         /// \return Iterator of first value
@@ -97,16 +285,77 @@ namespace mvcc {
         /// \return Iterator of end
         Iterator end();
 
+        /// Get the reverse begin of all values, which is the record with the largest key.
+        /// \return ReverseIterator of last value
+        ReverseIterator rbegin();
+
+        /// Get the reverse end of all values. End means an iterator points to nullptr.
+        /// \return ReverseIterator of end
+        ReverseIterator rend();
+
+        /// Find the record whose key is the largest one less than or equal to given key. This function is used to
+        /// traverse table in descending order.
+        /// \param key The key to seek
+        /// \return ReverseIterator of record
+        ReverseIterator seekForPrev(const std::string &key);
+
         /// Start a transaction. If there is any error while processing, all operations will roll back.
         /// \param kvs vector of key-value pair to write
         /// \return Is transaction suceeded
         bool transaction(const std::vector<std::pair<std::string, std::string>> &kvs);
 
+        /// Callback of an asynchronous transaction, receiving whether the transaction is committed
+        using CommitCallback = std::function<void(bool committed)>;
+
+        /// Commit a transaction of key-value pairs without blocking the caller. The first attempt runs in the calling
+        /// thread and never waits for a lock: if a value is locked by another transaction, the transaction is tried
+        /// again by a background thread at growing intervals, while the caller goes on. Each attempt takes a new version,
+        /// so a late commit is never stacked under the newer versions committed while it waited. In sync
+        /// log mode the writes are committed once their batch is buffered, and callback is called after the batch is
+        /// synced, without any thread waiting for the sync.
+        /// \param kvs vector of key-value pair to write
+        /// \param callback Called once with the result, in the calling thread, the retry thread or the log writer
+        /// thread, so it should be short
+        /// \param wait_ms Max time to retry while a value is locked
+        /// @note Readers may see the writes before they are synced, but a crash can only lose writes whose callback
+        /// has not been called, since batches are synced in log order.
+        void transactionAsync(std::vector<std::pair<std::string, std::string>> kvs, CommitCallback callback,
+                              int wait_ms = 50);
+
+        /// Commit a transaction of key-value pairs without blocking the caller like above, and get the result later.
+        /// \param kvs vector of key-value pair to write
+        /// \param wait_ms Max time to retry while a value is locked
+        /// \return Future of whether the transaction is committed
+        std::future<bool> transactionAsync(std::vector<std::pair<std::string, std::string>> kvs, int wait_ms = 50);
+
+        /// Run a read-write transaction. Body reads records at the snapshot of the transaction, and the records it
+        /// appends are written as one transaction. Values are only locked at commit, so body may take its time. In
+        /// serializable mode a transaction fails if any record it read has been written by a concurrent commit, which
+        /// prevents lost updates and write skew. A failed transaction can simply be run again.
+        /// \param body Body of transaction
+        /// \param isolation Isolation level
+        /// \return Is transaction committed
+        bool transaction(const TransactionBody &body, Isolation isolation = serializable);
+
+        /// Start an interactive read-write transaction. See ReadWriteTransaction.
+        /// \param isolation Isolation level
+        /// \return Transaction
+        ReadWriteTransaction startTransaction(Isolation isolation = serializable);
+
         /// Start a bulk write. Operation will pause after error occurs.
         /// \param kvs vector of key-value pair to write
         /// \return Is all operation finished
         bool bulkWrite(const std::vector<std::pair<std::string, std::string>> &kvs);
 
+        /// Start a bulk write applied by many threads. Records are partitioned by key hash, and each partition is
+        /// applied in order by one thread of the load pool, stopping at its first failed record like bulkWrite. Applied
+        /// records of all partitions are committed together under one version.
+        /// \param kvs vector of key-value pair to write
+        /// \param partitions Num of partitions, 0 means the num of load threads
+        /// \return Result of each partition
+        std::vector<BulkPartition> parallelBulkWrite(const std::vector<std::pair<std::string, std::string>> &kvs,
+                                                     size_t partitions = 0);
+
         /// Erase a record with given key.
         /// \param key The key of record
         /// \return Is ok
@@ -129,6 +378,12 @@ namespace mvcc {
         /// \return value or ""
         std::string read(const std::string &key);
 
+        /// Read records of many keys under one snapshot. Lookups of different keys are interleaved so that their cache
+        /// misses overlap, which is faster than reading them one by one.
+        /// \param keys Keys of records
+        /// \return Values in the order of keys, "" if not exists
+        std::vector<std::string> multiGet(const std::vector<std::string> &keys);
+
         /// Check is record with given key exists.
         /// \param key The key of record
         /// \return Is record exists
@@ -140,43 +395,397 @@ namespace mvcc {
         /// \return Iterator of record.
         Iterator find(const std::string &key);
 
-        /// The num of records, typically key nums in this table.
+        /// The num of records in all memtables. A key written again after rotation is counted once in each memtable
+        /// until they are merged.
         /// \return The num of records
         [[nodiscard]] size_t size() const;
 
-        /// Not used.
-        /// \return
+        /// Memory use of this table, including keys, skip list towers, version records, retired nodes, hash index and
+        /// bloom filters.
+        /// \return Memory use in bytes
         [[nodiscard]] size_t memoryUse() const;
 
-        /// Force start compact process. Make sure that no operation is now on this table. A daemon thread will be start
-        /// to do compact task.
+        /// Num of writes stalled because memory use exceeded the stall limit.
+        /// \return Stalled write num
+        [[nodiscard]] size_t stalledWriteNum() const;
+
+        /// Num of commits issued by group commit. Each of them commits one or more transactions under one version.
+        /// \return Group num
+        [[nodiscard]] size_t groupCommitNum() const;
+
+        /// Num of times asynchronous transactions are scheduled again because a value is locked or writes are stalled.
+        /// \return Retry num
+        [[nodiscard]] size_t asyncRetryNum() const;
+
+        /// Num of serializable transactions failed because a record they read was written concurrently.
+        /// \return Conflict num
+        [[nodiscard]] size_t conflictNum() const;
+
+        /// Num of values spilled to value log.
+        /// \return Spilled value num
+        [[nodiscard]] size_t spilledNum() const;
+
+        /// Force start compact process. The active memtable is rotated into the immutable queue and a new one takes
+        /// writes, then the oldest memtable is compacted and the immutable ones are merged into it as a chain of tasks
+        /// on the shared maintenance executor. This function returns immediately.
         /// @note Costly action.
         void compact();
 
+        /// Write a consistent checkpoint of this table in background. A new snapshot version is pinned after all
+        /// operations started before have finished, and all live records visible to it are streamed in key order into
+        /// given file. Writers are not blocked, but compaction of this table waits until the snapshot is released.
+        /// \param path Path of checkpoint file. An existing one is replaced only when the new one is complete
+        /// \return Future of result, false if the file can not be written or another checkpoint is running
+        std::future<bool> checkpoint(const std::string &path);
+
+        /// Rotate the active memtable into the immutable queue. A new empty memtable will take all later writes.
+        void rotate();
+
+        /// Num of memtables, including the active one.
+        /// \return num
+        [[nodiscard]] size_t memtableNum() const;
+
+        /// Block until all writes acknowledged before are synced to log. Used in batched and async durability modes.
+        /// \return False if the log has failed to write, true if there is no log
+        bool flushLog();
+
+        /// Get committed changes after given cursor in version order. Writes recovered from checkpoint and log are not
+        /// changes. See ChangeStream::poll.
+        /// \param cursor Version of the last consumed change, advanced to the version of the last returned change
+        /// \param changes Returned changes are appended
+        /// \param max Max num of changes returned
+        /// \param wait_ms Max time to wait if there is no change after cursor
+        /// \return False if changes after cursor have been dropped, subscriber needs to resync with a scan
+        /// @throw std::runtime_error if change stream is not enabled
+        bool pollChanges(long &cursor, std::vector<ChangeStream::Change> &changes, size_t max = 1024, int wait_ms = 0);
+
+        /// Version of the newest change in change stream. A new subscriber starting from it only sees later changes.
+        /// \return Version
+        /// @throw std::runtime_error if change stream is not enabled
+        [[nodiscard]] long lastChangeVersion() const;
+
+        /// Block until the running compaction finishes.
+        void waitForCompaction() const;
+
+        /// Submit a low priority task to release version records that no alive operation can see. Values which are
+        /// written often are pruned by writers, this task is for the ones not written any more.
+        void vacuum();
+
 
     private:
 
-        // Clean buffer skip list.
-        void clearBuffer();
+        /// A snapshot of the memtable chain, newest first. The last one is the base memtable, into which immutable
+        /// ones are merged. A chain is never modified after published, and a replaced one is retired.
+        struct Chain {
+            std::vector<MemTable *> tables_;
+        };
+
+        // A transaction waiting in group commit queue.
+        struct CommitRequest {
+            const std::vector<std::pair<std::string, std::string>> *kvs_;
+            bool done_ = false;
+            bool committed_ = false;
+        };
+
+        // Write given kvs as one transaction with a new version.
+        bool commitWrites(const std::vector<std::pair<std::string, std::string>> &kvs);
+
+        // Queue a transaction for group commit, and commit the queue as its leader if no one else is committing.
+        bool groupCommit(const std::vector<std::pair<std::string, std::string>> &kvs);
+
+        // Commit queued transactions under one version. If the group fails, its transactions are committed one by one,
+        // so a single failing transaction does not fail the others.
+        void commitGroup(const std::vector<CommitRequest *> &group);
+
+        // An asynchronous transaction. It holds no version while waiting, so it does not hold back the lowest alive
+        // version during its retries.
+        struct AsyncCommit {
+            std::vector<std::pair<std::string, std::string>> kvs_;
+            CommitCallback callback_;
+            std::chrono::milliseconds wait_;
+            std::chrono::steady_clock::time_point stall_deadline_;  // 写入停顿的等待期限
+            std::chrono::steady_clock::time_point deadline_{};      // 第一次遇到锁冲突时设置的等待期限
+            std::chrono::steady_clock::time_point retry_at_{};
+            std::chrono::microseconds backoff_{0};
+        };
+
+        // Try an asynchronous transaction once without waiting for any lock, and call its callback if it finishes.
+        // Returns false if it should be tried again later.
+        bool attemptAsync(AsyncCommit &commit);
+
+        // Queue an asynchronous transaction for retry with a growing interval, starting the retry thread if needed.
+        void scheduleRetry(std::unique_ptr<AsyncCommit> commit);
 
-        // Check whether the compression conditions are met
+        // Retry loop of asynchronous transactions. Transactions still queued when the table is destroyed fail.
+        void retryAsync();
+
+        // Find the value of given key for point read with given version, nullptr if not exists.
+        Value *findValue(const std::string &key, long version);
+
+        // A record read by a serializable transaction. value_ is nullptr if the key was not found.
+        struct ReadRecord {
+            std::string key_;
+            Value *value_;
+            const ValueNode *visible_;
+        };
+
+        // Read a record for a transaction with given version, and append it to reads if reads is not nullptr. Must be
+        // called with the version registered.
+        std::string readForTransaction(const std::string &key, long version, std::vector<ReadRecord> *reads);
+
+        // Check whether a read of a serializable transaction is still valid. Must be called after all writes of the
+        // transaction are applied, and before they are committed.
+        bool validateRead(const ReadRecord &read, long version);
+
+        // Visit the records in [lower, upper) at given version in key order, including the deleted ones whose value is
+        // "", and append them to reads if reads is not nullptr. Empty upper means no bound. Visiting stops once visit
+        // returns false. Must be called with the version registered.
+        void scanForTransaction(const std::string &lower, const std::string &upper, long version,
+                                std::vector<ReadRecord> *reads,
+                                const std::function<bool(const std::string &key, const std::string &value)> &visit);
+
+        // Check whether a range scanned by a serializable transaction has no phantom, which means every record in the
+        // range but the scanned keys has never been written by a concurrent commit. Called like validateRead.
+        bool validateRange(const std::string &lower, const std::string &upper, const std::vector<std::string> &keys,
+                           long version);
+
+        // Find the values of many keys for point read with given version like findValue, with the lookups in each
+        // memtable interleaved. Must be called with the version registered.
+        void findValues(const std::string *const *keys, size_t n, long version, Value **values);
+
+        // Get the value of given key in active memtable for write. If not exists, a new record will be constructed.
+        // Must be called with a version registered.
+        Value *locateForWrite(const std::string &key);
+
+        // Load a mapped checkpoint with parallel bulk writes into the active memtable. Returns the num of log batches
+        // covered by the checkpoint, 0 if it is absent or broken.
+        size_t loadCheckpoint(const std::string &path);
+
+        // Write a checkpoint with given fence snapshot. Runs on maintenance executor after all operations started
+        // before the fence have finished.
+        bool writeCheckpoint(const std::string &path, const CheckpointHeader &header, op::StreamReadOperation stream);
+
+        // Replay given log skipping the first skip batches. Records are partitioned by key hash across load threads, and
+        // only the last record of each key is applied. The coordinator version is restored to the max replayed one.
+        void recover(const std::string &path, size_t skip);
+
+        // Write given kvs into the active memtable with one bulk write. Used by recovery.
+        void bulkLoad(const std::vector<std::pair<std::string, std::string>> &kvs);
+
+        // Num of threads used by recovery.
+        [[nodiscard]] size_t loadThreads() const;
+
+        // Append a batch to log, true if there is no log.
+        bool logBatch(long version, const std::vector<WriteAheadLog::Record> &records);
+
+        // Build a commit hook logging the first num kvs as one batch and recording num to applied, empty if there is
+        // neither log nor change stream.
+        op::CommitHook commitHook(long version, const std::vector<std::pair<std::string, std::string>> &kvs,
+                                  size_t &applied);
+
+        // Publish the first num kvs to change stream. Must be called before the version is released.
+        void publishChanges(long version, const std::vector<std::pair<std::string, std::string>> &kvs, size_t num);
+
+        // Construct an empty memtable with table options.
+        MemTable *newMemTable();
+
+        // Publish a new chain and retire the old one. Must be called with chain mutex held.
+        void publish(Chain *chain);
+
+        // Start a compaction cycle on maintenance executor if none is running.
+        void scheduleCompaction();
+
+        // Compaction phase running on maintenance executor. 0 : seal immutables, 1 : compact step, 2 : merge,
+        // 3 : release merged tables.
+        void compactTask(int phase);
+
+        // Submit given task once all versions less than given one are released, so no worker is parked waiting for
+        // readers. The task is dropped if the table is being destroyed.
+        void submitAfterRelease(const void *owner, long version, MaintenanceExecutor::Priority priority,
+                                MaintenanceExecutor::Task task);
+
+        // Check whether the compression conditions are met, including memory budget. Must be called with a version
+        // registered.
         void tryCompact();
 
-    private:
+        // Whether memory use exceeds the stall limit while maintenance is running to free it. Starts compaction if
+        // needed.
+        bool writeStalled();
 
-        std::atomic<int> status_;   // 1 : compact,写缓冲区 2 : clean,写主表
+        // Stall the writer while memory use exceeds the stall limit, until maintenance frees enough memory.
+        void throttleWrite();
 
-        SkipList<Value> skipList_;  //  内存表区域
-        SkipList<Value> buffer_;    // 备用插入缓冲区
+        // Memory use of all parts except filters, which can be read without registering a version.
+        [[nodiscard]] size_t trackedMemory() const;
 
-        std::atomic<size_t> mem_use_ = 0;   // 内存占用估算
+        // Spill cold values to value log until given bytes are freed. The scan continues from the key where the last
+        // one stopped, so every value gets a chance to be read again between two visits. Runs on maintenance executor.
+        void spillCold(size_t target);
+
+        // Release replaced version records of spilled values which no alive operation can access, or all of them if
+        // force is set. Runs on maintenance executor or in destructor.
+        void releaseSpilled(bool force);
+
+    private:
+
+        std::atomic<size_t> version_mem_ = 0;   // 所有版本链的内存占用，需要在内存表之后析构
+        std::atomic<size_t> node_mem_ = 0;      // 所有跳跃表节点以及索引的内存占用
+
+        Options options_;
+        LoadPool load_pool_;    // 并行批量写入、加载检查点以及回放日志共用的线程
+
+        std::atomic<Chain *> chain_;    // 内存表链，第一个是活跃表，最后一个是基础表
+        std::mutex chain_mtx_;          // 修改内存表链时互斥
+        std::vector<Chain *> retired_chains_;   // 等待读操作结束后释放的链
+        std::vector<MemTable *> merged_;        // 本次压缩合并的不可变表
+        std::vector<Chain *> releasing_chains_; // 合并之后等待读操作结束再释放的链
+
+        size_t memory_budget_;
+        double stall_ratio_;
+        int stall_timeout_ms_;
+        std::atomic<size_t> vacuum_mark_ = 0;   // 上次清理结束时的内存占用
+        std::chrono::steady_clock::duration vacuum_interval_;
+        std::atomic<std::chrono::steady_clock::time_point> vacuum_time_{};    // 上次清理结束的时间
+        std::atomic<bool> vacuuming_ = false;
+        std::atomic<size_t> stalled_writes_ = 0;
+        std::atomic<size_t> conflicts_ = 0;     // 验证失败的可串行化事务数量
+
+        std::mutex group_mtx_;
+        std::condition_variable group_cv_;      // 一组提交结束时唤醒等待的事务
+        std::vector<CommitRequest *> group_queue_;  // 等待组提交的事务
+        bool group_leader_ = false;             // 是否有事务正在提交一组
+        std::atomic<size_t> group_num_ = 0;
+
+        std::mutex async_mtx_;
+        std::condition_variable async_cv_;      // 有事务需要重试或者表被销毁时唤醒重试线程
+        std::vector<std::unique_ptr<AsyncCommit>> async_queue_;    // 等待重试的异步事务
+        bool async_stop_ = false;
+        std::atomic<size_t> async_retry_num_ = 0;
+        std::thread async_thread_;              // 重试线程，第一次需要重试时启动
 
         CleanThreshold threshold_;  // 清理阈值
         double percent; // 具体百分比
 
         std::atomic<size_t> deleted_nums; // 删除操作的个数
 
-        std::thread th_;
+        size_t compact_step_;   // 每次压缩的节点数量
+        std::atomic<bool> compacting_ = false;  // 压缩过程是否正在进行，包括最后等待读操作结束的阶段
+        mutable std::mutex compact_mtx_;
+        mutable std::condition_variable compact_cv_;    // 压缩结束时唤醒 waitForCompaction
+        size_t compact_deleted_ = 0;    // 本次压缩开始时的删除计数
+        size_t release_waits_ = 0;      // 等待版本释放之后再提交的任务数量，由 compact_mtx_ 保护
+        bool closing_ = false;          // 表正在销毁，版本释放之后不再提交任务，由 compact_mtx_ 保护
+
+        std::unique_ptr<WriteAheadLog> log_;    // 预写日志，为空表示不记录日志
+
+        std::shared_ptr<ChangeStream> changes_;     // 变更流，分片表的所有分片共用一个
+
+        std::unique_ptr<ValueLog> value_log_;   // 冷值换出的值日志，为空表示不换出
+        std::string spill_hand_;                // 上次换出停止位置的键
+        std::vector<std::pair<long, std::vector<ValueNode *>>> spill_retired_;  // 栅栏版本以及被替换的版本记录
+        std::atomic<size_t> spill_retired_mem_ = 0;     // 被替换但还未释放的版本记录的内存占用
+        std::atomic<size_t> spilled_ = 0;
+
+        std::mutex checkpoint_mtx_;
+        std::shared_ptr<std::promise<bool>> checkpoint_;    // 正在进行的检查点，同时也是其维护任务的所有者
+    };
+
+    /// @brief An interactive read-write transaction of a ValueTable.
+    /// @details Class ReadWriteTransaction reads records at the snapshot of its version, and buffers its writes in a
+    /// small vector sorted by key, so reads and scans of the transaction see its own writes. Nothing is locked until
+    /// commit, where all writes are applied as one transaction like ValueTable::transaction. In serializable mode the
+    /// records read and the ranges scanned are validated at commit, and the transaction fails if any of them has been
+    /// written by a concurrent commit, including a record inserted into a scanned range.
+    /// @note The version of an alive transaction is registered, which holds back compaction and version cleanup, so a
+    /// transaction should not be kept open longer than needed. A transaction is not thread safe.
+    class ValueTable::ReadWriteTransaction {
+    public:
+
+        ReadWriteTransaction(ReadWriteTransaction &&other) = default;
+
+        ReadWriteTransaction &operator=(ReadWriteTransaction &&other) = default;
+
+        /// Abort the transaction if it is still active.
+        ~ReadWriteTransaction() = default;
+
+        /// Read a record at the snapshot of this transaction, or the value written by this transaction before.
+        /// \param key The key of record
+        /// \return value or ""
+        /// @throw std::runtime_error if the transaction has finished
+        std::string get(const std::string &key);
+
+        /// Write a record at commit. Writing "" is the same as erasing.
+        /// \param key The key of record
+        /// \param value The value of record
+        /// @throw std::runtime_error if the transaction has finished
+        void put(const std::string &key, const std::string &value);
+
+        /// Erase a record at commit.
+        /// \param key The key of record
+        /// @throw std::runtime_error if the transaction has finished
+        void erase(const std::string &key);
+
+        /// Read the records in [lower, upper) in ascending key order, merged with the writes of this transaction.
+        /// \param lower The lower bound of key, "" means no bound
+        /// \param upper The upper bound of key, "" means no bound
+        /// \param limit Max num of records returned
+        /// \return Key-value pairs
+        /// @throw std::runtime_error if the transaction has finished
+        std::vector<std::pair<std::string, std::string>> scan(const std::string &lower = "", const std::string &upper = "",
+                                                              size_t limit = SIZE_MAX);
+
+        /// Commit all buffered writes. The transaction finishes whether it succeeds or not, and a failed one can simply
+        /// be started again.
+        /// \return Is transaction committed
+        /// @throw std::runtime_error if the transaction has finished
+        bool commit();
+
+        /// Drop all buffered writes and finish the transaction.
+        void abort();
+
+        /// Whether the transaction has neither committed nor aborted.
+        /// \return Is active
+        [[nodiscard]] bool active() const;
+
+        /// Get the snapshot version of this transaction.
+        /// \return Version value
+        /// @throw std::runtime_error if the transaction has finished
+        [[nodiscard]] long version() const;
+
+        /// Num of records buffered to write.
+        /// \return num
+        [[nodiscard]] size_t writeNum() const;
+
+    private:
+
+        friend class ValueTable;
+
+        // A range scanned by a serializable transaction and the keys found in it.
+        struct ScanRecord {
+            std::string lower_;
+            std::string upper_;
+            std::vector<std::string> keys_;
+        };
+
+        using Writes = std::vector<std::pair<std::string, std::string>>;
+
+        ReadWriteTransaction(ValueTable *table, op::Transaction transaction, Isolation isolation);
+
+        // Throw if the transaction has finished.
+        void checkActive() const;
+
+        // Position of the first buffered write whose key is not less than given key.
+        Writes::iterator lowerBound(const std::string &key);
+
+    private:
+
+        ValueTable *table_;
+        std::optional<op::Transaction> transaction_;    // 为空表示事务已结束，同时释放版本
+        Isolation isolation_;
+
+        Writes writes_;     // 按键排序的写入集合，空值表示删除
+        std::vector<ReadRecord> reads_;
+        std::vector<ScanRecord> scans_;
     };
 }
 #endif //ALGYOLO_VALUETABLE_H
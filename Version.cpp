@@ -7,13 +7,22 @@
 #include "OpCoordinator.h"
 namespace mvcc {
 
-    Version::Version(long version, bool refer) : version_(version), use_count_(new std::atomic<int>(1)),
-                                                 refer_(refer) {}
+    Version::Version(long version, bool refer, bool write) : version_(version), use_count_(new std::atomic<int>(1)),
+                                                             refer_(refer), write_(write) {}
 
-    Version::Version(const Version &other) : version_(other.version_.load()), use_count_(other.use_count_), refer_(other.refer_) {
+    Version::Version(const Version &other) : version_(other.version_.load()), use_count_(other.use_count_), refer_(other.refer_),
+                                             write_(other.write_) {
         use_count_->fetch_add(1);
     }
 
+    Version::Version(Version &&other) noexcept: version_(other.version_.load()), use_count_(other.use_count_),
+                                                refer_(other.refer_), write_(other.write_),
+                                                running_default(other.running_default),
+                                                operations_(std::move(other.operations_)) {
+        other.use_count_ = nullptr;
+        other.running_default = false;
+    }
+
     Version::~Version() {
 
         if (running_default) {
@@ -23,9 +32,7 @@ namespace mvcc {
             }
         }
 
-        if (use_count_->fetch_sub(1) == 1) {
-            Coordinator.versionReleaseNotify(version_);
-        }
+        release();
     }
 
 
@@ -35,13 +42,48 @@ namespace mvcc {
             return *this;
         }
 
+        other.use_count_->fetch_add(1);
+        release();  // 放弃原有版本的引用
+
         version_ = other.version_.load();
         use_count_ = other.use_count_;
-        operations_ = {};
-        use_count_->fetch_add(1);
+        refer_ = other.refer_;
+        write_ = other.write_;
+        operations_.clear();
         return *this;
     }
 
+    Version &Version::operator=(Version &&other) noexcept {
+        if (this == &other) {
+            return *this;
+        }
+
+        release();
+
+        version_ = other.version_.load();
+        use_count_ = other.use_count_;
+        refer_ = other.refer_;
+        write_ = other.write_;
+        running_default = other.running_default;
+        operations_ = std::move(other.operations_);
+
+        other.use_count_ = nullptr;
+        other.running_default = false;
+        return *this;
+    }
+
+    void Version::release() {
+        // 被移动过的对象不再持有引用
+        if (use_count_ == nullptr)
+            return;
+
+        if (use_count_->fetch_sub(1) == 1) {
+            if (!refer_)
+                Coordinator.versionReleaseNotify(version_, write_);
+            delete use_count_;
+        }
+    }
+
     long Version::version() const {
         return version_.load();
     }
@@ -71,6 +113,10 @@ namespace mvcc {
         operations_.emplace_back(operated);
     }
 
+    void Version::reserveOperations(size_t num) {
+        operations_.reserve(num);
+    }
+
     int Version::count() const {
         return use_count_->load();
     }
@@ -5,8 +5,8 @@
 #ifndef ALGYOLO_VERSION_H
 #define ALGYOLO_VERSION_H
 
+#include "SmallVector.h"
 #include <atomic>
-#include <list>
 
 
 namespace mvcc {
@@ -24,13 +24,18 @@ namespace mvcc {
 
         /// Construct a typical version with given version.
         /// \param version Given version sequence
-        /// \param refer Is version a refer
-        explicit Version(long version, bool refer = false);
+        /// \param refer Is version a refer. A refer is not recorded by OpCoordinator and can not commit
+        /// \param write Is version owned by a write operation, which is recorded by OpCoordinator as a live write
+        explicit Version(long version, bool refer = false, bool write = false);
 
         /// Copy constructor. The operation will increase use_count.
         /// \param other Source object
         Version(const Version &other);
 
+        /// Move constructor. The reference and recorded operations are taken without changing use_count.
+        /// \param other Source object, which is left empty and releases nothing
+        Version(Version &&other) noexcept;
+
         /// Every destruction will decrease use_count. If use count is zero, function will call OpCoordinator::versionReleaseNotify
         ~Version();
 
@@ -39,6 +44,11 @@ namespace mvcc {
         /// \return Result of comparison
         Version &operator=(const Version &other);
 
+        /// Move assignment. The reference of this impl is released and the one of other is taken.
+        /// \param other Source object, which is left empty and releases nothing
+        /// \return This impl
+        Version &operator=(Version &&other) noexcept;
+
         /// Get the version sequence.
         /// \return Version value
         [[nodiscard]] long version() const;
@@ -54,6 +64,10 @@ namespace mvcc {
         /// \param operated Operation to record
         void recordOperation(ValueNode *operated);
 
+        /// Make room for given num of operations, so that recording them allocates at most once.
+        /// \param num Num of operations
+        void reserveOperations(size_t num);
+
         /// Get use count of this impl.
         /// \return Use count
         [[nodiscard]] int count() const;
@@ -62,6 +76,11 @@ namespace mvcc {
         /// \param n Self adding quantity
         void versionUpdate(int n);
 
+    private:
+
+        /// Decrease use count. If use count is zero, function will call OpCoordinator::versionReleaseNotify
+        void release();
+
     private:
 
         std::atomic<long> version_ = 0;            // 事务号
@@ -69,8 +88,9 @@ namespace mvcc {
         std::atomic<int> *use_count_ = nullptr;   // 引用计数，用于事务视图控制
 
         bool refer_ = false;
+        bool write_ = false;    // 写操作的版本，释放时从协调器的存活写版本中移除
         bool running_default = true;    // 如果用户没有commit或undo，析构的时候会自动 undo
-        std::list<ValueNode *> operations_;     // 当前版本操作过的所有value节点
+        SmallVector<ValueNode *, 8> operations_;    // 当前版本操作过的所有value节点，少量写入时不分配内存
     };
 }
 
@@ -0,0 +1,369 @@
+//
+// Created by 唐仁初 on 2022/12/19.
+//
+
+#include "WriteAheadLog.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace mvcc {
+
+    namespace {
+
+        // 批次格式：| body size (4) | crc32 of body (4) | version (8) | record num (4) | records |
+        // 记录格式：| type (1) | key size (4) | key | value size (4) | value |
+        constexpr size_t kHeaderSize = 8;
+
+        uint32_t crc32(const char *data, size_t n) {
+            static const auto table = [] {
+                std::vector<uint32_t> t(256);
+                for (uint32_t i = 0; i < 256; i++) {
+                    uint32_t c = i;
+                    for (int k = 0; k < 8; k++) {
+                        c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                    }
+                    t[i] = c;
+                }
+                return t;
+            }();
+
+            uint32_t c = 0xFFFFFFFFu;
+            for (size_t i = 0; i < n; i++) {
+                c = table[(c ^ static_cast<uint8_t>(data[i])) & 0xFF] ^ (c >> 8);
+            }
+            return c ^ 0xFFFFFFFFu;
+        }
+
+        template<typename T>
+        void putFixed(std::string &dst, T v) {
+            dst.append(reinterpret_cast<const char *>(&v), sizeof(T));
+        }
+
+        template<typename T>
+        bool getFixed(const std::string &src, size_t &pos, T &v) {
+            if (pos + sizeof(T) > src.size())
+                return false;
+            std::memcpy(&v, src.data() + pos, sizeof(T));
+            pos += sizeof(T);
+            return true;
+        }
+
+        bool getString(const std::string &src, size_t &pos, std::string &s) {
+            uint32_t n;
+            if (!getFixed(src, pos, n) || pos + n > src.size())
+                return false;
+            s.assign(src, pos, n);
+            pos += n;
+            return true;
+        }
+
+        bool decodeBody(const std::string &body, WriteAheadLog::Batch &batch) {
+            size_t pos = 0;
+            int64_t version;
+            uint32_t num;
+            if (!getFixed(body, pos, version) || !getFixed(body, pos, num))
+                return false;
+
+            batch.version_ = static_cast<long>(version);
+            batch.records_.clear();
+            for (uint32_t i = 0; i < num; i++) {
+                uint8_t type;
+                WriteAheadLog::Record record;
+                if (!getFixed(body, pos, type) || !getString(body, pos, record.key_) ||
+                    !getString(body, pos, record.value_))
+                    return false;
+                record.type_ = static_cast<WriteAheadLog::RecordType>(type);
+                batch.records_.emplace_back(std::move(record));
+            }
+            return pos == body.size();
+        }
+
+        bool writeAll(int fd, const std::string &data) {
+            size_t done = 0;
+            while (done < data.size()) {
+                auto n = ::write(fd, data.data() + done, data.size() - done);
+                if (n < 0) {
+                    if (errno == EINTR)
+                        continue;
+                    return false;
+                }
+                done += static_cast<size_t>(n);
+            }
+            return true;
+        }
+    }
+
+    WriteAheadLog::WriteAheadLog(const std::string &path, Durability durability, int sync_interval_ms)
+            : durability_(durability), sync_interval_(std::chrono::milliseconds(sync_interval_ms)) {
+
+        // 上次崩溃时写了一半的批次需要截掉，否则之后追加的批次无法被读取
+        size_t valid = 0;
+        appended_ = written_ = synced_ = scan(path, {}, 0, valid);
+
+        fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT, 0644);
+        if (fd_ < 0)
+            throw std::runtime_error("Open log file failed : " + path);
+
+        if (::ftruncate(fd_, static_cast<off_t>(valid)) != 0 || ::lseek(fd_, 0, SEEK_END) < 0) {
+            ::close(fd_);
+            throw std::runtime_error("Truncate log file failed : " + path);
+        }
+
+        writer_ = std::thread([this] {
+            work();
+        });
+    }
+
+    WriteAheadLog::~WriteAheadLog() {
+        flush();
+
+        {
+            std::lock_guard<std::mutex> lg(mtx_);
+            stop_ = true;
+        }
+        work_cv_.notify_all();
+
+        if (writer_.joinable())
+            writer_.join();
+
+        ::close(fd_);
+    }
+
+    bool WriteAheadLog::append(long version, const std::vector<Record> &records) {
+
+        // 在锁外编码，临界区内只拷贝字节
+        std::string data;
+        encode(data, version, records);
+
+        std::unique_lock<std::mutex> lk(mtx_);
+        if (failed_)
+            return false;
+
+        buffer_.append(data);
+        auto seq = ++appended_;
+        work_cv_.notify_one();
+
+        if (durability_ != sync)
+            return true;
+
+        // 写线程正在同步时，后来的批次会在缓冲区中累积，下一次同步一起落盘
+        done_cv_.wait(lk, [this, seq] { return synced_ >= seq || failed_; });
+        return synced_ >= seq;
+    }
+
+    bool WriteAheadLog::append(long version, const std::vector<Record> &records, std::function<void(bool)> done) {
+
+        std::string data;
+        encode(data, version, records);
+
+        {
+            std::lock_guard<std::mutex> lg(mtx_);
+            if (failed_)
+                return false;
+
+            buffer_.append(data);
+            auto seq = ++appended_;
+            work_cv_.notify_one();
+
+            // 同步模式下由写线程在覆盖该批次的同步完成之后回调，调用者不需要等待
+            if (durability_ == sync) {
+                waiters_.emplace_back(seq, std::move(done));
+                return true;
+            }
+        }
+
+        done(true);
+        return true;
+    }
+
+    bool WriteAheadLog::flush() {
+        std::unique_lock<std::mutex> lk(mtx_);
+
+        auto target = appended_;
+        if (synced_ >= target)
+            return !failed_;
+
+        sync_request_ = std::max(sync_request_, target);
+        work_cv_.notify_one();
+
+        done_cv_.wait(lk, [this, target] { return synced_ >= target || failed_; });
+        return synced_ >= target;
+    }
+
+    WriteAheadLog::Durability WriteAheadLog::durability() const {
+        return durability_;
+    }
+
+    size_t WriteAheadLog::batchNum() const {
+        std::lock_guard<std::mutex> lg(mtx_);
+        return appended_;
+    }
+
+    size_t WriteAheadLog::writeNum() const {
+        return write_num_.load();
+    }
+
+    size_t WriteAheadLog::syncNum() const {
+        return sync_num_.load();
+    }
+
+    void WriteAheadLog::work() {
+
+        std::unique_lock<std::mutex> lk(mtx_);
+        auto last_sync = Clock::now();
+
+        while (true) {
+
+            auto now = Clock::now();
+            bool sync_due = durability_ == batched && written_ > synced_ && now >= last_sync + sync_interval_;
+
+            if (buffer_.empty() && sync_request_ <= synced_ && !sync_due) {
+                if (stop_)
+                    return;
+
+                // 定期同步模式下，有未同步的数据时需要在到期时醒来
+                if (durability_ == batched && written_ > synced_)
+                    work_cv_.wait_until(lk, last_sync + sync_interval_);
+                else
+                    work_cv_.wait(lk);
+                continue;
+            }
+
+            std::string data;
+            data.swap(buffer_);
+            auto end = appended_;
+            bool do_sync = durability_ == sync || sync_request_ > synced_ || sync_due;
+
+            lk.unlock();
+
+            // 一次写入与同步覆盖期间追加的所有批次
+            bool ok = true;
+            if (!data.empty()) {
+                ok = writeAll(fd_, data);
+                write_num_.fetch_add(1);
+            }
+            if (ok && do_sync) {
+                ok = ::fdatasync(fd_) == 0;
+                sync_num_.fetch_add(1);
+            }
+
+            lk.lock();
+
+            if (!ok) {
+                failed_ = true;
+            } else {
+                written_ = end;
+                if (do_sync) {
+                    synced_ = end;
+                    last_sync = now;
+                }
+            }
+            done_cv_.notify_all();
+
+            if (!waiters_.empty()) {
+                std::vector<std::pair<std::function<void(bool)>, bool>> ready;
+                takeWaiters(ready);
+
+                // 回调可能再次追加，需要在锁外执行
+                lk.unlock();
+                for (auto &waiter: ready) {
+                    waiter.first(waiter.second);
+                }
+                lk.lock();
+            }
+
+            if (failed_)
+                return;
+        }
+    }
+
+    void WriteAheadLog::takeWaiters(std::vector<std::pair<std::function<void(bool)>, bool>> &ready) {
+        // 等待者按照批次序号追加，已经落盘的是其中的前缀
+        size_t n = 0;
+        while (n < waiters_.size() && (failed_ || waiters_[n].first <= synced_)) {
+            ready.emplace_back(std::move(waiters_[n].second), waiters_[n].first <= synced_);
+            n++;
+        }
+        waiters_.erase(waiters_.begin(), waiters_.begin() + static_cast<long>(n));
+    }
+
+    void WriteAheadLog::encode(std::string &dst, long version, const std::vector<Record> &records) {
+        auto start = dst.size();
+        dst.append(kHeaderSize, '\0');
+
+        putFixed<int64_t>(dst, version);
+        putFixed<uint32_t>(dst, static_cast<uint32_t>(records.size()));
+        for (auto &record: records) {
+            putFixed<uint8_t>(dst, record.type_);
+            putFixed<uint32_t>(dst, static_cast<uint32_t>(record.key_.size()));
+            dst.append(record.key_);
+            putFixed<uint32_t>(dst, static_cast<uint32_t>(record.value_.size()));
+            dst.append(record.value_);
+        }
+
+        auto size = static_cast<uint32_t>(dst.size() - start - kHeaderSize);
+        auto crc = crc32(dst.data() + start + kHeaderSize, size);
+        std::memcpy(&dst[start], &size, 4);
+        std::memcpy(&dst[start + 4], &crc, 4);
+    }
+
+    size_t WriteAheadLog::decode(const char *data, size_t size, Batch &batch) {
+        if (size < kHeaderSize)
+            return 0;
+
+        uint32_t body_size, crc;
+        std::memcpy(&body_size, data, 4);
+        std::memcpy(&crc, data + 4, 4);
+        if (size < kHeaderSize + body_size)
+            return 0;
+
+        std::string body(data + kHeaderSize, body_size);
+        if (crc32(body.data(), body_size) != crc || !decodeBody(body, batch))
+            throw std::runtime_error("Corrupt log batch");
+        return kHeaderSize + body_size;
+    }
+
+    size_t WriteAheadLog::replay(const std::string &path, const std::function<void(Batch &)> &apply,
+                                 size_t skip) {
+        size_t valid = 0;
+        return scan(path, apply, skip, valid);
+    }
+
+    size_t WriteAheadLog::scan(const std::string &path, const std::function<void(Batch &)> &apply,
+                               size_t skip, size_t &valid) {
+        valid = 0;
+
+        std::ifstream in(path, std::ios::binary);
+        if (!in)
+            return 0;
+
+        size_t num = 0;
+        std::string body;
+        Batch batch;
+
+        while (true) {
+            char header[kHeaderSize];
+            if (!in.read(header, kHeaderSize))
+                break;
+
+            uint32_t size, crc;
+            std::memcpy(&size, header, 4);
+            std::memcpy(&crc, header + 4, 4);
+
+            body.resize(size);
+            if (!in.read(&body[0], size) || crc32(body.data(), size) != crc || !decodeBody(body, batch))
+                break;
+
+            if (apply && num >= skip)
+                apply(batch);
+
+            valid += kHeaderSize + size;
+            num++;
+        }
+        return num;
+    }
+}
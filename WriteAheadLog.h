@@ -0,0 +1,185 @@
+//
+// Created by 唐仁初 on 2022/12/19.
+//
+
+#ifndef ALGYOLO_WRITEAHEADLOG_H
+#define ALGYOLO_WRITEAHEADLOG_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace mvcc {
+
+    /// @brief Append-only write-ahead log with group commit.
+    /// @details Class WriteAheadLog records committed writes of a table. Every commit is encoded as one batch, which
+    /// carries the commit version and all records of the commit, and is protected by a checksum. Committers only copy
+    /// their batch into a shared buffer, and a single writer thread writes everything buffered with one write call and
+    /// one fdatasync, so the cost of a sync is shared by all commits arriving while the previous one is in progress.
+    /// A torn batch at the tail of the log is detected by its checksum and dropped when the log is reopened.
+    class WriteAheadLog {
+    public:
+
+        /// Describes when a commit is acknowledged
+        enum Durability {
+            /// Commit returns after its batch is synced to disk
+            sync,
+            /// Commit returns after its batch is buffered. The writer syncs at most once per sync interval, so a crash
+            /// loses at most the commits of the last interval
+            batched,
+            /// Commit returns after its batch is buffered. The writer never syncs, flushing is left to the OS
+            async
+        };
+
+        /// Describes the type of a record
+        enum RecordType : uint8_t {
+            /// Write a value
+            put = 0,
+            /// Erase a key
+            erase = 1
+        };
+
+        /// @brief One key-value change in a batch.
+        struct Record {
+            RecordType type_;
+            std::string key_;
+            std::string value_;
+        };
+
+        /// @brief All records of one commit.
+        struct Batch {
+            long version_;
+            std::vector<Record> records_;
+        };
+
+        /// Open a log file for append. The file is created if not exists, and a torn tail is truncated.
+        /// \param path Path of log file
+        /// \param durability Durability mode
+        /// \param sync_interval_ms Max interval between two syncs in batched mode
+        /// @throw std::runtime_error if the file can not be opened
+        explicit WriteAheadLog(const std::string &path, Durability durability = sync, int sync_interval_ms = 10);
+
+        /// Flush and sync all buffered batches, then stop the writer thread.
+        ~WriteAheadLog();
+
+        WriteAheadLog(const WriteAheadLog &other) = delete;
+
+        WriteAheadLog &operator=(const WriteAheadLog &other) = delete;
+
+        /// Append a batch to the log. In sync mode the function blocks until the batch is on disk.
+        /// \param version Commit version
+        /// \param records Records of the commit
+        /// \return False if the log has failed to write
+        /// @note Thread safe
+        bool append(long version, const std::vector<Record> &records);
+
+        /// Append a batch to the log without blocking. done is called once the batch is durable as the durability mode
+        /// defines: after it is synced in sync mode, or right after it is buffered in other modes.
+        /// \param version Commit version
+        /// \param records Records of the commit
+        /// \param done Called with true once the batch is durable, or false if the log fails before. In sync mode it
+        /// runs on the writer thread, so it should be short
+        /// \return False if the log has already failed, and done is not called
+        /// @note Thread safe
+        bool append(long version, const std::vector<Record> &records, std::function<void(bool)> done);
+
+        /// Block until all batches appended before are written and synced, whatever the durability mode is.
+        /// \return False if the log has failed to write
+        /// @note Thread safe
+        bool flush();
+
+        /// Get the durability mode.
+        /// \return Durability mode
+        [[nodiscard]] Durability durability() const;
+
+        /// Num of batches in the log, including the ones found when the log was opened. It is also the index of the next
+        /// batch to append.
+        /// \return num
+        [[nodiscard]] size_t batchNum() const;
+
+        /// Num of write calls issued by writer thread. Each of them carries one or more batches.
+        /// \return num
+        [[nodiscard]] size_t writeNum() const;
+
+        /// Num of fdatasync calls issued by writer thread.
+        /// \return num
+        [[nodiscard]] size_t syncNum() const;
+
+        /// Read a log file and call apply for each batch in append order. Reading stops at the first torn or corrupt
+        /// batch.
+        /// \param path Path of log file
+        /// \param apply Callback of each batch. The records of the batch can be moved out
+        /// \param skip Num of batches at the head of the log not to apply, such as the ones covered by a checkpoint
+        /// \return Num of batches read including skipped ones, 0 if the file does not exist
+        static size_t replay(const std::string &path, const std::function<void(Batch &)> &apply,
+                             size_t skip = 0);
+
+        /// Encode a batch in log format and append it to dst, such as to ship it to a follower.
+        /// \param dst Encoded batch is appended
+        /// \param version Commit version
+        /// \param records Records of the commit
+        static void encode(std::string &dst, long version, const std::vector<Record> &records);
+
+        /// Decode the batch in log format at the head of data.
+        /// \param data Encoded data
+        /// \param size Size of data
+        /// \param batch Decoded batch
+        /// \return Length of the batch, 0 if data does not hold a whole batch yet
+        /// @throw std::runtime_error if the batch is corrupt
+        static size_t decode(const char *data, size_t size, Batch &batch);
+
+    private:
+
+        /// Writer loop. Writes buffered batches and syncs them according to durability mode.
+        void work();
+
+        /// Take the callbacks of async appends which are synced, or all of them if the log has failed. Must be called
+        /// with mutex held.
+        /// \param ready Taken callbacks and whether their batches are synced
+        void takeWaiters(std::vector<std::pair<std::function<void(bool)>, bool>> &ready);
+
+        /// Internal interface. Read valid batches of a log file.
+        /// \param path Path of log file
+        /// \param apply Callback of each batch, can be empty
+        /// \param skip Num of batches at the head not to apply
+        /// \param valid Length of the valid prefix of the file
+        /// \return Num of batches read
+        static size_t scan(const std::string &path, const std::function<void(Batch &)> &apply, size_t skip,
+                           size_t &valid);
+
+    private:
+
+        using Clock = std::chrono::steady_clock;
+
+        int fd_ = -1;
+        Durability durability_;
+        Clock::duration sync_interval_;
+
+        mutable std::mutex mtx_;
+        std::condition_variable work_cv_;   // 有新数据或者需要同步时唤醒写线程
+        std::condition_variable done_cv_;   // 写入或同步完成时唤醒提交者
+
+        std::string buffer_;        // 等待写入的批次
+        uint64_t appended_ = 0;     // 已追加的批次序号，从打开时已有的批次数开始
+        uint64_t written_ = 0;      // 已写入的批次序号
+        uint64_t synced_ = 0;       // 已同步到磁盘的批次序号
+        uint64_t sync_request_ = 0; // flush 要求同步到的批次序号
+        bool failed_ = false;
+        bool stop_ = false;
+
+        std::vector<std::pair<uint64_t, std::function<void(bool)>>> waiters_;   // 同步模式下等待落盘的异步追加
+
+        std::atomic<size_t> write_num_ = 0;
+        std::atomic<size_t> sync_num_ = 0;
+
+        std::thread writer_;
+    };
+}
+
+#endif //ALGYOLO_WRITEAHEADLOG_H
@@ -7,9 +7,16 @@
 #include "../OpCoordinator.h"
 #include "../Operation.h"
 #include "../ValueTable.h"
+#include "../Replication.h"
 
 #include <gtest/gtest.h>
 #include <map>
+#include <algorithm>
+#include <filesystem>
+#include <future>
+#include <random>
+#include <sys/socket.h>
+#include <unistd.h>
 
 using namespace mvcc;
 
@@ -281,4 +288,727 @@ TEST(SPEED_TEST,SINGLE_KEY_TEST) {
 
     std::cout << "Map time ms : " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()
               << std::endl;
-}
\ No newline at end of file
+}
+TEST(SPEED_TEST,POINT_READ_TEST) {
+    size_t size = 200000;
+
+    std::vector<std::string> keys(size);
+    for (int i = 0; i < size; i++) {
+        keys[i] = std::to_string(i);
+    }
+
+    ValueTable::Options options;
+    ValueTable table(options);
+    options.hash_index = true;
+    ValueTable indexed(options);
+
+    for (int i = 0; i < size; i++) {
+        table.emplace(keys[i], "1");
+        indexed.emplace(keys[i], "1");
+    }
+
+    auto start = std::chrono::system_clock::now();
+    for (int i = 0; i < size; i++) {
+        table.read(keys[i]);
+    }
+    auto end = std::chrono::system_clock::now();
+
+    std::cout << "SkipList point read time ms : "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << std::endl;
+
+    start = std::chrono::system_clock::now();
+    for (int i = 0; i < size; i++) {
+        indexed.read(keys[i]);
+    }
+    end = std::chrono::system_clock::now();
+
+    std::cout << "HashIndex point read time ms : "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << std::endl;
+}
+
+TEST(SPEED_TEST,MISS_READ_TEST) {
+    size_t size = 200000;
+
+    std::vector<std::string> keys(size), misses(size);
+    for (int i = 0; i < size; i++) {
+        keys[i] = std::to_string(i);
+        misses[i] = std::to_string(i) + "_";
+    }
+
+    ValueTable::Options options;
+    ValueTable table(options);
+    options.filter = true;
+    ValueTable filtered(options);
+
+    for (int i = 0; i < size; i++) {
+        table.emplace(keys[i], "1");
+        filtered.emplace(keys[i], "1");
+    }
+
+    auto start = std::chrono::system_clock::now();
+    for (int i = 0; i < size; i++) {
+        table.exist(misses[i]);
+    }
+    auto end = std::chrono::system_clock::now();
+
+    std::cout << "SkipList miss time ms : "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << std::endl;
+
+    start = std::chrono::system_clock::now();
+    for (int i = 0; i < size; i++) {
+        filtered.exist(misses[i]);
+    }
+    end = std::chrono::system_clock::now();
+
+    std::cout << "BloomFilter miss time ms : "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << std::endl;
+}
+
+TEST(SPEED_TEST,COMPACT_LATENCY_TEST) {
+    size_t size = 200000;
+
+    std::vector<std::string> keys(size);
+    for (int i = 0; i < size; i++) {
+        keys[i] = std::to_string(i);
+    }
+
+    for (auto threshold: {ValueTable::never, ValueTable::low}) {
+        ValueTable::Options options;
+        options.threshold = threshold;
+        ValueTable table(options);
+
+        std::vector<long> latency;
+        latency.reserve(size);
+
+        // 写入的同时删除一半的键，触发压缩
+        for (int i = 0; i < size; i++) {
+            auto start = std::chrono::steady_clock::now();
+            table.emplace(keys[i], "1");
+            auto end = std::chrono::steady_clock::now();
+            latency.emplace_back(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+
+            if (i % 2 == 1)
+                table.erase(keys[i - 1]);
+        }
+        table.waitForCompaction();
+
+        std::sort(latency.begin(), latency.end());
+        std::cout << (threshold == ValueTable::never ? "Never" : "Low") << " compact write p50 ns : "
+                  << latency[size / 2] << " p99 ns : " << latency[size * 99 / 100] << " max ns : " << latency.back()
+                  << std::endl;
+    }
+}
+
+TEST(SPEED_TEST,MEMORY_BUDGET_TEST) {
+    size_t size = 20000;
+    std::string payload(100, 'x');
+
+    std::vector<std::string> keys(size);
+    for (int i = 0; i < size; i++) {
+        keys[i] = std::to_string(i);
+    }
+
+    for (size_t budget: {size_t(0), size_t(12 * 1024 * 1024)}) {
+        ValueTable::Options options;
+        options.memory_budget = budget;
+        options.vacuum_interval_ms = 10;
+        ValueTable table(options);
+
+        for (auto &key: keys) {
+            table.emplace(key, payload);
+        }
+
+        size_t peak = 0;
+        auto start = std::chrono::steady_clock::now();
+        {
+            // 长时间的快照读期间，所有的旧版本都无法清理
+            auto it = table.begin();
+            for (int round = 0; round < 5; round++) {
+                for (auto &key: keys) {
+                    table.update(key, payload);
+                }
+                peak = std::max(peak, table.memoryUse());
+            }
+        }
+
+        // 快照结束后只更新热点键，冷数据的旧版本只能由后台清理
+        for (int round = 0; round < 20; round++) {
+            for (int i = 0; i < size / 20; i++) {
+                table.update(keys[i], payload);
+            }
+            peak = std::max(peak, table.memoryUse());
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+        std::cout << "Budget " << budget / 1024 << " KB : peak memory KB : " << peak / 1024 << " final memory KB : "
+                  << table.memoryUse() / 1024 << " stalled writes : " << table.stalledWriteNum() << " time ms : "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << std::endl;
+    }
+}
+
+TEST(SPEED_TEST,WAL_TEST) {
+    size_t threads = 8;
+    size_t size = 2000;     // 每个线程的提交次数
+    auto path = (std::filesystem::temp_directory_path() / "mvcc_wal_speed_test.log").string();
+
+    // -1 表示不记录日志
+    for (int mode: {-1, int(WriteAheadLog::sync), int(WriteAheadLog::batched), int(WriteAheadLog::async)}) {
+        std::filesystem::remove(path);
+
+        ValueTable::Options options;
+        if (mode >= 0) {
+            options.wal_path = path;
+            options.wal_durability = static_cast<WriteAheadLog::Durability>(mode);
+        }
+
+        std::chrono::steady_clock::duration cost{};
+        {
+            ValueTable table(options);
+
+            auto start = std::chrono::steady_clock::now();
+            std::vector<std::thread> workers;
+            for (size_t t = 0; t < threads; t++) {
+                workers.emplace_back([&table, t, size] {
+                    for (size_t i = 0; i < size; i++) {
+                        table.update(std::to_string(t * size + i), "value");
+                    }
+                });
+            }
+            for (auto &worker: workers) {
+                worker.join();
+            }
+            table.flushLog();
+            cost = std::chrono::steady_clock::now() - start;
+        }
+
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(cost).count();
+        const char *names[] = {"None", "Sync", "Batched", "Async"};
+        std::cout << names[mode + 1] << " log : " << threads * size << " commits in ms : " << ms
+                  << " commits per second : " << static_cast<long>(threads * size) * 1000 / std::max<long>(ms, 1)
+                  << std::endl;
+    }
+
+    // 对比单线程与多线程回放日志的耗时
+    for (size_t load_threads: {1, 0}) {
+        ValueTable::Options options;
+        options.wal_path = path;
+        options.load_threads = load_threads;
+
+        auto start = std::chrono::steady_clock::now();
+        ValueTable table(options);
+        auto end = std::chrono::steady_clock::now();
+
+        EXPECT_EQ(table.size(), threads * size);
+        std::cout << (load_threads == 1 ? "Single thread" : "Parallel") << " replay of " << threads * size
+                  << " commits in ms : " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()
+                  << std::endl;
+    }
+    std::filesystem::remove(path);
+}
+
+TEST(SPEED_TEST,CHECKPOINT_TEST) {
+    size_t size = 200000;
+    auto path = (std::filesystem::temp_directory_path() / "mvcc_checkpoint_speed_test.ckpt").string();
+
+    std::vector<std::string> keys(size);
+    for (int i = 0; i < size; i++) {
+        keys[i] = std::to_string(i);
+    }
+
+    ValueTable table;
+    for (auto &key: keys) {
+        table.emplace(key, "value");
+    }
+
+    // 对比检查点进行时与不进行时的前台写入耗时
+    for (bool checkpoint: {false, true}) {
+        std::future<bool> written;
+        auto checkpoint_start = std::chrono::steady_clock::now();
+        if (checkpoint)
+            written = table.checkpoint(path);
+
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < size / 2; i++) {
+            table.update(keys[i], "new");
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        std::cout << (checkpoint ? "With" : "Without") << " checkpoint write time ms : "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+        if (checkpoint) {
+            EXPECT_TRUE(written.get());
+            std::cout << " checkpoint time ms : " << std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now() - checkpoint_start).count();
+        }
+        std::cout << std::endl;
+    }
+
+    // 对比单线程与多线程加载检查点的耗时
+    ValueTable::Options options;
+    options.checkpoint_path = path;
+    for (size_t threads: {1, 0}) {
+        options.load_threads = threads;
+        auto start = std::chrono::steady_clock::now();
+        ValueTable loaded(options);
+        auto end = std::chrono::steady_clock::now();
+
+        EXPECT_EQ(loaded.size(), size);
+        std::cout << (threads == 1 ? "Single thread" : "Parallel") << " checkpoint load time ms : "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << std::endl;
+    }
+    std::filesystem::remove(path);
+}
+
+TEST(SPEED_TEST,VALUE_LOG_TEST) {
+    size_t size = 20000;
+    std::string payload(1000, 'v');
+
+    ValueTable::Options options;
+    options.value_log_path = (std::filesystem::temp_directory_path() / "mvcc_value_log_speed_test.vlog").string();
+    options.memory_budget = 8 << 20;
+    options.stall_timeout_ms = 5;
+    options.vacuum_interval_ms = 0;
+    ValueTable table(options);
+
+    std::vector<std::string> keys(size);
+    for (size_t i = 0; i < size; i++) {
+        keys[i] = std::to_string(i);
+        table.emplace(keys[i], payload);
+    }
+
+    // 热点键持续被读取，其余的键不再访问
+    std::mt19937 rng(0);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (table.memoryUse() > options.memory_budget && std::chrono::steady_clock::now() < deadline) {
+        for (size_t i = 0; i < 100; i++) {
+            table.read(keys[i]);
+        }
+        table.vacuum();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::cout << "Data size MB : " << size * payload.size() / (1 << 20) << " memory use MB : "
+              << table.memoryUse() / (1 << 20) << " spilled values : " << table.spilledNum() << std::endl;
+
+    // 对比热点键与随机键的读取耗时
+    for (size_t range: {size_t(100), size}) {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < 100000; i++) {
+            table.read(keys[rng() % range]);
+        }
+        auto end = std::chrono::steady_clock::now();
+        std::cout << (range == size ? "Random" : "Hot") << " key 100000 reads time ms : "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << std::endl;
+    }
+}
+
+TEST(SPEED_TEST,CHANGE_STREAM_TEST) {
+    size_t size = 100000;
+    std::vector<std::string> keys(size);
+    for (size_t i = 0; i < size; i++) {
+        keys[i] = std::to_string(i);
+    }
+
+    // 对比开启变更流前后的写入耗时，订阅者同时读取变更
+    for (bool enabled: {false, true}) {
+        ValueTable::Options options;
+        options.change_stream = enabled;
+        ValueTable table(options);
+
+        std::atomic<bool> stop = false;
+        size_t received = 0;
+        auto consumer = std::async(std::launch::async, [&] {
+            if (!enabled)
+                return;
+            long cursor = 0;
+            std::vector<ChangeStream::Change> changes;
+            while (!stop || received < size) {
+                changes.clear();
+                if (!table.pollChanges(cursor, changes, 1024, 10))
+                    cursor = table.lastChangeVersion();
+                received += changes.size();
+                if (stop && changes.empty())
+                    break;
+            }
+        });
+
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < size; i++) {
+            table.update(keys[i], "value");
+        }
+        auto end = std::chrono::steady_clock::now();
+        stop = true;
+        consumer.get();
+
+        std::cout << (enabled ? "With" : "Without") << " change stream " << size << " writes time ms : "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()
+                  << " changes received : " << received << std::endl;
+    }
+}
+
+TEST(SPEED_TEST,REPLICATION_TEST) {
+    size_t size = 100000;
+    std::vector<std::string> keys(size);
+    for (size_t i = 0; i < size; i++) {
+        keys[i] = std::to_string(i);
+    }
+
+    ValueTable::Options options;
+    options.change_stream = true;
+    options.change_history = size;
+    ValueTable primary(options);
+
+    int fds[2];
+    ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    {
+        Follower follower(fds[1]);
+        LogShipper shipper(primary, fds[0], 0);
+
+        // 统计主节点写入耗时，以及跟随者追上主节点的耗时
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < size; i++) {
+            primary.update(keys[i], "value");
+        }
+        auto written = std::chrono::steady_clock::now();
+
+        long version;
+        while (follower.read(keys.back(), version).empty() && !shipper.failed()) {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        auto applied = std::chrono::steady_clock::now();
+
+        std::cout << "Primary " << size << " writes time ms : "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(written - start).count()
+                  << " follower caught up time ms : "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(applied - start).count()
+                  << " batches shipped : " << shipper.batchNum() << " local commits : " << follower.applyNum()
+                  << std::endl;
+    }
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
+
+TEST(SPEED_TEST,MULTI_GET_TEST) {
+    size_t size = 500000;
+    size_t batch = 256;
+
+    std::vector<std::string> keys(size);
+    for (size_t i = 0; i < size; i++) {
+        keys[i] = std::to_string(i);
+    }
+
+    for (bool hash_index: {false, true}) {
+        ValueTable::Options options;
+        options.hash_index = hash_index;
+        ValueTable table(options);
+        for (size_t i = 0; i < size; i++) {
+            table.emplace(keys[i], "value");
+        }
+
+        // 对比逐个读取与批量读取同样的随机键
+        std::mt19937 rng(0);
+        std::vector<std::vector<std::string>> batches(1000);
+        for (auto &b: batches) {
+            for (size_t i = 0; i < batch; i++) {
+                b.emplace_back(keys[rng() % size]);
+            }
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        size_t found = 0;
+        for (auto &b: batches) {
+            for (auto &key: b) {
+                found += !table.read(key).empty();
+            }
+        }
+        auto mid = std::chrono::steady_clock::now();
+        for (auto &b: batches) {
+            for (auto &value: table.multiGet(b)) {
+                found += !value.empty();
+            }
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        std::cout << (hash_index ? "Hash index" : "Skip list") << " " << batches.size() * batch
+                  << " reads time ms : " << std::chrono::duration_cast<std::chrono::milliseconds>(mid - start).count()
+                  << " multiGet time ms : " << std::chrono::duration_cast<std::chrono::milliseconds>(end - mid).count()
+                  << " found : " << found << std::endl;
+    }
+}
+
+TEST(SPEED_TEST,SERIALIZABLE_TEST) {
+    size_t threads = 4;
+    size_t size = 20000;
+
+    // 对比可串行化事务与外部全局锁保护的读改写，每个线程修改各自的一组键
+    for (bool global_lock: {true, false}) {
+        ValueTable table;
+        std::mutex mtx;
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::future<void>> workers;
+        for (size_t t = 0; t < threads; t++) {
+            workers.emplace_back(std::async(std::launch::async, [&, t] {
+                for (size_t i = 0; i < size; i++) {
+                    auto key = std::to_string(t) + "-" + std::to_string(i % 100);
+                    auto body = [&key](const ValueTable::TransactionRead &read,
+                                       std::vector<std::pair<std::string, std::string>> &writes) {
+                        writes.emplace_back(key, read(key) + "v");
+                        return true;
+                    };
+
+                    if (global_lock) {
+                        std::lock_guard<std::mutex> lg(mtx);
+                        table.transaction(body, ValueTable::snapshot);
+                    } else {
+                        while (!table.transaction(body)) {}
+                    }
+                }
+            }));
+        }
+        for (auto &worker: workers) {
+            worker.get();
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        std::cout << (global_lock ? "Global lock" : "Serializable") << " " << threads * size
+                  << " read-modify-write time ms : "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()
+                  << " conflicts : " << table.conflictNum() << std::endl;
+    }
+}
+
+TEST(SPEED_TEST,INTERACTIVE_TRANSACTION_TEST) {
+    size_t threads = 4;
+    size_t size = 500;
+
+    // 事务在读取与提交之间有一段处理时间，对比处理期间一直持有锁与只在提交时加锁
+    for (bool hold_lock: {true, false}) {
+        ValueTable table;
+        std::mutex mtx;
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::future<void>> workers;
+        for (size_t t = 0; t < threads; t++) {
+            workers.emplace_back(std::async(std::launch::async, [&, t] {
+                for (size_t i = 0; i < size; i++) {
+                    auto prefix = std::to_string(t) + "-";
+                    auto key = prefix + std::to_string(i % 100);
+
+                    std::unique_lock<std::mutex> lk(mtx, std::defer_lock);
+                    if (hold_lock)
+                        lk.lock();
+
+                    while (true) {
+                        auto transaction = table.startTransaction();
+                        auto records = transaction.scan(prefix, prefix + "~", 10);
+                        transaction.put(key, transaction.get(key) + std::to_string(records.size()));
+                        std::this_thread::sleep_for(std::chrono::microseconds(100));
+                        if (transaction.commit())
+                            break;
+                    }
+                }
+            }));
+        }
+        for (auto &worker: workers) {
+            worker.get();
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        std::cout << (hold_lock ? "Lock held while thinking" : "Lock at commit") << " " << threads * size
+                  << " interactive transactions time ms : "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()
+                  << " conflicts : " << table.conflictNum() << std::endl;
+    }
+}
+
+TEST(SPEED_TEST,LOCK_ORDER_TEST) {
+    size_t size = 20000;
+
+    // 两个线程写入同一组键，对比相同顺序与相反顺序，统计失败重试的次数
+    for (bool opposite: {false, true}) {
+        ValueTable table;
+        std::atomic<size_t> retries = 0;
+
+        auto run = [&table, &retries, size](std::vector<std::string> keys) {
+            for (size_t i = 0; i < size; i++) {
+                std::vector<std::pair<std::string, std::string>> kvs;
+                for (auto &key: keys) {
+                    kvs.emplace_back(key, std::to_string(i));
+                }
+                while (!table.transaction(kvs)) {
+                    retries.fetch_add(1);
+                }
+            }
+        };
+
+        auto start = std::chrono::steady_clock::now();
+        auto first = std::async(std::launch::async, run, std::vector<std::string>{"a", "b", "c", "d"});
+        auto second = std::async(std::launch::async, run, opposite ? std::vector<std::string>{"d", "c", "b", "a"}
+                                                                   : std::vector<std::string>{"a", "b", "c", "d"});
+        first.get();
+        second.get();
+        auto end = std::chrono::steady_clock::now();
+
+        std::cout << (opposite ? "Opposite order" : "Same order") << " " << 2 * size << " transactions time ms : "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()
+                  << " retries : " << retries.load() << std::endl;
+    }
+}
+
+TEST(SPEED_TEST,GROUP_COMMIT_TEST) {
+    size_t threads = 8;
+    size_t size = 5000;
+    auto path = (std::filesystem::temp_directory_path() / "mvcc_group_commit_speed.log").string();
+
+    // 多个线程并发提交小事务，对比每个事务各自分配版本与组提交
+    for (bool wal: {false, true}) {
+        for (bool group: {false, true}) {
+            std::filesystem::remove(path);
+            ValueTable::Options options;
+            options.group_commit = group;
+            if (wal)
+                options.wal_path = path;
+
+            auto start = std::chrono::steady_clock::now();
+            {
+                ValueTable table(options);
+                std::vector<std::future<void>> workers;
+                for (size_t t = 0; t < threads; t++) {
+                    workers.emplace_back(std::async(std::launch::async, [&table, t, size] {
+                        for (size_t i = 0; i < size; i++) {
+                            auto key = std::to_string(t) + "-" + std::to_string(i);
+                            table.transaction({{key, "v"}});
+                        }
+                    }));
+                }
+                for (auto &worker: workers) {
+                    worker.get();
+                }
+                auto end = std::chrono::steady_clock::now();
+
+                std::cout << (group ? "Group commit" : "Single commit") << (wal ? " with log " : " ")
+                          << threads * size << " transactions time ms : "
+                          << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()
+                          << " groups : " << table.groupCommitNum() << std::endl;
+            }
+        }
+    }
+    std::filesystem::remove(path);
+}
+
+TEST(SPEED_TEST,PARALLEL_BULK_WRITE_TEST) {
+    size_t size = 200000;
+
+    std::vector<std::pair<std::string, std::string>> kvs;
+    std::mt19937 rng(0);
+    for (size_t i = 0; i < size; i++) {
+        kvs.emplace_back(std::to_string(rng()), std::to_string(i));
+    }
+
+    // 对比单线程批量写入与按哈希分区的并行批量写入
+    for (size_t partitions: {1, 2, 4, 8}) {
+        ValueTable table;
+
+        auto start = std::chrono::steady_clock::now();
+        if (partitions == 1)
+            table.bulkWrite(kvs);
+        else
+            table.parallelBulkWrite(kvs, partitions);
+        auto end = std::chrono::steady_clock::now();
+
+        std::cout << "Bulk write with " << partitions << " partitions " << size << " records time ms : "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << std::endl;
+    }
+}
+
+TEST(SPEED_TEST,SMALL_TRANSACTION_TEST) {
+    size_t size = 200000;
+
+    // 小事务的写入记录保存在内联数组中，除了版本节点之外不分配内存
+    for (size_t writes: {1, 8, 16}) {
+        std::vector<Value> nodes(writes);
+
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < size; i++) {
+            auto transaction = Coordinator.startTransaction();
+            for (auto &node: nodes) {
+                transaction.appendOperation(&node, "value");
+            }
+            transaction.tryCommit();
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        std::cout << size << " transactions of " << writes << " writes time ms : "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << std::endl;
+    }
+}
+
+TEST(SPEED_TEST,ASYNC_COMMIT_TEST) {
+    size_t size = 2000;
+    auto path = (std::filesystem::temp_directory_path() / "mvcc_async_commit_speed.log").string();
+
+    // 同步日志模式下单个调用者连续提交，对比等待每个事务落盘与异步提交之后统一等待结果
+    for (bool async: {false, true}) {
+        std::filesystem::remove(path);
+        ValueTable::Options options;
+        options.wal_path = path;
+
+        ValueTable table(options);
+        auto start = std::chrono::steady_clock::now();
+
+        std::vector<std::future<bool>> futures;
+        size_t committed = 0;
+        for (size_t i = 0; i < size; i++) {
+            auto key = std::to_string(i);
+            if (async)
+                futures.emplace_back(table.transactionAsync({{key, "v"}, {"hot", key}}));
+            else
+                committed += table.transaction({{key, "v"}, {"hot", key}});
+        }
+        for (auto &future: futures) {
+            committed += future.get();
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        std::cout << (async ? "Async" : "Blocking") << " commit with sync log " << size << " transactions time ms : "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()
+                  << " committed : " << committed << " retries : " << table.asyncRetryNum() << std::endl;
+    }
+    std::filesystem::remove(path);
+}
+
+TEST(SPEED_TEST,READ_ONLY_TRANSACTION_TEST) {
+    size_t size = 1000000;
+    Value node;
+    Coordinator.startWriteOperation(&node, "value").write();
+
+    // 对比登记共享版本的快照读与公布在线程读槽位中的只读事务，线程数增加时前者在同一把锁与计数上竞争
+    for (size_t threads: {1, 2, 4}) {
+        for (bool slot: {false, true}) {
+            auto start = std::chrono::steady_clock::now();
+            std::vector<std::future<size_t>> readers;
+            for (size_t t = 0; t < threads; t++) {
+                readers.emplace_back(std::async(std::launch::async, [&node, slot, size] {
+                    size_t bytes = 0;
+                    for (size_t i = 0; i < size; i++) {
+                        if (slot)
+                            bytes += Coordinator.startReadOnlyTransaction().read(&node).size();
+                        else
+                            bytes += Coordinator.startStreamReadOperation(&node).read().size();
+                    }
+                    return bytes;
+                }));
+            }
+            for (auto &reader: readers) {
+                EXPECT_EQ(reader.get(), size * 5);
+            }
+            auto end = std::chrono::steady_clock::now();
+
+            std::cout << (slot ? "Read-only transaction " : "Registered snapshot read ") << threads << " threads "
+                      << threads * size << " reads time ms : "
+                      << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << std::endl;
+        }
+    }
+}
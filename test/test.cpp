@@ -7,8 +7,27 @@
 #include "../OpCoordinator.h"
 #include "../Operation.h"
 #include "../ValueTable.h"
+#include "../HashIndex.h"
+#include "../BloomFilter.h"
+#include "../ShardedValueTable.h"
+#include "../MaintenanceExecutor.h"
+#include "../LoadPool.h"
+#include "../WriteAheadLog.h"
+#include "../Checkpoint.h"
+#include "../BlockCache.h"
+#include "../ValueLog.h"
+#include "../ChangeStream.h"
+#include "../Replication.h"
+#include "../SmallVector.h"
 
 #include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <map>
+#include <set>
+#include <sys/socket.h>
+#include <unistd.h>
 
 using namespace mvcc;
 
@@ -87,6 +106,31 @@ TEST(MVCC_TEST,COORDINATOR_TEST){
 
 TEST(MVCC_TEST,TRANSATION_TEST){
 
+    // 读操作在提交之前开始，跳过了未提交的节点并停在更旧的节点上，之后的写入不能移出这个旧节点
+    {
+        Value node;
+        Coordinator.startWriteOperation(&node, "0").write();
+        std::vector<op::ReadOperation> reads;
+        {
+            auto transaction = Coordinator.startTransaction();
+            transaction.appendOperation(&node, "1");
+            EXPECT_TRUE(transaction.tryCommit([&](size_t) {
+                reads.push_back(Coordinator.startReadOperation(&node));
+                EXPECT_EQ(reads.back().read(), "0");
+                return true;
+            }));
+        }
+        auto held = node.memoryUse();
+        Coordinator.startWriteOperation(&node, "2").write();
+        EXPECT_GT(node.memoryUse(), held);
+        EXPECT_EQ(reads.back().read(), "1");
+
+        // 读操作结束之后可以移出
+        reads.clear();
+        Coordinator.startWriteOperation(&node, "3").write();
+        EXPECT_LE(node.memoryUse(), held);
+    }
+
     Value node1,node2,node3;
     auto transaction = Coordinator.startTransaction();
     transaction.appendOperation(&node1, "1");
@@ -133,8 +177,2122 @@ TEST(MVCC_TEST,VALUE_TABLE_TEST){
     table.emplace("22","22");
 }
 
+TEST(MVCC_TEST,REVERSE_ITERATOR_TEST){
+    SkipList<int> skipList;
+
+    EXPECT_EQ(skipList.rbegin(),skipList.rend());
+
+    skipList.insert("1", 1);
+    skipList.insert("3", 3);
+    skipList.insert("5", 5);
+
+    std::vector<int> values;
+    for (auto it = skipList.rbegin(); it != skipList.rend(); ++it) {
+        values.emplace_back(*it);
+    }
+    EXPECT_EQ(values, std::vector<int>({5, 3, 1}));
+
+    EXPECT_EQ(skipList.seekForPrev("4").key(), "3");
+    EXPECT_EQ(skipList.seekForPrev("3").key(), "3");
+    EXPECT_EQ(skipList.seekForPrev("0"), skipList.rend());
+
+    ValueTable table;
+    table.emplace("a","1");
+    table.emplace("b","2");
+    table.emplace("c","3");
+
+    auto it = table.seekForPrev("bb");
+    EXPECT_EQ(it.key(),"b");
+
+    // 迭代器使用创建时的快照版本
+    table.update("a","11");
+    ++it;
+    EXPECT_EQ(it.key(),"a");
+    EXPECT_EQ(*it,"1");
+    ++it;
+    EXPECT_EQ(it,table.rend());
+
+    std::vector<std::string> keys;
+    for (auto rit = table.rbegin(); rit != table.rend(); ++rit) {
+        keys.emplace_back(rit.key());
+    }
+    EXPECT_EQ(keys, std::vector<std::string>({"c", "b", "a"}));
+}
+
+TEST(MVCC_TEST,HASH_INDEX_TEST){
+    HashIndex<int> index(16);
+    std::vector<int> values(100);
+
+    for (int i = 0; i < 100; i++) {
+        values[i] = i;
+        EXPECT_EQ(index.insert(std::to_string(i), &values[i]), &values[i]);
+    }
+    EXPECT_EQ(index.size(), 100);
+    EXPECT_GE(index.capacity(), 200);
+
+    // 重复插入返回原有的值
+    int other = 0;
+    EXPECT_EQ(index.insert("1", &other), &values[1]);
+    EXPECT_EQ(*index.find("99"), 99);
+    EXPECT_EQ(index.find("100"), nullptr);
+
+    EXPECT_TRUE(index.erase("1"));
+    EXPECT_FALSE(index.erase("1"));
+    EXPECT_EQ(index.find("1"), nullptr);
+    EXPECT_EQ(index.insert("1", &other), &other);
+    index.reclaim();
+
+    ValueTable::Options options;
+    options.hash_index = true;
+    ValueTable table(options);
+
+    table.emplace("1","1");
+    table.emplace("2","2");
+    EXPECT_EQ(table.read("1"),"1");
+    EXPECT_TRUE(table.exist("2"));
+    table.erase("1");
+    EXPECT_FALSE(table.exist("1"));
+    EXPECT_EQ(table.read("1"),"");
+    table.emplace("1","11");
+    EXPECT_EQ(table.read("1"),"11");
+    EXPECT_EQ(table.size(),2);
+}
+
+TEST(MVCC_TEST,BLOOM_FILTER_TEST){
+    BloomFilter filter(100);
+
+    // 插入数量超过预期时会追加新的位数组
+    for (int i = 0; i < 10000; i++) {
+        filter.add(std::to_string(i));
+    }
+    for (int i = 0; i < 10000; i++) {
+        EXPECT_TRUE(filter.mayContain(std::to_string(i)));
+    }
+
+    int false_positive = 0;
+    for (int i = 10000; i < 20000; i++) {
+        false_positive += filter.mayContain(std::to_string(i));
+    }
+    EXPECT_LT(false_positive, 500);
+
+    ValueTable::Options options;
+    options.filter = true;
+    ValueTable table(options);
+
+    table.emplace("1","1");
+    table.emplace("2","2");
+    EXPECT_EQ(table.read("1"),"1");
+    EXPECT_EQ(table.read("3"),"");
+    EXPECT_FALSE(table.exist("3"));
+    EXPECT_TRUE(table.exist("2"));
+    EXPECT_EQ(table.find("3"),table.end());
+    EXPECT_EQ(table.find("2").key(),"2");
+}
+
+TEST(MVCC_TEST,SHARDED_TABLE_TEST){
+    ShardedValueTable table(4);
+
+    for (int i = 0; i < 100; i++) {
+        EXPECT_TRUE(table.emplace(std::to_string(i), std::to_string(i)));
+    }
+    EXPECT_EQ(table.size(), 100);
+    EXPECT_EQ(table.read("42"), "42");
+    EXPECT_TRUE(table.erase("42"));
+    EXPECT_FALSE(table.exist("42"));
+
+    EXPECT_TRUE(table.transaction({{"a", "1"}, {"b", "2"}, {"c", "3"}}));
+    EXPECT_EQ(table.read("b"), "2");
+
+    // 遍历结果需要按照键有序
+    auto it = table.begin();
+    std::string prev = it.key();
+    size_t count = 0;
+    for (; it != table.end(); ++it, ++count) {
+        EXPECT_LE(prev, it.key());
+        prev = it.key();
+    }
+    EXPECT_GE(count, 102);
+
+    it = table.find("a");
+    EXPECT_EQ(*it, "1");
+    ++it;
+    EXPECT_EQ(it.key(), "b");
+
+    ShardedValueTable ranged(std::vector<std::string>{"b", "d"});
+    ranged.emplace("a", "1");
+    ranged.emplace("c", "2");
+    ranged.emplace("e", "3");
+    EXPECT_EQ(ranged.shard("c").size(), 1);
+
+    std::vector<std::string> values;
+    for (auto rit = ranged.begin(); rit != ranged.end(); ++rit) {
+        values.emplace_back(*rit);
+    }
+    EXPECT_EQ(values, std::vector<std::string>({"1", "2", "3"}));
+}
+
+TEST(MVCC_TEST,COMPACT_TEST){
+    {
+        auto write = Coordinator.startWriteOperation(nullptr, "");
+        auto read = Coordinator.startReadOperation(nullptr);
+        EXPECT_GE(Coordinator.aliveOperationNum(), 2);
+    }
+    // 所有操作结束后，版本记录都会被释放
+    EXPECT_EQ(Coordinator.aliveOperationNum(), 0);
+
+    ValueTable::Options options;
+    options.threshold = ValueTable::low;
+    options.compact_step = 8;
+    options.hash_index = true;
+    options.filter = true;
+    ValueTable table(options);
+
+    for (int i = 0; i < 100; i++) {
+        table.emplace(std::to_string(i), std::to_string(i));
+    }
+
+    {
+        // 持有迭代器时压缩过程会等待该快照结束
+        auto it = table.begin();
+
+        for (int i = 0; i < 20; i++) {
+            table.erase(std::to_string(i));
+        }
+
+        // 写操作触发压缩，但是不会等待压缩完成
+        EXPECT_TRUE(table.update("50", "new"));
+        EXPECT_TRUE(table.update("new", "new"));
+        EXPECT_EQ(table.read("50"), "new");
+        EXPECT_EQ(table.read("new"), "new");
+        EXPECT_EQ(*it, "0");
+    }
+    table.waitForCompaction();
+
+    EXPECT_EQ(table.size(), 81);
+    EXPECT_FALSE(table.exist("10"));
+    EXPECT_EQ(table.read("50"), "new");
+    EXPECT_EQ(table.read("new"), "new");
+    EXPECT_EQ(table.read("99"), "99");
+
+    size_t count = 0;
+    for (auto pos = table.begin(); pos != table.end(); ++pos) {
+        count++;
+    }
+    EXPECT_EQ(count, 81);
+}
+
+TEST(MVCC_TEST,MEMTABLE_TEST){
+    ValueTable table;
+
+    for (int i = 0; i < 10; i++) {
+        table.emplace(std::to_string(i), std::to_string(i));
+    }
+
+    // 轮转之后新的写操作进入新的活跃表，读操作可以看到所有内存表
+    table.rotate();
+    EXPECT_EQ(table.memtableNum(), 2);
+    table.rotate();
+    EXPECT_EQ(table.memtableNum(), 2);  // 空的活跃表不会轮转
+
+    table.update("5", "new");
+    table.emplace("10", "10");
+    EXPECT_EQ(table.read("5"), "new");
+    EXPECT_EQ(table.read("3"), "3");
+    EXPECT_EQ(table.read("10"), "10");
+
+    // 删除会作用于所有内存表
+    table.erase("5");
+    EXPECT_FALSE(table.exist("5"));
+    table.update("5", "again");
+    EXPECT_EQ(table.read("5"), "again");
+
+    // 同一个键在多个内存表中只会被遍历一次，并且读取到最新的版本
+    size_t count = 0;
+    for (auto it = table.begin(); it != table.end(); ++it) {
+        if (it.key() == "5") {
+            EXPECT_EQ(*it, "again");
+        }
+        count++;
+    }
+    EXPECT_EQ(count, 11);
+
+    count = 0;
+    for (auto it = table.rbegin(); it != table.rend(); ++it) {
+        count++;
+    }
+    EXPECT_EQ(count, 11);
+
+    {
+        auto it = table.find("3");
+        EXPECT_EQ(it.key(), "3");
+        ++it;
+        EXPECT_EQ(it.key(), "4");
+    }
+
+    // 活跃表写满之后自动轮转，不可变表在后台合并到基础表
+    ValueTable::Options options;
+    options.memtable_size = 16;
+    options.hash_index = true;
+    options.filter = true;
+    ValueTable small(options);
+
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < 100; i++) {
+            small.update(std::to_string(i), std::to_string(round));
+        }
+    }
+    small.waitForCompaction();
+    small.compact();
+    small.waitForCompaction();
+
+    EXPECT_LE(small.memtableNum(), 2);
+    for (int i = 0; i < 100; i++) {
+        EXPECT_EQ(small.read(std::to_string(i)), "2");
+    }
+
+    count = 0;
+    for (auto pos = small.begin(); pos != small.end(); ++pos) {
+        EXPECT_EQ(*pos, "2");
+        count++;
+    }
+    EXPECT_EQ(count, 100);
+}
+
+TEST(MVCC_TEST,VERSION_WAIT_TEST){
+    // 没有存活版本时不会阻塞
+    Coordinator.waitVersionRelease(Coordinator.fenceVersion());
+
+    std::atomic<bool> released = false;
+    std::thread waiter;
+    {
+        auto read = Coordinator.startReadOperation(nullptr);
+        auto fence = Coordinator.fenceVersion();
+
+        waiter = std::thread([&released, fence] {
+            Coordinator.waitVersionRelease(fence);
+            released = true;
+        });
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        EXPECT_FALSE(released.load());
+    }
+
+    // 读操作结束后等待者立即被唤醒
+    auto start = std::chrono::steady_clock::now();
+    waiter.join();
+    EXPECT_TRUE(released.load());
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(50));
+}
+
+TEST(MVCC_TEST,MAINTENANCE_TEST){
+    int owner = 0, other = 0;
+    std::mutex mtx;
+    std::vector<int> order;
+
+    // 同一所有者的任务串行执行，高优先级的任务先执行
+    std::promise<void> gate;
+    auto blocked = gate.get_future().share();
+    Maintenance.submit(&owner, MaintenanceExecutor::normal, [blocked] { blocked.wait(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    for (int i = 0; i < 3; i++) {
+        Maintenance.submit(&owner, MaintenanceExecutor::low, [&, i] {
+            std::lock_guard<std::mutex> lg(mtx);
+            order.emplace_back(10 + i);
+        });
+    }
+    Maintenance.submit(&owner, MaintenanceExecutor::high, [&] {
+        std::lock_guard<std::mutex> lg(mtx);
+        order.emplace_back(0);
+    });
+    EXPECT_EQ(Maintenance.queueDepth(MaintenanceExecutor::low), 3);
+    EXPECT_EQ(Maintenance.queueDepth(MaintenanceExecutor::high), 1);
+
+    // 其他所有者的任务不会被阻塞
+    std::promise<void> done;
+    Maintenance.submit(&other, MaintenanceExecutor::low, [&done] { done.set_value(); });
+    EXPECT_EQ(done.get_future().wait_for(std::chrono::seconds(1)), std::future_status::ready);
+
+    gate.set_value();
+    Maintenance.cancel(&other);
+    while (Maintenance.queueDepth(MaintenanceExecutor::low) != 0 || Maintenance.runningNum() != 0) {
+        std::this_thread::yield();
+    }
+    {
+        std::lock_guard<std::mutex> lg(mtx);
+        EXPECT_EQ(order, std::vector<int>({0, 10, 11, 12}));
+    }
+
+    // 限速之后任务的开始时间被拉开
+    Maintenance.setRateLimit(&owner, 50);
+    std::atomic<int> count = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 5; i++) {
+        Maintenance.submit(&owner, MaintenanceExecutor::normal, [&count] { count++; });
+    }
+    while (count.load() != 5) {
+        std::this_thread::yield();
+    }
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(70));
+    Maintenance.cancel(&owner);
+
+    // 清理不再写入的值的过期版本
+    ValueTable table;
+    table.emplace("key", "1");
+    table.update("key", "2");
+    table.vacuum();
+    table.erase("key");
+    EXPECT_EQ(table.read("key"), "");
+}
+
+TEST(MVCC_TEST,MEMORY_BUDGET_TEST){
+    std::string payload(100, 'x');
+
+    ValueTable table;
+    auto empty = table.memoryUse();
+
+    for (int i = 0; i < 1000; i++) {
+        table.emplace(std::to_string(i), payload);
+    }
+    auto filled = table.memoryUse();
+    EXPECT_GT(filled - empty, 1000 * payload.size());
+
+    {
+        // 持有快照时旧版本无法被写操作清理
+        auto it = table.begin();
+        for (int round = 0; round < 4; round++) {
+            for (int i = 0; i < 1000; i++) {
+                table.update(std::to_string(i), payload);
+            }
+        }
+        EXPECT_GT(table.memoryUse(), filled + 4 * 1000 * payload.size());
+    }
+
+    // 不再写入的值由后台任务清理
+    table.vacuum();
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (table.memoryUse() > filled + 1000 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_LE(table.memoryUse(), filled + 1000);
+
+    // 压缩之后已删除节点的内存被释放
+    for (int i = 0; i < 1000; i++) {
+        table.erase(std::to_string(i));
+    }
+    table.compact();
+    table.waitForCompaction();
+    EXPECT_LT(table.memoryUse() - empty, 1000);
+
+    // 超出预算时写操作被限流，后台清理之后内存回落到预算附近
+    ValueTable::Options options;
+    options.memory_budget = 128 * 1024;
+    options.stall_timeout_ms = 5;
+    options.vacuum_interval_ms = 0;
+    options.maintenance_rate = 10;      // 限速之后后续的清理任务在排队期间一定会阻塞写操作
+    ValueTable budget_table(options);
+
+    for (int i = 0; i < 200; i++) {
+        budget_table.emplace(std::to_string(i), payload);
+    }
+    {
+        auto it = budget_table.begin();
+        for (int round = 0; round < 4 && budget_table.stalledWriteNum() == 0; round++) {
+            for (int i = 0; i < 200; i++) {
+                EXPECT_TRUE(budget_table.update(std::to_string(i), payload));
+            }
+        }
+    }
+    EXPECT_GT(budget_table.stalledWriteNum(), 0);
+
+    budget_table.update("0", payload);
+    deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (budget_table.memoryUse() > options.memory_budget && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_LE(budget_table.memoryUse(), options.memory_budget);
+}
+
 int main(int argc,char *argv[]){
     testing::InitGoogleTest(&argc,argv);
 
     return RUN_ALL_TESTS();
-}
\ No newline at end of file
+}
+
+TEST(MVCC_TEST,WAL_TEST){
+    auto path = (std::filesystem::temp_directory_path() / "mvcc_wal_test.log").string();
+    std::filesystem::remove(path);
+
+    ValueTable::Options options;
+    options.wal_path = path;
+
+    {
+        ValueTable table(options);
+        table.emplace("1", "1");
+        table.update("1", "2");
+        EXPECT_TRUE(table.transaction({{"2", "2"}, {"3", "3"}}));
+        EXPECT_TRUE(table.bulkWrite({{"4", "4"}, {"5", "5"}}));
+        table.erase("3");
+    }
+
+    // 每次提交是一个批次
+    std::vector<WriteAheadLog::Batch> batches;
+    EXPECT_EQ(WriteAheadLog::replay(path, [&batches](const WriteAheadLog::Batch &batch) {
+        batches.push_back(batch);
+    }), 5);
+    EXPECT_EQ(batches[2].records_.size(), 2);
+    EXPECT_EQ(batches[4].records_[0].type_, WriteAheadLog::erase);
+
+    // 单线程与多线程回放的结果一致，回放之后分配的版本号大于日志中的版本号
+    for (size_t threads: {1, 4}) {
+        options.load_threads = threads;
+        ValueTable table(options);
+        EXPECT_EQ(table.read("1"), "2");
+        EXPECT_EQ(table.read("2"), "2");
+        EXPECT_FALSE(table.exist("3"));
+        EXPECT_EQ(table.read("4"), "4");
+        EXPECT_GE(Coordinator.getNewestVersion(), batches.back().version_);
+    }
+    auto restored = Coordinator.getNewestVersion() + 100;
+    Coordinator.restoreVersion(restored);
+    Coordinator.restoreVersion(restored - 50);
+    EXPECT_EQ(Coordinator.getNewestVersion(), restored);
+
+    // 重新打开时回放日志
+    {
+        ValueTable table(options);
+        EXPECT_EQ(table.read("1"), "2");
+        EXPECT_EQ(table.read("2"), "2");
+        EXPECT_FALSE(table.exist("3"));
+        EXPECT_EQ(table.read("5"), "5");
+        table.update("6", "6");
+    }
+
+    // 写了一半的批次会被丢弃，之后追加的批次仍然可以读取
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::app);
+        out << "torn";
+    }
+    {
+        ValueTable table(options);
+        EXPECT_EQ(table.read("6"), "6");
+        table.update("7", "7");
+    }
+    EXPECT_EQ(WriteAheadLog::replay(path, [](const WriteAheadLog::Batch &) {}), 7);
+
+    // 定期同步与异步模式下，flush 之后所有批次都已经落盘
+    for (auto durability: {WriteAheadLog::batched, WriteAheadLog::async}) {
+        std::filesystem::remove(path);
+        WriteAheadLog log(path, durability, 1000);
+        for (int i = 0; i < 100; i++) {
+            EXPECT_TRUE(log.append(i, {{WriteAheadLog::put, std::to_string(i), "v"}}));
+        }
+        EXPECT_TRUE(log.flush());
+        EXPECT_EQ(log.batchNum(), 100);
+        EXPECT_LE(log.syncNum(), log.writeNum());
+        EXPECT_EQ(WriteAheadLog::replay(path, [](const WriteAheadLog::Batch &) {}), 100);
+    }
+
+    // 同步模式下并发提交会合并为更少的同步
+    std::filesystem::remove(path);
+    {
+        WriteAheadLog log(path, WriteAheadLog::sync);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; t++) {
+            threads.emplace_back([&log, t] {
+                for (int i = 0; i < 50; i++) {
+                    log.append(t * 100 + i, {{WriteAheadLog::put, std::to_string(i), "v"}});
+                }
+            });
+        }
+        for (auto &th: threads) {
+            th.join();
+        }
+        EXPECT_EQ(log.batchNum(), 200);
+        EXPECT_LE(log.syncNum(), 200);
+    }
+    EXPECT_EQ(WriteAheadLog::replay(path, [](const WriteAheadLog::Batch &) {}), 200);
+
+    // 并发写入同一个键时日志顺序与版本链上的顺序一致，恢复之后读到的值与之前相同
+    std::filesystem::remove(path);
+    options.load_threads = 1;
+    std::map<std::string, std::string> latest;
+    {
+        ValueTable table(options);
+        std::vector<std::thread> writers;
+        for (int t = 0; t < 4; t++) {
+            writers.emplace_back([&table, t] {
+                for (int i = 0; i < 50; i++) {
+                    auto value = std::to_string(t) + "-" + std::to_string(i);
+                    if (i % 2 == 0)
+                        table.update("race", value);
+                    else
+                        table.bulkWrite({{"bulk", value}, {"race", value}});
+                }
+            });
+        }
+        for (auto &writer: writers) {
+            writer.join();
+        }
+        latest["race"] = table.read("race");
+        latest["bulk"] = table.read("bulk");
+    }
+    {
+        ValueTable table(options);
+        EXPECT_EQ(table.read("race"), latest["race"]);
+        EXPECT_EQ(table.read("bulk"), latest["bulk"]);
+    }
+    std::filesystem::remove(path);
+
+    // 回调在持有值的锁时执行，后一个写操作在前一个的回调结束之后才能写入，最后一次回调对应最新的值
+    for (bool bulk: {false, true}) {
+        Value node;
+        std::mutex mtx;
+        std::vector<std::string> hooked;
+        auto write = [&node, &mtx, &hooked, bulk](const std::string &value, int delay_ms) {
+            auto hook = [&mtx, &hooked, &value, delay_ms](size_t) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
+                std::lock_guard<std::mutex> lg(mtx);
+                hooked.emplace_back(value);
+                return true;
+            };
+            if (bulk) {
+                auto op = Coordinator.startBulkWriteOperation();
+                op.appendOperation(&node, value);
+                return op.run(hook);
+            }
+            return Coordinator.startWriteOperation(&node, value).write(hook);
+        };
+
+        auto slow = std::async(std::launch::async, write, "slow", 20);
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        EXPECT_TRUE(write("fast", 0));
+        EXPECT_TRUE(slow.get());
+
+        ASSERT_EQ(hooked.size(), 2);
+        EXPECT_EQ(node.read(0, true), hooked.back());
+    }
+}
+
+TEST(MVCC_TEST,CHECKPOINT_TEST){
+    auto dir = std::filesystem::temp_directory_path();
+    auto wal_path = (dir / "mvcc_checkpoint_test.log").string();
+    auto path = (dir / "mvcc_checkpoint_test.ckpt").string();
+    std::filesystem::remove(wal_path);
+    std::filesystem::remove(path);
+
+    ValueTable::Options options;
+    options.wal_path = wal_path;
+
+    {
+        ValueTable table(options);
+        for (int i = 0; i < 1000; i++) {
+            table.emplace(std::to_string(i), std::to_string(i));
+        }
+        table.erase("10");
+        table.transaction({{"a", "init"}, {"b", "init"}});
+
+        // 检查点期间写操作不会被阻塞，同一个事务中的两个键在检查点中总是一致的
+        std::atomic<bool> stop = false;
+        std::thread writer([&table, &stop] {
+            for (int i = 0; !stop.load(); i++) {
+                table.transaction({{"a", std::to_string(i)}, {"b", std::to_string(i)}});
+            }
+        });
+
+        for (int round = 0; round < 3; round++) {
+            EXPECT_TRUE(table.checkpoint(path).get());
+
+            std::map<std::string, std::string> records;
+            CheckpointHeader header;
+            EXPECT_TRUE(CheckpointReader::read(path, header, [&records](const std::string &key,
+                                                                        const std::string &value) {
+                records.emplace(key, value);
+            }));
+            EXPECT_EQ(records.size(), 1001);
+            EXPECT_EQ(records.count("10"), 0);
+            EXPECT_EQ(records["a"], records["b"]);
+            EXPECT_GT(header.log_batches_, 1000);
+        }
+
+        stop = true;
+        writer.join();
+
+        // 检查点之后的修改只存在于日志中
+        table.update("1", "new");
+        table.erase("2");
+        table.emplace("new", "new");
+    }
+
+    // 单线程与多线程加载检查点的结果一致
+    options.checkpoint_path = path;
+    for (size_t threads: {1, 4}) {
+        options.load_threads = threads;
+        ValueTable table(options);
+        EXPECT_EQ(table.read("1"), "new");
+        EXPECT_FALSE(table.exist("2"));
+        EXPECT_FALSE(table.exist("10"));
+        EXPECT_EQ(table.read("new"), "new");
+        EXPECT_EQ(table.read("999"), "999");
+        EXPECT_EQ(table.read("a"), table.read("b"));
+
+        size_t count = 0;
+        for (auto it = table.begin(); it != table.end(); ++it) {
+            count++;
+        }
+        EXPECT_EQ(count, 1001);
+    }
+
+    // 检查点可以按下标随机读取，被截断的检查点无效，此时从头回放日志
+    {
+        CheckpointReader reader(path);
+        EXPECT_TRUE(reader.valid());
+        EXPECT_EQ(reader.size(), 1001);
+
+        std::string_view key, value;
+        EXPECT_TRUE(reader.entry(0, key, value));
+        EXPECT_EQ(key, "0");
+        EXPECT_TRUE(reader.entry(1000, key, value));
+        EXPECT_EQ(key, "b");
+        EXPECT_FALSE(reader.entry(1001, key, value));
+    }
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) - 1);
+    EXPECT_FALSE(CheckpointReader(path).valid());
+    {
+        ValueTable table(options);
+        EXPECT_EQ(table.read("1"), "new");
+        EXPECT_FALSE(table.exist("10"));
+        EXPECT_EQ(table.read("999"), "999");
+    }
+
+    // 检查点正在进行时，新的检查点请求会直接失败
+    {
+        ValueTable table;
+        for (int i = 0; i < 10000; i++) {
+            table.emplace(std::to_string(i), std::to_string(i));
+        }
+        auto first = table.checkpoint(path);
+        auto second = table.checkpoint(path);
+        EXPECT_TRUE(first.get());
+        EXPECT_FALSE(second.get());
+    }
+
+    std::filesystem::remove(wal_path);
+    std::filesystem::remove(path);
+}
+
+TEST(MVCC_TEST,VALUE_LOG_TEST){
+    auto path = (std::filesystem::temp_directory_path() / "mvcc_value_log_test.vlog").string();
+
+    // 块缓存按照时钟算法替换，被再次访问过的块会留在缓存中，不完整的块不会被缓存
+    {
+        BlockCache cache(4 * 16, 16);
+        auto load = [](uint64_t block, std::string &data) {
+            data.assign(block == 9 ? 8 : 16, static_cast<char>('a' + block));
+            return true;
+        };
+        for (uint64_t block = 0; block < 4; block++) {
+            EXPECT_EQ(*cache.get(block, load), std::string(16, static_cast<char>('a' + block)));
+        }
+        cache.get(0, load);
+        cache.get(4, load);
+        EXPECT_EQ(cache.missNum(), 5);
+        cache.get(0, load);
+        EXPECT_EQ(cache.hitNum(), 2);
+        cache.get(1, load);
+        EXPECT_EQ(cache.missNum(), 6);
+
+        cache.get(9, load);
+        cache.get(9, load);
+        EXPECT_EQ(cache.missNum(), 8);
+    }
+
+    // 值可以跨越多个块，关闭之后文件被删除
+    {
+        ValueLog log(path, 1024, 64);
+        std::string first, second;
+        EXPECT_TRUE(log.append(std::string(100, 'x'), first));
+        EXPECT_TRUE(log.append("value", second));
+        EXPECT_EQ(log.read(first), std::string(100, 'x'));
+        EXPECT_EQ(log.read(second), "value");
+        EXPECT_EQ(log.size(), 105);
+
+        // 最近被读过的值在下一次检查时才会被换出
+        Value value(std::string(100, 'v'), 1);
+        value.read(1);
+        EXPECT_EQ(value.spill(&log, 64), nullptr);
+        auto replaced = value.spill(&log, 64);
+        EXPECT_NE(replaced, nullptr);
+        delete replaced;
+        EXPECT_LT(value.memoryUse(), 100);
+        EXPECT_EQ(value.read(1), std::string(100, 'v'));
+        EXPECT_EQ(value.spill(&log, 64), nullptr);
+    }
+    EXPECT_FALSE(std::filesystem::exists(path));
+
+    // 超出预算时冷值被换出，读取时从值日志中取回
+    ValueTable::Options options;
+    options.value_log_path = path;
+    options.memory_budget = 256 * 1024;
+    options.stall_timeout_ms = 5;
+    options.vacuum_interval_ms = 0;
+    {
+        ValueTable table(options);
+        std::string payload(4000, 'v');
+        for (int i = 0; i < 500; i++) {
+            table.emplace(std::to_string(i), payload + std::to_string(i));
+        }
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+        while (table.memoryUse() > options.memory_budget && std::chrono::steady_clock::now() < deadline) {
+            table.vacuum();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        EXPECT_LE(table.memoryUse(), options.memory_budget);
+        EXPECT_GT(table.spilledNum(), 0);
+
+        for (int i = 0; i < 500; i++) {
+            EXPECT_EQ(table.read(std::to_string(i)), payload + std::to_string(i));
+        }
+
+        // 换出的值可以被修改和删除，遍历时同样可以读取
+        EXPECT_TRUE(table.update("1", "new"));
+        EXPECT_TRUE(table.erase("2"));
+        EXPECT_EQ(table.read("1"), "new");
+        EXPECT_FALSE(table.exist("2"));
+
+        size_t count = 0;
+        for (auto it = table.begin(); it != table.end(); ++it) {
+            EXPECT_FALSE((*it).empty());
+            count++;
+        }
+        EXPECT_EQ(count, 499);
+
+        table.compact();
+        table.waitForCompaction();
+        EXPECT_EQ(table.read("3"), payload + "3");
+    }
+    EXPECT_FALSE(std::filesystem::exists(path));
+}
+
+TEST(MVCC_TEST,CHANGE_STREAM_TEST){
+    // 未开启变更流时无法订阅
+    {
+        ValueTable table;
+        long cursor = 0;
+        std::vector<ChangeStream::Change> changes;
+        EXPECT_THROW(table.pollChanges(cursor, changes), std::runtime_error);
+    }
+
+    // 一直读取到得到 num 个变更或超时
+    auto pollUntil = [](auto &table, long &cursor, std::vector<ChangeStream::Change> &changes, size_t num) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        bool ok = true;
+        while (ok && changes.size() < num && std::chrono::steady_clock::now() < deadline) {
+            ok = table.pollChanges(cursor, changes, 1024, 10);
+        }
+        return ok;
+    };
+
+    ValueTable::Options options;
+    options.change_stream = true;
+    options.change_history = 100;
+    {
+        ValueTable table(options);
+        EXPECT_EQ(table.lastChangeVersion(), 0);
+
+        table.emplace("a", "1");
+        table.transaction({{"b", "2"}, {"c", "3"}});
+        table.erase("a");
+        table.erase("none");
+        table.bulkWrite({{"d", "4"}});
+
+        long cursor = 0;
+        std::vector<ChangeStream::Change> changes;
+        EXPECT_TRUE(pollUntil(table, cursor, changes, 5));
+        ASSERT_EQ(changes.size(), 5);
+
+        EXPECT_EQ(changes[0].key_, "a");
+        EXPECT_EQ(changes[0].type_, ChangeStream::put);
+        EXPECT_EQ(changes[1].version_, changes[2].version_);
+        EXPECT_EQ(changes[2].key_, "c");
+        EXPECT_EQ(changes[3].type_, ChangeStream::erase);
+        EXPECT_EQ(changes[3].key_, "a");
+        EXPECT_EQ(changes[4].value_, "4");
+        for (size_t i = 1; i < changes.size(); i++) {
+            EXPECT_LE(changes[i - 1].version_, changes[i].version_);
+        }
+        EXPECT_EQ(cursor, changes.back().version_);
+        EXPECT_EQ(table.lastChangeVersion(), cursor);
+
+        // 同一个事务的变更不会被拆分到两次读取中
+        changes.clear();
+        long resume = 0;
+        EXPECT_TRUE(table.pollChanges(resume, changes, 2));
+        EXPECT_EQ(changes.size(), 3);
+
+        // 从游标处继续读取，只返回之后的变更
+        table.update("e", "5");
+        changes.clear();
+        EXPECT_TRUE(pollUntil(table, cursor, changes, 1));
+        ASSERT_EQ(changes.size(), 1);
+        EXPECT_EQ(changes[0].key_, "e");
+
+        // 交互式事务中的删除作为删除发布
+        auto transaction = table.startTransaction();
+        transaction.erase("e");
+        transaction.put("f", "6");
+        EXPECT_TRUE(transaction.commit());
+        changes.clear();
+        EXPECT_TRUE(pollUntil(table, cursor, changes, 2));
+        ASSERT_EQ(changes.size(), 2);
+        EXPECT_EQ(changes[0].key_, "e");
+        EXPECT_EQ(changes[0].type_, ChangeStream::erase);
+        EXPECT_EQ(changes[1].type_, ChangeStream::put);
+
+        // 落后于历史的订阅者需要重新同步
+        for (int i = 0; i < 200; i++) {
+            table.update(std::to_string(i), "v");
+        }
+        bool behind = false;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (!behind && std::chrono::steady_clock::now() < deadline) {
+            resume = cursor;
+            changes.clear();
+            behind = !table.pollChanges(resume, changes, 1024, 10);
+        }
+        EXPECT_TRUE(behind);
+    }
+
+    options.change_history = 1 << 16;
+
+    // 多个线程并发写入时，订阅者看到的变更版本号递增，且不重复、不遗漏
+    {
+        ShardedValueTable table(4, options);
+        long cursor = table.lastChangeVersion();
+
+        std::atomic<bool> ok = true;
+        std::vector<ChangeStream::Change> changes;
+        auto consumer = std::async(std::launch::async, [&] {
+            ok = pollUntil(table, cursor, changes, 4 * 50);
+        });
+
+        std::vector<std::future<void>> writers;
+        for (int t = 0; t < 4; t++) {
+            writers.emplace_back(std::async(std::launch::async, [&table, t] {
+                for (int i = 0; i < 25; i++) {
+                    auto key = std::to_string(t) + "-" + std::to_string(i);
+                    table.transaction({{key + "a", "v"}, {key + "b", "v"}});
+                }
+            }));
+        }
+        for (auto &writer: writers) {
+            writer.get();
+        }
+        consumer.get();
+
+        EXPECT_TRUE(ok);
+        ASSERT_EQ(changes.size(), 4 * 50);
+        std::set<std::string> keys;
+        for (size_t i = 0; i < changes.size(); i++) {
+            keys.insert(changes[i].key_);
+            if (i > 0) {
+                EXPECT_LE(changes[i - 1].version_, changes[i].version_);
+            }
+            if (i % 2 == 1) {
+                EXPECT_EQ(changes[i].version_, changes[i - 1].version_);
+            }
+        }
+        EXPECT_EQ(keys.size(), 4 * 50);
+    }
+
+    // 读操作不会阻挡变更流，长时间的快照与检查点期间变更照常送达
+    {
+        ValueTable table(options);
+        long cursor = table.lastChangeVersion();
+        std::vector<ChangeStream::Change> changes;
+
+        auto read = Coordinator.startReadOperation(nullptr);
+        auto fence = Coordinator.startFenceReadOperation(nullptr);
+        table.update("read", "v");
+        EXPECT_TRUE(pollUntil(table, cursor, changes, 1));
+        ASSERT_EQ(changes.size(), 1);
+        EXPECT_EQ(changes[0].key_, "read");
+    }
+
+    // 未结束的写操作阻挡期间积压的变更分多次取出，逐次归并之后仍然按版本号顺序进入历史
+    {
+        ValueTable table(options);
+        long cursor = table.lastChangeVersion();
+        std::vector<ChangeStream::Change> changes;
+        {
+            auto write = Coordinator.startTransaction();
+
+            std::vector<std::future<void>> writers;
+            for (int t = 0; t < 4; t++) {
+                writers.emplace_back(std::async(std::launch::async, [&table, t] {
+                    for (int i = 0; i < 50; i++) {
+                        table.transaction({{std::to_string(t) + "-" + std::to_string(i), "v"}});
+                        std::this_thread::sleep_for(std::chrono::microseconds(100));
+                    }
+                }));
+            }
+            for (auto &writer: writers) {
+                writer.get();
+            }
+
+            EXPECT_TRUE(table.pollChanges(cursor, changes, 1024, 5));
+            EXPECT_TRUE(changes.empty());
+        }
+
+        EXPECT_TRUE(pollUntil(table, cursor, changes, 4 * 50));
+        ASSERT_EQ(changes.size(), 4 * 50);
+        for (size_t i = 1; i < changes.size(); i++) {
+            EXPECT_LT(changes[i - 1].version_, changes[i].version_);
+        }
+    }
+}
+
+TEST(MVCC_TEST,REPLICATION_TEST){
+    // 日志批次可以拼接在一起传输，不完整的批次等待更多数据
+    {
+        std::string data;
+        WriteAheadLog::encode(data, 7, {{WriteAheadLog::put, "k", "v"}});
+        WriteAheadLog::encode(data, 8, {{WriteAheadLog::erase, "k", ""}});
+
+        WriteAheadLog::Batch batch;
+        auto used = WriteAheadLog::decode(data.data(), data.size(), batch);
+        EXPECT_EQ(batch.version_, 7);
+        EXPECT_EQ(batch.records_[0].value_, "v");
+        EXPECT_EQ(WriteAheadLog::decode(data.data() + used, data.size() - used - 1, batch), 0);
+        EXPECT_EQ(WriteAheadLog::decode(data.data() + used, data.size() - used, batch), data.size() - used);
+        EXPECT_EQ(batch.records_[0].type_, WriteAheadLog::erase);
+
+        data[used + 20] ^= 1;
+        EXPECT_THROW(WriteAheadLog::decode(data.data() + used, data.size() - used, batch), std::runtime_error);
+    }
+
+    ValueTable::Options options;
+    options.change_stream = true;
+    auto path = (std::filesystem::temp_directory_path() / "mvcc_replication_test.ckpt").string();
+
+    // 等待跟随者读到某个值
+    auto waitValue = [](Follower &follower, const std::string &key, const std::string &value) {
+        long version;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (follower.read(key, version) != value && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return follower.read(key, version) == value;
+    };
+
+    {
+        ValueTable primary(options);
+        int fds[2];
+        ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+        std::unique_ptr<Follower> follower(new Follower(fds[1]));
+        {
+            LogShipper shipper(primary, fds[0], 0);
+
+            for (int i = 0; i < 100; i++) {
+                primary.emplace(std::to_string(i), "v" + std::to_string(i));
+            }
+            primary.transaction({{"a", "1"}, {"b", "1"}});
+            primary.erase("5");
+            primary.bulkWrite({{"c", "1"}, {"d", "1"}});
+            primary.update("done", "1");
+
+            ASSERT_TRUE(waitValue(*follower, "done", "1"));
+            EXPECT_FALSE(shipper.failed());
+            EXPECT_EQ(follower->appliedVersion(), shipper.shippedVersion());
+            EXPECT_TRUE(follower->waitFor(shipper.shippedVersion(), 0));
+            EXPECT_LE(follower->applyNum(), shipper.batchNum());
+
+            long version;
+            for (int i = 0; i < 100; i++) {
+                EXPECT_EQ(follower->read(std::to_string(i), version), i == 5 ? "" : "v" + std::to_string(i));
+            }
+            EXPECT_EQ(follower->read("b", version), "1");
+            EXPECT_EQ(follower->read("d", version), "1");
+            EXPECT_EQ(version, follower->appliedVersion());
+
+            // 删除跟随者上不存在的键不是应用失败，同一批次的写入照常应用
+            auto transaction = primary.startTransaction();
+            transaction.erase("missing");
+            transaction.erase("a");
+            transaction.put("e", "1");
+            EXPECT_TRUE(transaction.commit());
+            ASSERT_TRUE(waitValue(*follower, "e", "1"));
+            EXPECT_EQ(follower->read("a", version), "");
+            EXPECT_EQ(follower->read("missing", version), "");
+            EXPECT_FALSE(follower->finished());
+
+            // 并发写入时跟随者读到的版本与值都不会回退
+            std::atomic<bool> stop = false;
+            std::thread writer([&primary, &stop] {
+                for (int i = 0; !stop.load(); i++) {
+                    primary.update("counter", std::to_string(i));
+                }
+            });
+            long last_version = 0;
+            long last_value = -1;
+            for (int i = 0; i < 1000; i++) {
+                auto value = follower->read("counter", version);
+                EXPECT_GE(version, last_version);
+                if (!value.empty()) {
+                    EXPECT_GE(std::stol(value), last_value);
+                    last_value = std::stol(value);
+                }
+                last_version = version;
+            }
+            stop = true;
+            writer.join();
+
+            // 故障切换前可以先检查点，新的跟随者从检查点开始接收之后的变更
+            EXPECT_TRUE(primary.checkpoint(path).get());
+        }
+
+        CheckpointReader reader(path);
+        ASSERT_TRUE(reader.valid());
+        long seed = reader.header().version_;
+
+        int seed_fds[2];
+        ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, seed_fds), 0);
+        ValueTable::Options follower_options;
+        follower_options.checkpoint_path = path;
+        Follower seeded(seed_fds[1], follower_options, seed);
+        {
+            LogShipper shipper(primary, seed_fds[0], seed);
+            primary.update("after", "1");
+
+            ASSERT_TRUE(waitValue(seeded, "after", "1"));
+            long version;
+            EXPECT_EQ(seeded.read("99", version), "v99");
+            EXPECT_EQ(seeded.read("5", version), "");
+            EXPECT_GT(version, seed);
+        }
+
+        // 主节点关闭连接之后跟随者停止
+        ::close(fds[0]);
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (!follower->finished() && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        EXPECT_TRUE(follower->finished());
+        EXPECT_FALSE(follower->waitFor(follower->appliedVersion() + 1, 10));
+        follower.reset();
+
+        ::close(fds[1]);
+        ::close(seed_fds[0]);
+        ::close(seed_fds[1]);
+    }
+    std::filesystem::remove(path);
+
+    // 落后于变更历史的跟随者需要重新初始化
+    options.change_history = 10;
+    {
+        ValueTable primary(options);
+        for (int i = 0; i < 100; i++) {
+            primary.update(std::to_string(i), "v");
+        }
+
+        int fds[2];
+        ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+        LogShipper shipper(primary, fds[0], 0);
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (!shipper.failed() && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        EXPECT_TRUE(shipper.failed());
+        ::close(fds[0]);
+        ::close(fds[1]);
+    }
+}
+
+TEST(MVCC_TEST,MULTI_GET_TEST){
+    // 交错查找的结果与逐个查找相同
+    {
+        SkipList<int> list;
+        for (int i = 0; i < 1000; i += 2) {
+            list.insert(std::to_string(i), i);
+        }
+        list.erase("10");
+
+        std::vector<std::string> keys;
+        for (int i = 0; i < 1000; i++) {
+            keys.emplace_back(std::to_string(i));
+        }
+        keys.emplace_back("");
+        keys.emplace_back("zzz");
+
+        std::vector<const std::string *> ptrs;
+        for (auto &key: keys) {
+            ptrs.emplace_back(&key);
+        }
+        std::vector<SkipList<int>::Iterator> its(keys.size(), list.end());
+        list.findMany(ptrs.data(), ptrs.size(), its.data());
+        for (size_t i = 0; i < 1000; i++) {
+            EXPECT_EQ(its[i] == list.end(), i % 2 == 1 || i == 10);
+            if (its[i] != list.end()) {
+                EXPECT_EQ(*its[i], i);
+            }
+        }
+        EXPECT_TRUE(its[1000] == list.end());
+        EXPECT_TRUE(its[1001] == list.end());
+    }
+
+    auto check = [](auto &table) {
+        for (int i = 0; i < 2000; i++) {
+            table.emplace(std::to_string(i), "v" + std::to_string(i));
+        }
+        for (int i = 0; i < 2000; i += 7) {
+            table.erase(std::to_string(i));
+        }
+        for (int i = 0; i < 2000; i += 5) {
+            table.update(std::to_string(i), "new" + std::to_string(i));
+        }
+
+        std::vector<std::string> keys;
+        for (int i = 2100; i >= 0; i -= 3) {
+            keys.emplace_back(std::to_string(i));
+        }
+        keys.emplace_back("1");
+        keys.emplace_back("1");
+        keys.emplace_back("");
+
+        auto values = table.multiGet(keys);
+        ASSERT_EQ(values.size(), keys.size());
+        for (size_t i = 0; i < keys.size(); i++) {
+            EXPECT_EQ(values[i], table.read(keys[i])) << keys[i];
+        }
+        EXPECT_EQ(values[keys.size() - 2], "v1");
+        EXPECT_TRUE(table.multiGet({}).empty());
+
+        // 所有键在同一个快照中读取，先写入的键不会比后写入的键更旧
+        table.update("a", "0");
+        table.update("b", "0");
+        std::atomic<bool> stop = false;
+        std::thread writer([&table, &stop] {
+            for (int i = 1; !stop.load(); i++) {
+                table.update("a", std::to_string(i));
+                table.update("b", std::to_string(i));
+            }
+        });
+        for (int i = 0; i < 1000; i++) {
+            auto res = table.multiGet({"a", "1", "b"});
+            EXPECT_GE(std::stol(res[0]), std::stol(res[2]));
+        }
+        stop = true;
+        writer.join();
+    };
+
+    // 跳跃表，哈希索引，以及多个内存表组成的链
+    ValueTable::Options options;
+    options.filter_bits_per_key = 0;
+    {
+        ValueTable table(options);
+        check(table);
+    }
+    options.hash_index = true;
+    options.filter_bits_per_key = 10;
+    {
+        ValueTable table(options);
+        check(table);
+    }
+    options.hash_index = false;
+    options.memtable_size = 300;
+    {
+        ValueTable table(options);
+        check(table);
+    }
+    {
+        ShardedValueTable table(4, options);
+        check(table);
+    }
+}
+
+TEST(MVCC_TEST,SERIALIZABLE_TEST){
+    using Writes = std::vector<std::pair<std::string, std::string>>;
+
+    // 两个事务都读取 x 与 y，各自把其中一个置零，快照隔离下会同时提交
+    auto writeSkew = [](ValueTable &table, ValueTable::Isolation isolation) {
+        table.update("x", "1");
+        table.update("y", "1");
+
+        std::atomic<int> arrived = 0;
+        auto run = [&table, &arrived, isolation](const std::string &key) {
+            return table.transaction([&arrived, &key](const ValueTable::TransactionRead &read, Writes &writes) {
+                bool on_call = std::stoi(read("x")) + std::stoi(read("y")) >= 2;
+
+                // 等待另一个事务也完成读取
+                arrived.fetch_add(1);
+                auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+                while (arrived.load() < 2 && std::chrono::steady_clock::now() < deadline) {
+                    std::this_thread::yield();
+                }
+
+                if (on_call)
+                    writes.emplace_back(key, "0");
+                return true;
+            }, isolation);
+        };
+
+        auto first = std::async(std::launch::async, run, "x");
+        auto second = std::async(std::launch::async, run, "y");
+        return first.get() + second.get();
+    };
+
+    {
+        ValueTable table;
+        EXPECT_EQ(writeSkew(table, ValueTable::snapshot), 2);
+        EXPECT_EQ(table.read("x"), "0");
+        EXPECT_EQ(table.read("y"), "0");
+    }
+    {
+        ValueTable table;
+        EXPECT_LE(writeSkew(table, ValueTable::serializable), 1);
+        EXPECT_GE(std::stoi(table.read("x")) + std::stoi(table.read("y")), 1);
+        EXPECT_GE(table.conflictNum(), 1);
+    }
+
+    // 读取之后被其他操作修改的记录，以及读取时还不存在、之后被写入的记录，都会导致提交失败
+    {
+        ValueTable table;
+        table.update("k", "1");
+
+        auto modify = [&table](const std::string &key, ValueTable::Isolation isolation) {
+            return table.transaction([&table, &key](const ValueTable::TransactionRead &read, Writes &writes) {
+                writes.emplace_back("out", read(key) + "!");
+                table.update(key, "changed");
+                return true;
+            }, isolation);
+        };
+        EXPECT_FALSE(modify("k", ValueTable::serializable));
+        EXPECT_FALSE(modify("absent", ValueTable::serializable));
+        EXPECT_EQ(table.conflictNum(), 2);
+        EXPECT_EQ(table.read("out"), "");
+
+        EXPECT_TRUE(modify("k", ValueTable::snapshot));
+        EXPECT_EQ(table.read("out"), "changed!");
+
+        // 只读事务与主动放弃的事务
+        std::string seen;
+        EXPECT_TRUE(table.transaction([&seen](const ValueTable::TransactionRead &read, Writes &) {
+            seen = read("k");
+            return true;
+        }));
+        EXPECT_EQ(seen, "changed");
+        EXPECT_FALSE(table.transaction([](const ValueTable::TransactionRead &, Writes &writes) {
+            writes.emplace_back("k", "aborted");
+            return false;
+        }));
+        EXPECT_EQ(table.read("k"), "changed");
+
+        // 同一个事务读取并修改同一个键
+        EXPECT_TRUE(table.transaction([](const ValueTable::TransactionRead &read, Writes &writes) {
+            writes.emplace_back("k", read("k") + "+");
+            return true;
+        }));
+        EXPECT_EQ(table.read("k"), "changed+");
+    }
+
+    // 并发的读改写在失败时重试，不会丢失更新
+    auto increments = [](auto &table) {
+        std::vector<std::future<void>> workers;
+        for (int t = 0; t < 4; t++) {
+            workers.emplace_back(std::async(std::launch::async, [&table, t] {
+                for (int i = 0; i < 100; i++) {
+                    // 在两个账户之间转账，并累加计数
+                    auto from = "acct" + std::to_string((t + i) % 4);
+                    auto to = "acct" + std::to_string((t + i + 1) % 4);
+                    while (!table.transaction([&from, &to](const ValueTable::TransactionRead &read, Writes &writes) {
+                        auto counter = read("counter");
+                        writes.emplace_back("counter", std::to_string(counter.empty() ? 1 : std::stoi(counter) + 1));
+                        writes.emplace_back(from, std::to_string(std::stoi(read(from)) - 1));
+                        writes.emplace_back(to, std::to_string(std::stoi(read(to)) + 1));
+                        return true;
+                    })) {}
+                }
+            }));
+        }
+        for (auto &worker: workers) {
+            worker.get();
+        }
+
+        EXPECT_EQ(table.read("counter"), "400");
+        int total = 0;
+        for (int i = 0; i < 4; i++) {
+            total += std::stoi(table.read("acct" + std::to_string(i)));
+        }
+        EXPECT_EQ(total, 400);
+    };
+    {
+        ValueTable table;
+        for (int i = 0; i < 4; i++) {
+            table.update("acct" + std::to_string(i), "100");
+        }
+        increments(table);
+    }
+    {
+        ShardedValueTable table(4);
+        for (int i = 0; i < 4; i++) {
+            table.update("acct" + std::to_string(i), "100");
+        }
+        increments(table);
+    }
+}
+
+TEST(MVCC_TEST,INTERACTIVE_TRANSACTION_TEST){
+    using Records = std::vector<std::pair<std::string, std::string>>;
+
+    // 事务内的读取与扫描能看到自己尚未提交的写入，其他操作看不到
+    {
+        ValueTable table;
+        table.update("k1", "1");
+        table.update("k3", "3");
+        table.update("k5", "5");
+        table.update("m", "m");
+
+        auto transaction = table.startTransaction(ValueTable::snapshot);
+        transaction.put("k2", "2");
+        transaction.erase("k3");
+        transaction.put("k5", "five");
+        EXPECT_EQ(transaction.writeNum(), 3);
+
+        EXPECT_EQ(transaction.get("k2"), "2");
+        EXPECT_EQ(transaction.get("k3"), "");
+        EXPECT_EQ(transaction.get("k5"), "five");
+        EXPECT_EQ(transaction.scan("k", "l"), (Records{{"k1", "1"}, {"k2", "2"}, {"k5", "five"}}));
+        EXPECT_EQ(transaction.scan("k2", "", 2), (Records{{"k2", "2"}, {"k5", "five"}}));
+        EXPECT_EQ(transaction.scan("k", "l", 0), Records{});
+        EXPECT_EQ(table.read("k2"), "");
+        EXPECT_EQ(table.read("k3"), "3");
+
+        // 提交之前不持有锁，其他写操作不会被阻塞，快照隔离下读到旧值的事务仍然可以提交
+        EXPECT_TRUE(table.update("m", "changed"));
+        EXPECT_EQ(transaction.get("m"), "m");
+
+        EXPECT_TRUE(transaction.commit());
+        EXPECT_FALSE(transaction.active());
+        EXPECT_THROW(transaction.get("k1"), std::runtime_error);
+        EXPECT_THROW(transaction.commit(), std::runtime_error);
+
+        EXPECT_EQ(table.read("k2"), "2");
+        EXPECT_EQ(table.read("k3"), "");
+        EXPECT_EQ(table.read("k5"), "five");
+
+        auto aborted = table.startTransaction();
+        aborted.put("k1", "aborted");
+        aborted.abort();
+        EXPECT_FALSE(aborted.active());
+        EXPECT_EQ(table.read("k1"), "1");
+    }
+
+    // 扫描过的范围中插入了新的记录时，可串行化事务提交失败
+    auto phantom = [](ValueTable::Isolation isolation, const std::string &inserted, size_t limit) {
+        ValueTable table;
+        table.update("p1", "1");
+        table.update("p5", "5");
+
+        auto transaction = table.startTransaction(isolation);
+        int sum = 0;
+        for (auto &record: transaction.scan("p", "q", limit)) {
+            sum += std::stoi(record.second);
+        }
+        transaction.put("sum", std::to_string(sum));
+
+        table.update(inserted, "3");
+        return transaction.commit();
+    };
+    EXPECT_FALSE(phantom(ValueTable::serializable, "p3", SIZE_MAX));
+    EXPECT_TRUE(phantom(ValueTable::snapshot, "p3", SIZE_MAX));
+    EXPECT_TRUE(phantom(ValueTable::serializable, "q3", SIZE_MAX));
+    EXPECT_TRUE(phantom(ValueTable::serializable, "p3", 1));
+    EXPECT_FALSE(phantom(ValueTable::serializable, "p0", 1));
+
+    // 扫描过的记录被修改或删除时提交失败，事务自己写入的记录不算冲突
+    {
+        ValueTable table;
+        table.update("r1", "1");
+        table.update("r2", "2");
+
+        auto transaction = table.startTransaction();
+        transaction.put("r0", "0");
+        EXPECT_EQ(transaction.scan("r").size(), 3);
+        transaction.put("r3", "3");
+        EXPECT_TRUE(transaction.commit());
+
+        transaction = table.startTransaction();
+        EXPECT_EQ(transaction.scan("r").size(), 4);
+        table.erase("r2");
+        EXPECT_FALSE(transaction.commit());
+        EXPECT_EQ(table.conflictNum(), 1);
+    }
+
+    // 并发地把一组计数器的总和写入新的记录，每一次提交都基于一致的快照
+    {
+        ValueTable table;
+        for (int i = 0; i < 4; i++) {
+            table.update("c" + std::to_string(i), "0");
+        }
+
+        std::vector<std::future<void>> workers;
+        for (int t = 0; t < 4; t++) {
+            workers.emplace_back(std::async(std::launch::async, [&table, t] {
+                for (int i = 0; i < 50; i++) {
+                    while (true) {
+                        auto transaction = table.startTransaction();
+                        auto key = "c" + std::to_string(t);
+                        transaction.put(key, std::to_string(std::stoi(transaction.get(key)) + 1));
+
+                        int total = 0;
+                        for (auto &record: transaction.scan("c", "d")) {
+                            total += std::stoi(record.second);
+                        }
+                        transaction.put("total", std::to_string(total));
+                        if (transaction.commit())
+                            break;
+                    }
+                }
+            }));
+        }
+        for (auto &worker: workers) {
+            worker.get();
+        }
+
+        int total = 0;
+        for (int i = 0; i < 4; i++) {
+            EXPECT_EQ(table.read("c" + std::to_string(i)), "50");
+            total += std::stoi(table.read("c" + std::to_string(i)));
+        }
+        EXPECT_EQ(table.read("total"), std::to_string(total));
+    }
+}
+
+TEST(MVCC_TEST,LOCK_ORDER_TEST){
+    // 事务按照固定顺序加锁，遇到被锁定的值时等待锁释放而不是立即失败，只有超时才失败
+    {
+        Value node;
+        EXPECT_TRUE(node.getLock());
+
+        auto start = std::chrono::steady_clock::now();
+        EXPECT_FALSE(node.getLock(20));
+        EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(20));
+
+        auto waiting = std::async(std::launch::async, [&node] {
+            bool locked = node.getLock(1000);
+            if (locked)
+                node.unlock();
+            return locked;
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        node.unlock();
+        EXPECT_TRUE(waiting.get());
+    }
+
+    // 加锁失败时只释放已经获得的锁，不会释放其他操作持有的锁
+    {
+        Value node1, node2;
+        EXPECT_TRUE(node1.getLock());
+
+        auto transaction = Coordinator.startTransaction();
+        transaction.appendOperation(&node2, "2");
+        transaction.appendOperation(&node1, "1");
+        EXPECT_FALSE(transaction.tryCommit());
+
+        EXPECT_FALSE(std::async(std::launch::async, [&node1] { return node1.getLock(1); }).get());
+        EXPECT_TRUE(std::async(std::launch::async, [&node2] {
+            bool locked = node2.getLock(1);
+            if (locked)
+                node2.unlock();
+            return locked;
+        }).get());
+        node1.unlock();
+    }
+
+    // 两个线程以相反的顺序写入同一组键，冲突的事务等待锁释放，不需要重试
+    {
+        ValueTable table;
+        std::atomic<size_t> retries = 0;
+        auto run = [&table, &retries](const std::string &first, const std::string &second) {
+            for (int i = 0; i < 200; i++) {
+                while (!table.transaction({{first, std::to_string(i)}, {second, std::to_string(i)}})) {
+                    retries.fetch_add(1);
+                }
+            }
+        };
+
+        auto forward = std::async(std::launch::async, run, "a", "b");
+        auto backward = std::async(std::launch::async, run, "b", "a");
+        forward.get();
+        backward.get();
+
+        EXPECT_EQ(table.read("a"), table.read("b"));
+        EXPECT_EQ(retries.load(), 0);
+    }
+}
+
+TEST(MVCC_TEST,GROUP_COMMIT_TEST){
+    auto path = (std::filesystem::temp_directory_path() / "mvcc_group_commit_test.log").string();
+    std::filesystem::remove(path);
+
+    ValueTable::Options options;
+    options.wal_path = path;
+    options.group_commit = true;
+    options.change_stream = true;
+
+    size_t threads = 8, size = 50;
+    {
+        ValueTable table(options);
+
+        // 领导者同步日志期间到达的事务排队，由下一个领导者一起提交
+        std::vector<std::future<size_t>> workers;
+        for (size_t t = 0; t < threads; t++) {
+            workers.emplace_back(std::async(std::launch::async, [&table, t, size] {
+                size_t committed = 0;
+                for (size_t i = 0; i < size; i++) {
+                    auto key = std::to_string(t) + "-" + std::to_string(i);
+                    committed += table.transaction({{key + "a", "v"}, {key + "b", "v"}, {"last", key}});
+                }
+                return committed;
+            }));
+        }
+        size_t committed = 0;
+        for (auto &worker: workers) {
+            committed += worker.get();
+        }
+        EXPECT_EQ(committed, threads * size);
+        EXPECT_GE(table.groupCommitNum(), 1);
+        EXPECT_LT(table.groupCommitNum(), threads * size);
+
+        // 同一组中的事务共享一个版本，变更流中同一个键在一个版本中只出现一次
+        long cursor = 0;
+        std::vector<ChangeStream::Change> changes;
+        auto expected = 2 * threads * size + table.groupCommitNum();
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (changes.size() < expected && std::chrono::steady_clock::now() < deadline) {
+            EXPECT_TRUE(table.pollChanges(cursor, changes, 1024, 10));
+        }
+        EXPECT_EQ(changes.size(), expected);
+
+        std::set<std::pair<long, std::string>> seen;
+        for (auto &change: changes) {
+            EXPECT_TRUE(seen.emplace(change.version_, change.key_).second);
+        }
+    }
+
+    // 每一组是日志中的一个批次，回放之后所有事务都在
+    EXPECT_LT(WriteAheadLog::replay(path, [](WriteAheadLog::Batch &) {}), threads * size);
+    {
+        ValueTable table(options);
+        for (size_t t = 0; t < threads; t++) {
+            for (size_t i = 0; i < size; i++) {
+                auto key = std::to_string(t) + "-" + std::to_string(i);
+                EXPECT_EQ(table.read(key + "a"), "v");
+                EXPECT_EQ(table.read(key + "b"), "v");
+            }
+        }
+        EXPECT_NE(table.read("last"), "");
+    }
+    std::filesystem::remove(path);
+}
+
+TEST(MVCC_TEST,PARALLEL_BULK_WRITE_TEST){
+    auto path = (std::filesystem::temp_directory_path() / "mvcc_parallel_bulk_test.log").string();
+    std::filesystem::remove(path);
+
+    ValueTable::Options options;
+    options.wal_path = path;
+    options.change_stream = true;
+
+    std::vector<std::pair<std::string, std::string>> kvs;
+    for (int i = 0; i < 10000; i++) {
+        kvs.emplace_back(std::to_string(i), std::to_string(i));
+    }
+    kvs.emplace_back("7", "seven");     // 同一个键以后写入的为准
+
+    {
+        ValueTable table(options);
+        auto results = table.parallelBulkWrite(kvs, 4);
+        ASSERT_EQ(results.size(), 4);
+
+        size_t size = 0, applied = 0;
+        for (auto &result: results) {
+            EXPECT_GT(result.size_, 0);
+            EXPECT_EQ(result.applied_, result.size_);
+            size += result.size_;
+            applied += result.applied_;
+        }
+        EXPECT_EQ(size, kvs.size());
+        EXPECT_EQ(applied, kvs.size());
+
+        EXPECT_EQ(table.read("0"), "0");
+        EXPECT_EQ(table.read("9999"), "9999");
+        EXPECT_EQ(table.read("7"), "seven");
+        EXPECT_EQ(table.size(), 10000);
+
+        // 所有分区在同一个版本下提交
+        long cursor = 0;
+        std::vector<ChangeStream::Change> changes;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (changes.size() < kvs.size() && std::chrono::steady_clock::now() < deadline) {
+            EXPECT_TRUE(table.pollChanges(cursor, changes, 1 << 14, 10));
+        }
+        ASSERT_EQ(changes.size(), kvs.size());
+        for (auto &change: changes) {
+            EXPECT_EQ(change.version_, changes.front().version_);
+        }
+
+        auto empty = table.parallelBulkWrite({});
+        size = 0;
+        for (auto &result: empty) {
+            size += result.size_;
+        }
+        EXPECT_EQ(size, 0);
+    }
+
+    // 所有分区是日志中的一个批次
+    EXPECT_EQ(WriteAheadLog::replay(path, [](WriteAheadLog::Batch &) {}), 1);
+    {
+        ValueTable table(options);
+        EXPECT_EQ(table.read("7"), "seven");
+        EXPECT_EQ(table.read("9999"), "9999");
+    }
+    std::filesystem::remove(path);
+}
+
+TEST(MVCC_TEST,SMALL_VECTOR_TEST){
+    // 不超过内联容量时不分配内存，超过之后移动到堆上
+    SmallVector<std::string, 4> values;
+    for (int i = 0; i < 4; i++) {
+        values.emplace_back(std::to_string(i));
+    }
+    EXPECT_TRUE(values.isInline());
+    values.push_back(values[0]);    // 扩容时参数引用自身的元素
+    EXPECT_FALSE(values.isInline());
+    EXPECT_EQ(values.size(), 5);
+    EXPECT_EQ(values.back(), "0");
+
+    // 移动堆上的数组只转移缓冲，移动内联的数组逐个移动元素
+    auto heap = values.capacity();
+    SmallVector<std::string, 4> moved(std::move(values));
+    EXPECT_TRUE(values.empty());
+    EXPECT_TRUE(values.isInline());
+    EXPECT_EQ(moved.capacity(), heap);
+    EXPECT_EQ(moved[4], "0");
+
+    SmallVector<std::string, 4> small;
+    small.emplace_back(std::string(100, 'x'));
+    SmallVector<std::string, 4> other(std::move(small));
+    EXPECT_TRUE(other.isInline());
+    EXPECT_EQ(other[0], std::string(100, 'x'));
+
+    auto copied = moved;
+    copied.resize(2);
+    EXPECT_EQ(copied.size(), 2);
+    EXPECT_EQ(moved.size(), 5);
+    copied = other;
+    EXPECT_EQ(copied.size(), 1);
+    EXPECT_EQ(copied[0], other[0]);
+    copied.clear();
+    EXPECT_TRUE(copied.empty());
+
+    // 移动版本不改变引用计数，被移动的版本不会再次释放
+    {
+        auto transaction = Coordinator.startTransaction();
+        auto moved_transaction = std::move(transaction);
+
+        // 写入数量超过内联容量的事务
+        std::vector<Value> nodes(20);
+        for (auto &node: nodes) {
+            moved_transaction.appendOperation(&node, "v");
+        }
+        EXPECT_TRUE(moved_transaction.tryCommit());
+
+        auto stream = Coordinator.startStreamReadOperation(&nodes[19]);
+        EXPECT_EQ(stream.read(), "v");
+    }
+
+    Version version(1, true);
+    Version taken(std::move(version));
+    EXPECT_EQ(taken.count(), 1);
+    Version copy(taken);
+    EXPECT_EQ(taken.count(), 2);
+    copy = Version(2, true);
+    EXPECT_EQ(taken.count(), 1);
+    EXPECT_EQ(copy.version(), 2);
+}
+
+TEST(MVCC_TEST,ASYNC_COMMIT_TEST){
+    // 不等待锁的提交在值被锁定时立即失败
+    {
+        Value node;
+        EXPECT_TRUE(node.getLock());
+        auto transaction = Coordinator.startTransaction();
+        transaction.appendOperation(&node, "v");
+        auto start = std::chrono::steady_clock::now();
+        EXPECT_FALSE(transaction.tryCommit(nullptr, 0));
+        EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(40));
+        node.unlock();
+        EXPECT_TRUE(transaction.tryCommit(nullptr, 0));
+    }
+
+    // 没有冲突时在调用线程中完成，返回时已经可见
+    {
+        ValueTable table;
+        EXPECT_TRUE(table.transactionAsync({{"a", "1"}, {"b", "2"}}).get());
+        EXPECT_EQ(table.read("a"), "1");
+        EXPECT_EQ(table.read("b"), "2");
+
+        bool called = false;
+        table.transactionAsync({{"a", "3"}}, [&called](bool committed) {
+            EXPECT_TRUE(committed);
+            called = true;
+        });
+        EXPECT_TRUE(called);
+        EXPECT_EQ(table.read("a"), "3");
+        EXPECT_EQ(table.asyncRetryNum(), 0);
+    }
+
+    auto path = (std::filesystem::temp_directory_path() / "mvcc_async_commit_test.log").string();
+    std::filesystem::remove(path);
+
+    ValueTable::Options options;
+    options.wal_path = path;
+
+    size_t size = 0;
+    {
+        ValueTable table(options);
+
+        // 同步日志模式下同步事务在落盘期间持有锁，异步事务遇到锁之后交给重试线程，调用者继续提交
+        std::atomic<bool> stop = false;
+        auto contender = std::async(std::launch::async, [&table, &stop] {
+            while (!stop.load()) {
+                table.transaction({{"hot", "sync"}});
+            }
+        });
+
+        std::vector<std::future<bool>> futures;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (futures.size() < 100 || (table.asyncRetryNum() == 0 && std::chrono::steady_clock::now() < deadline)) {
+            auto key = "async-" + std::to_string(futures.size());
+            futures.emplace_back(table.transactionAsync({{"hot", key}, {key, "v"}}, 1000));
+        }
+        EXPECT_GT(table.asyncRetryNum(), 0);
+
+        // 回调在提交之后并且批次落盘之后才会发生
+        for (auto &future: futures) {
+            EXPECT_TRUE(future.get());
+        }
+        stop.store(true);
+        contender.get();
+
+        size = futures.size();
+        for (size_t i = 0; i < size; i++) {
+            EXPECT_EQ(table.read("async-" + std::to_string(i)), "v");
+        }
+    }
+
+    {
+        ValueTable table(options);
+        for (size_t i = 0; i < size; i++) {
+            EXPECT_EQ(table.read("async-" + std::to_string(i)), "v");
+        }
+    }
+    std::filesystem::remove(path);
+
+    // 等待重试的异步事务不持有版本，不会阻挡最低存活版本；重试时分配新的版本
+    {
+        ValueTable::Options stall;
+        stall.memory_budget = 1;
+        stall.stall_timeout_ms = 5000;
+        ValueTable table(stall);
+        table.emplace("a", "1");
+        table.waitForCompaction();
+
+        std::future<bool> future;
+        {
+            // 压缩等待读操作结束，期间写入一直处于停顿状态
+            auto read = Coordinator.startReadOperation(nullptr);
+            table.compact();
+
+            auto alive = Coordinator.aliveOperationNum();
+            auto retries = table.asyncRetryNum();
+            future = table.transactionAsync({{"a", "2"}});
+            EXPECT_GT(table.asyncRetryNum(), retries);
+            EXPECT_EQ(Coordinator.aliveOperationNum(), alive);
+            EXPECT_EQ(future.wait_for(std::chrono::milliseconds(20)), std::future_status::timeout);
+            EXPECT_EQ(Coordinator.aliveOperationNum(), alive);
+        }
+
+        EXPECT_TRUE(future.get());
+        EXPECT_EQ(table.read("a"), "2");
+    }
+}
+
+TEST(MVCC_TEST,READ_ONLY_TRANSACTION_TEST){
+    auto alive = Coordinator.aliveOperationNum();
+
+    // 只读事务公布在读槽位中，版本清理保留快照可见的版本
+    Value node;
+    Coordinator.startWriteOperation(&node, "v1").write();
+    {
+        auto read = Coordinator.startReadOnlyTransaction();
+        EXPECT_EQ(read.version(), Coordinator.getNewestVersion());
+        EXPECT_LE(Coordinator.getLowestVersion(), read.version());
+        EXPECT_EQ(Coordinator.aliveOperationNum(), alive + 1);
+
+        Coordinator.startWriteOperation(&node, "v2").write();
+        Coordinator.startWriteOperation(&node, "v3").write();
+        EXPECT_EQ(read.read(&node), "v1");
+
+        // 嵌套的只读事务使用更新的快照，外层的版本仍然留在槽位中
+        {
+            auto inner = Coordinator.startReadOnlyTransaction();
+            EXPECT_EQ(inner.read(&node), "v3");
+        }
+        EXPECT_EQ(read.read(&node), "v1");
+        EXPECT_LE(Coordinator.getLowestVersion(), read.version());
+    }
+    EXPECT_EQ(Coordinator.aliveOperationNum(), alive);
+
+    // 等待版本释放时也会等待读槽位中的快照
+    {
+        std::promise<void> pinned, finish;
+        auto reader = std::async(std::launch::async, [&pinned, &finish] {
+            auto read = Coordinator.startReadOnlyTransaction();
+            pinned.set_value();
+            finish.get_future().wait();
+        });
+        pinned.get_future().wait();
+
+        auto fence = Coordinator.fenceVersion();
+        auto waiter = std::async(std::launch::async, [fence] {
+            Coordinator.waitVersionRelease(fence);
+        });
+        EXPECT_EQ(waiter.wait_for(std::chrono::milliseconds(50)), std::future_status::timeout);
+        finish.set_value();
+        EXPECT_EQ(waiter.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+        reader.get();
+    }
+
+    // 槽位用完之后的线程退回到登记版本
+    {
+        size_t threads = 160;
+        std::mutex mtx;
+        std::condition_variable cv;
+        size_t started = 0;
+        bool finished = false;
+
+        std::vector<std::future<std::string>> readers;
+        for (size_t i = 0; i < threads; i++) {
+            readers.emplace_back(std::async(std::launch::async, [&] {
+                auto read = Coordinator.startReadOnlyTransaction();
+                std::unique_lock<std::mutex> lk(mtx);
+                started++;
+                cv.notify_all();
+                cv.wait(lk, [&finished] { return finished; });
+                return read.read(&node);
+            }));
+        }
+        {
+            std::unique_lock<std::mutex> lk(mtx);
+            cv.wait(lk, [&] { return started == threads; });
+            EXPECT_EQ(Coordinator.aliveOperationNum(), alive + threads);
+            finished = true;
+        }
+        cv.notify_all();
+        for (auto &reader: readers) {
+            EXPECT_EQ(reader.get(), "v3");
+        }
+    }
+    EXPECT_EQ(Coordinator.aliveOperationNum(), alive);
+
+    // 没有得到槽位的线程在其他线程退出归还槽位之后重新获取
+    {
+        std::mutex mtx;
+        std::condition_variable cv;
+        size_t started = 0;
+        bool finished = false;
+
+        std::vector<std::thread> holders;
+        for (size_t i = 0; i < 128; i++) {
+            holders.emplace_back([&] {
+                auto read = Coordinator.startReadOnlyTransaction();
+                std::unique_lock<std::mutex> lk(mtx);
+                started++;
+                cv.notify_all();
+                cv.wait(lk, [&finished] { return finished; });
+            });
+        }
+        {
+            std::unique_lock<std::mutex> lk(mtx);
+            cv.wait(lk, [&] { return started == holders.size(); });
+        }
+        EXPECT_EQ(Coordinator.ownedSlotNum(), 128);
+
+        std::promise<void> tried, released;
+        std::thread late([&] {
+            {
+                auto read = Coordinator.startReadOnlyTransaction();
+                EXPECT_EQ(read.read(&node), "v3");
+            }
+            tried.set_value();
+            released.get_future().wait();
+
+            auto owned = Coordinator.ownedSlotNum();
+            auto read = Coordinator.startReadOnlyTransaction();
+            EXPECT_EQ(Coordinator.ownedSlotNum(), owned + 1);
+        });
+
+        tried.get_future().wait();
+        {
+            std::lock_guard<std::mutex> lg(mtx);
+            finished = true;
+        }
+        cv.notify_all();
+        for (auto &holder: holders) {
+            holder.join();
+        }
+        released.set_value();
+        late.join();
+    }
+    EXPECT_EQ(Coordinator.aliveOperationNum(), alive);
+
+    // 表的点查与批量点查使用只读事务
+    ValueTable table;
+    table.emplace("a", "1");
+    table.emplace("b", "2");
+    EXPECT_EQ(table.read("a"), "1");
+    EXPECT_EQ(table.multiGet({"a", "b", "c"}), (std::vector<std::string>{"1", "2", ""}));
+    EXPECT_EQ(Coordinator.aliveOperationNum(), alive);
+}
+
+TEST(MVCC_TEST,ERASE_REVIVE_TEST){
+    for (bool hash_index: {false, true}) {
+        ValueTable::Options options;
+        options.hash_index = hash_index;
+        ValueTable table(options);
+
+        table.emplace("a", "1");
+        EXPECT_TRUE(table.erase("a"));
+
+        // 写入已删除的键在验证失败时回滚，被删除的旧值不能因为节点恢复而重新可见
+        auto transaction = table.startTransaction(ValueTable::serializable);
+        EXPECT_EQ(transaction.get("b"), "");
+        transaction.put("a", "2");
+        table.emplace("b", "x");
+        EXPECT_FALSE(transaction.commit());
+
+        EXPECT_FALSE(table.exist("a"));
+        EXPECT_EQ(table.read("a"), "");
+        EXPECT_EQ(table.multiGet({"a"}), std::vector<std::string>{""});
+        for (auto it = table.begin(); it != table.end(); ++it) {
+            EXPECT_NE(it.key(), "a");
+        }
+
+        // 提交之后只有新写入的值可见
+        {
+            auto pending = table.startTransaction(ValueTable::snapshot);
+            pending.put("a", "3");
+            EXPECT_EQ(table.read("a"), "");
+            EXPECT_TRUE(pending.commit());
+        }
+        EXPECT_TRUE(table.exist("a"));
+        EXPECT_EQ(table.read("a"), "3");
+
+        // 再次删除之后重新写入
+        EXPECT_TRUE(table.erase("a"));
+        EXPECT_FALSE(table.exist("a"));
+        EXPECT_TRUE(table.emplace("a", "4"));
+        EXPECT_EQ(table.read("a"), "4");
+        EXPECT_EQ(table.size(), 2);
+    }
+}
+
+TEST(MVCC_TEST,VERSION_RELEASE_CALLBACK_TEST){
+    // 没有存活版本时回调立即在当前线程调用
+    bool called = false;
+    Coordinator.onVersionRelease(Coordinator.fenceVersion(), [&called] { called = true; });
+    EXPECT_TRUE(called);
+
+    std::atomic<bool> released = false;
+    {
+        auto read = Coordinator.startReadOperation(nullptr);
+        Coordinator.onVersionRelease(Coordinator.fenceVersion(), [&released] { released = true; });
+        EXPECT_FALSE(released.load());
+    }
+    EXPECT_TRUE(released.load());
+
+    // 压缩与检查点等待读操作结束时不占用工作线程，只有一个工作线程时其他任务也能执行
+    auto workers = Maintenance.workerNum();
+    Maintenance.setWorkerNum(1);
+    auto path = (std::filesystem::temp_directory_path() / "mvcc_release_callback.ckpt").string();
+    {
+        ValueTable table;
+        for (int i = 0; i < 100; i++) {
+            table.emplace(std::to_string(i), std::to_string(i));
+        }
+
+        std::future<bool> checkpoint;
+        {
+            auto read = Coordinator.startReadOperation(nullptr);
+            table.compact();
+            checkpoint = table.checkpoint(path);
+
+            int owner = 0;
+            std::promise<void> done;
+            Maintenance.submit(&owner, MaintenanceExecutor::low, [&done] { done.set_value(); });
+            EXPECT_EQ(done.get_future().wait_for(std::chrono::seconds(1)), std::future_status::ready);
+            EXPECT_EQ(checkpoint.wait_for(std::chrono::milliseconds(10)), std::future_status::timeout);
+            Maintenance.cancel(&owner);
+        }
+
+        EXPECT_TRUE(checkpoint.get());
+        table.waitForCompaction();
+        EXPECT_EQ(table.read("10"), "10");
+    }
+    Maintenance.setWorkerNum(workers);
+    std::filesystem::remove(path);
+}
+
+TEST(MVCC_TEST,LOAD_POOL_TEST){
+    LoadPool pool(3);
+
+    // 分区多于线程时每个分区也只执行一次，多次加载复用同一组线程
+    std::mutex mtx;
+    std::set<std::thread::id> threads;
+    for (int round = 0; round < 10; round++) {
+        std::vector<int> runs(16, 0);
+        pool.run(runs.size(), [&](size_t part) {
+            std::lock_guard<std::mutex> lg(mtx);
+            runs[part]++;
+            threads.emplace(std::this_thread::get_id());
+        });
+        EXPECT_EQ(runs, std::vector<int>(16, 1));
+    }
+    EXPECT_LE(threads.size(), 4);
+
+    // 并发的加载共用线程
+    std::atomic<size_t> sum = 0;
+    std::vector<std::future<void>> loads;
+    for (int i = 0; i < 4; i++) {
+        loads.emplace_back(std::async(std::launch::async, [&pool, &sum] {
+            pool.run(8, [&sum](size_t part) { sum.fetch_add(part); });
+        }));
+    }
+    for (auto &load: loads) {
+        load.get();
+    }
+    EXPECT_EQ(sum.load(), 4 * 28);
+
+    // 分区抛出的异常在其他分区结束之后交给调用者
+    std::atomic<int> finished = 0;
+    EXPECT_THROW(pool.run(4, [&finished](size_t part) {
+        if (part == 2)
+            throw std::runtime_error("part failed");
+        finished++;
+    }), std::runtime_error);
+    EXPECT_EQ(finished.load(), 3);
+}